@@ -0,0 +1,166 @@
+// conv_bench.cpp
+//
+// CPU load of streaming convolution for one channel at 48 kHz through a
+// 5 s impulse response: the non-uniformly partitioned convolver against
+// a uniformly partitioned one with the same block (and latency). Load is
+// process CPU time, background threads included, over the duration of
+// the audio; the worst call is the longest process () as a fraction of
+// one block period, which is what an audio callback has to fit in. The
+// partitioned convolver is driven in real time, one block per period as
+// a device would, since its background stages get that time to finish;
+// the uniform one has no background work and runs flat out.
+//
+// A second table calibrates the cost model of conv_choose (): each
+// method's time for a signal and a kernel against its prediction, and
+// the method chosen.
+//
+// usage: conv_bench [seconds of audio] [max block]
+
+#include "signals/convolver.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const double SR = 48000;
+
+template <typename F>
+static double seconds_per_call (F f) {
+	using clock = chrono::steady_clock;
+	long reps = 0;
+	auto t0 = clock::now ();
+	double elapsed = 0;
+	do {
+		f ();
+		++reps;
+		elapsed = chrono::duration<double> (clock::now () - t0).count ();
+	} while (elapsed < 0.2);
+	return elapsed / reps;
+}
+
+static double time_fft (const vector<double>& x, const vector<double>& h, long N) {
+	vector<double> X (N + 2), H (N + 2);
+	return seconds_per_call ([&] {
+		fill (X.begin (), X.end (), 0);
+		fill (H.begin (), H.end (), 0);
+		copy (x.begin (), x.end (), X.begin ());
+		copy (h.begin (), h.end (), H.begin ());
+		rfft<double> (&X[0], &X[0], N);
+		rfft<double> (&H[0], &H[0], N);
+		for (long k = 0; k <= N / 2; ++k) {
+			double xr = X[2 * k], xi = X[2 * k + 1];
+			X[2 * k] = xr * H[2 * k] - xi * H[2 * k + 1];
+			X[2 * k + 1] = xr * H[2 * k + 1] + xi * H[2 * k];
+		}
+		irfft<double> (&X[0], &X[0], N);
+	});
+}
+
+static double time_blocked (const vector<double>& x, const vector<double>& h, long B) {
+	long len = (long) (x.size () + h.size () - 1);
+	vector<double> buf (B);
+	return seconds_per_call ([&] {
+		UniformConvolver<double> conv (h.data (), (long) h.size (), B);
+		for (long pos = 0; pos < len; pos += B) {
+			long n = pos < (long) x.size () ? min (B, (long) x.size () - pos) : 0;
+			fill (buf.begin (), buf.end (), 0);
+			copy (x.begin () + pos, x.begin () + pos + n, buf.begin ());
+			conv.process (&buf[0], &buf[0]);
+		}
+	});
+}
+
+static void calibrate () {
+	printf ("\nconv method choice (times in ms, predicted in brackets)\n\n");
+	printf ("%8s %7s %17s %17s %23s %9s\n", "signal", "kernel", "direct", "fft", "blocked", "chosen");
+	static const char* names[] = {"direct", "fft", "blocked"};
+	mt19937_64 gen (2);
+	normal_distribution<double> dist (0, 1);
+	long sizes[][2] = {{100000, 8}, {100000, 32}, {100000, 128}, {100000, 512}, {1000000, 64},
+		{1000000, 4096}, {1000000, 65536}, {10000, 10000}, {200000, 200000}, {2000000, 240000}};
+	for (auto& sz : sizes) {
+		vector<double> x (sz[0]), h (sz[1]), y (sz[0] + sz[1] - 1);
+		for (auto& v : x) v = dist (gen);
+		for (auto& v : h) v = dist (gen);
+		double lx = (double) sz[0], lh = (double) sz[1];
+		double t_dir = lx * lh < 2e9 ? seconds_per_call ([&] {
+			direct_convolve<double> (x.data (), sz[0], h.data (), sz[1], y.data ()); }) : 0;
+		long N = (long) fft_good_size ((size_t) (sz[0] + sz[1] - 1));
+		double t_fft = time_fft (x, h, N);
+		ConvChoice c = conv_choose (sz[0], sz[1]);
+		long B = 64;
+		if (c.method == CONV_BLOCKED) B = c.size;
+		else while (B < min (sz[1], 65536L)) B *= 2;
+		double t_blk = time_blocked (x, h, B);
+		double blocks = ceil ((lx + lh - 1) / B), parts = ceil (lh / B);
+		double p_blk = parts * conv_rfft_cost (2 * B)
+			+ blocks * (2 * conv_rfft_cost (2 * B) + CONV_BLOCK_NS * B + parts * CONV_CMAC_NS * (B + 1));
+		printf ("%8ld %7ld %8.2f [%6.2f] %8.2f [%6.2f] %6ld: %6.2f [%6.2f] %9s\n", sz[0], sz[1],
+			t_dir * 1e3, (CONV_DIRECT_NS * lx * lh + CONV_COPY_NS * (lx + lh - 1)) * 1e-6,
+			t_fft * 1e3, (3 * conv_rfft_cost (N) + CONV_CMAC_NS * (N / 2 + 1)) * 1e-6,
+			B, t_blk * 1e3, p_blk * 1e-6, names[c.method]);
+	}
+}
+
+struct Load {
+	double cpu, worst, mean;
+};
+
+template <typename Engine>
+static Load run (Engine& engine, long block, const vector<double>& x, bool paced) {
+	using clock = chrono::steady_clock;
+	vector<double> y (block);
+	long calls = (long) x.size () / block;
+	double worst = 0, total = 0;
+	auto start = clock::now ();
+	clock_t c0 = std::clock ();
+	for (long i = 0; i < calls; ++i) {
+		if (paced) this_thread::sleep_until (start + chrono::duration<double> (i * block / SR));
+		auto t0 = clock::now ();
+		engine.process (&x[i * block], &y[0]);
+		double t = chrono::duration<double> (clock::now () - t0).count ();
+		worst = max (worst, t);
+		total += t;
+	}
+	double cpu = (double) (std::clock () - c0) / CLOCKS_PER_SEC;
+	double period = block / SR, audio = calls * period;
+	return Load {cpu / audio, worst / period, total / calls / period};
+}
+
+int main (int argc, char* argv[]) {
+	double seconds = argc > 1 ? atof (argv[1]) : 5;
+	if (seconds <= 0) {
+		calibrate ();
+		return 0;
+	}
+	long max_block = argc > 2 ? atol (argv[2]) : 16384;
+
+	mt19937_64 gen (1);
+	normal_distribution<double> dist (0, 1);
+	vector<double> ir ((size_t) (5 * SR)), x ((size_t) (seconds * SR));
+	for (size_t i = 0; i < ir.size (); ++i) ir[i] = dist (gen) * exp (-6.9 * i / ir.size ());
+	for (auto& v : x) v = dist (gen);
+
+	printf ("5 s response at 48 kHz, %.0f s of audio, loads per channel\n\n", seconds);
+	printf ("%6s %9s %7s %9s %9s %9s %11s\n", "block", "latency", "stages",
+		"load", "mean call", "worst", "uniform");
+	for (long block : {32L, 64L, 128L, 256L, 512L}) {
+		PartitionedConvolver<double> part (ir.data (), (long) ir.size (), block, max_block);
+		Load p = run (part, block, x, true);
+		UniformConvolver<double> uni (ir.data (), (long) ir.size (), block);
+		Load u = run (uni, block, x, false);
+		printf ("%6ld %7.2fms %7ld %8.1f%% %8.1f%% %8.1f%% %10.1f%%\n", block, 1000 * block / SR,
+			part.stages (), 100 * p.cpu, 100 * p.mean, 100 * p.worst, 100 * u.cpu);
+	}
+	calibrate ();
+	return 0;
+}
+
+// EOF
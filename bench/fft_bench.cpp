@@ -0,0 +1,117 @@
+// fft_bench.cpp
+//
+// Times the FFT kernels at power-of-two sizes: the table-free radix-2
+// kernel (fft_unplanned), the planned radix-2 reference, the planned kernel
+// the CPU selects and the four-step layout. Accuracy is reported against
+// the radix-2 reference, plus the round trip of fft () as dispatched.
+// A second table times sizes that are not powers of two (mixed radix or
+// Bluestein) against the next power of two and fft_good_size ().
+//
+// usage: fft_bench [min size] [max size]
+
+#include "signals/FFT.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+typedef function<void (double*, long)> Kernel;   // (data, sign)
+
+static double seconds_per_call (const Kernel& k, vector<double> buf, long N) {
+	using clock = chrono::steady_clock;
+	k (buf.data (), -1);
+	long reps = 0;
+	auto t0 = clock::now ();
+	double elapsed = 0;
+	do {
+		k (buf.data (), -1);
+		k (buf.data (), +1);
+		for (auto& v : buf) v /= (double) N;
+		reps += 2;
+		elapsed = chrono::duration<double> (clock::now () - t0).count ();
+	} while (elapsed < 0.25);
+	return elapsed / reps;
+}
+
+static double distance (const Kernel& k, const vector<double>& x, const vector<double>& ref) {
+	vector<double> buf (x);
+	k (buf.data (), -1);
+	double d = 0, peak = 0;
+	for (size_t i = 0; i < buf.size (); ++i) {
+		d = max (d, fabs (buf[i] - ref[i]));
+		peak = max (peak, fabs (ref[i]));
+	}
+	return d / peak;
+}
+
+static double roundtrip_error (const Kernel& k, const vector<double>& x, long N) {
+	vector<double> buf (x);
+	k (buf.data (), -1);
+	k (buf.data (), +1);
+	double err = 0;
+	for (size_t i = 0; i < buf.size (); ++i) err = max (err, fabs (buf[i] / N - x[i]));
+	return err;
+}
+
+int main (int argc, char* argv[]) {
+	long lo = argc > 1 ? atol (argv[1]) : 256;
+	long hi = argc > 2 ? atol (argv[2]) : 4194304;
+
+	FFTKernel best = fft_best_kernel ();
+	printf ("selected kernel: %s, four-step from %d points\n\n", fft_kernel_name (best), FFT_FOUR_STEP_MIN);
+	printf ("%9s %11s %11s %11s %11s %8s %9s %9s %9s\n", "size", "unplan us", "radix-2 us",
+		"direct us", "4-step us", "speedup", "err dir", "err 4st", "roundtrip");
+
+	mt19937_64 gen (1);
+	uniform_real_distribution<double> dist (-1, 1);
+	for (long N = lo; N <= hi; N <<= 1) {
+		vector<double> x (2 * N);
+		for (auto& v : x) v = dist (gen);
+
+		FFTPlan<double> direct (N, false), split (N, true);
+		Kernel unplanned = [N] (double* d, long s) { fft_unplanned<double> (d, N, s); };
+		Kernel radix2 = [&] (double* d, long s) { direct.execute (d, s, FFT_RADIX2); };
+		Kernel fast = [&] (double* d, long s) { direct.execute (d, s, best); };
+		Kernel four = [&] (double* d, long s) { split.execute (d, s, best); };
+		Kernel dispatched = [N] (double* d, long s) { fft<double> (d, N, s); };
+
+		vector<double> ref (x);
+		radix2 (ref.data (), -1);
+
+		double t_old = seconds_per_call (unplanned, x, N);
+		double t_r2 = seconds_per_call (radix2, x, N);
+		double t_fast = seconds_per_call (fast, x, N);
+		double t_four = seconds_per_call (four, x, N);
+		double t_used = N >= FFT_FOUR_STEP_MIN ? t_four : t_fast;
+		printf ("%9ld %11.1f %11.1f %11.1f %11.1f %7.2fx %9.1e %9.1e %9.1e\n", N, t_old * 1e6,
+			t_r2 * 1e6, t_fast * 1e6, t_four * 1e6, t_r2 / t_used, distance (fast, x, ref),
+			distance (four, x, ref), roundtrip_error (dispatched, x, N));
+	}
+
+	printf ("\n%9s %9s %11s %11s %11s %9s %9s\n", "size", "plan", "size us", "pow2 us",
+		"good us", "good", "roundtrip");
+	for (long N : {1000L, 1536L, 3000L, 6000L, 10007L, 44100L, 48000L, 100000L, 250000L, 1000003L}) {
+		if (N < lo || N > hi) continue;
+		long P = 1, G = fft_good_size (N);
+		while (P < N) P <<= 1;
+		vector<double> x (2 * P);
+		for (auto& v : x) v = dist (gen);
+		Kernel at_size = [N] (double* d, long s) { fft<double> (d, N, s); };
+		Kernel at_pow2 = [P] (double* d, long s) { fft<double> (d, P, s); };
+		Kernel at_good = [G] (double* d, long s) { fft<double> (d, G, s); };
+		printf ("%9ld %9s %11.1f %11.1f %11.1f %9ld %9.1e\n", N,
+			mixed_fft_plan<double> (N)->bluestein () ? "bluestein" : "mixed",
+			seconds_per_call (at_size, vector<double> (x.begin (), x.begin () + 2 * N), N) * 1e6,
+			seconds_per_call (at_pow2, x, P) * 1e6,
+			seconds_per_call (at_good, vector<double> (x.begin (), x.begin () + 2 * G), G) * 1e6, G,
+			roundtrip_error (at_size, vector<double> (x.begin (), x.begin () + 2 * N), N));
+	}
+	return 0;
+}
+
+// eof
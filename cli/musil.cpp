@@ -6,34 +6,348 @@
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <map>
 #include <string>
-#include <ctime>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace std;
 
-int main (int argc, char* argv[]) {
-    std::srand(time (NULL));
-    Environment interpreter;
+// parses sizes such as 512M, 2G or 1048576 (bytes)
+static size_t parse_size (const char* s) {
+	char* end = nullptr;
+	double v = strtod (s, &end);
+	if (end == s || v < 0) throw runtime_error (string ("invalid size '") + s + "'");
+	switch (toupper ((unsigned char) *end)) {
+	case 'K': v *= 1024.0; break;
+	case 'M': v *= 1024.0 * 1024.0; break;
+	case 'G': v *= 1024.0 * 1024.0 * 1024.0; break;
+	case '\0': break;
+	default: throw runtime_error (string ("invalid size '") + s + "'");
+	}
+	return (size_t) v;
+}
+
+static bool read_file (const string& path, string& src) {
+	ifstream f (path);
+	if (!f) return false;
+	src.assign (istreambuf_iterator<char> (f), {});
+	return true;
+}
+
+// Server mode
+//
+// musil --serve SOCK keeps one environment with the builtins registered and
+// the libraries preloaded, and forks it once per job: the job inherits the
+// warm state copy-on-write, so it starts without registering or loading
+// anything. musil --client SOCK sends the client's working directory, a
+// script (a path, or the source read from stdin) and its stdin, stdout and
+// stderr descriptors; the job writes straight to the client's terminal and
+// its exit status is sent back. A client given several files submits one
+// job per file, so a batch pays for a single client process.
+//
+// Request: a 4-byte length carrying the three descriptors, then the cwd and
+// the script ('f' path or 's' source), each ended by a NUL byte.
+// Reply: the 4-byte exit status.
+
+static volatile sig_atomic_t g_stop = 0;
+static void on_stop (int) { g_stop = 1; }
+
+static bool read_all (int fd, void* buf, size_t n) {
+	char* p = (char*) buf;
+	while (n) {
+		ssize_t r = ::read (fd, p, n);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) return false;
+		p += r; n -= (size_t) r;
+	}
+	return true;
+}
+
+static bool write_all (int fd, const void* buf, size_t n) {
+	const char* p = (const char*) buf;
+	while (n) {
+		ssize_t r = ::write (fd, p, n);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) return false;
+		p += r; n -= (size_t) r;
+	}
+	return true;
+}
+
+static sockaddr_un socket_address (const string& path) {
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+	if (path.empty () || path.size () >= sizeof (addr.sun_path))
+		throw runtime_error ("invalid socket path '" + path + "'");
+	memcpy (addr.sun_path, path.c_str (), path.size () + 1);
+	return addr;
+}
+
+static int connect_to (const string& path) {
+	sockaddr_un addr = socket_address (path);
+	int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (connect (fd, (sockaddr*) &addr, sizeof (addr)) < 0) {
+		::close (fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int submit (const string& path, const string& req) {
+	int fd = connect_to (path);
+	if (fd < 0) throw runtime_error ("cannot connect to '" + path + "'");
+
+	uint32_t len = (uint32_t) req.size ();
+	int fds[3] = {0, 1, 2};
+	char ctrl[CMSG_SPACE (sizeof (fds))] = {};
+	iovec iov {&len, sizeof (len)};
+	msghdr msg {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl;
+	msg.msg_controllen = sizeof (ctrl);
+	cmsghdr* cm = CMSG_FIRSTHDR (&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN (sizeof (fds));
+	memcpy (CMSG_DATA (cm), fds, sizeof (fds));
+
+	int32_t status = 1;
+	if (sendmsg (fd, &msg, 0) != (ssize_t) sizeof (len)
+		|| !write_all (fd, req.data (), req.size ())
+		|| !read_all (fd, &status, sizeof (status))) {
+		::close (fd);
+		throw runtime_error ("lost connection to '" + path + "'");
+	}
+	::close (fd);
+	return status;
+}
+
+// every file is a job of its own, run in order; the source read from stdin
+// is one job when no files are given
+static int run_client (const string& path, const vector<string>& files) {
+	char buf[4096];
+	if (!getcwd (buf, sizeof (buf))) throw runtime_error ("cannot read the working directory");
+	string cwd (buf, strlen (buf) + 1);
+	if (files.empty ()) {
+		string src (istreambuf_iterator<char> (cin), {});
+		return submit (path, cwd + 's' + src + '\0');
+	}
+	int status = 0;
+	for (auto& f : files) {
+		int s = submit (path, cwd + 'f' + f + '\0');
+		if (s) status = s;
+	}
+	return status;
+}
+
+// the job process: reads the request, installs the client's descriptors
+// and runs the script
+static int handle (Environment& env, int conn) {
+	uint32_t len = 0;
+	int fds[3] = {-1, -1, -1};
+	char ctrl[CMSG_SPACE (sizeof (fds))] = {};
+	iovec iov {&len, sizeof (len)};
+	msghdr msg {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl;
+	msg.msg_controllen = sizeof (ctrl);
+	if (recvmsg (conn, &msg, 0) != (ssize_t) sizeof (len)) return 1;
+	cmsghdr* cm = CMSG_FIRSTHDR (&msg);
+	if (!cm || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN (sizeof (fds))) return 1;
+	memcpy (fds, CMSG_DATA (cm), sizeof (fds));
 
-    add_scientific(interpreter);
-    add_system(interpreter);
-    add_signals(interpreter);
-    add_plotting(interpreter);
-	add_rtsound(interpreter);
+	string req (len, '\0');
+	if (!read_all (conn, &req[0], len)) return 1;
+	::close (conn);
+	size_t cut = req.find ('\0');
+	if (cut == string::npos || cut + 1 >= req.size ()) return 1;
+	string cwd = req.substr (0, cut);
+	char kind = req[cut + 1];
+	string item = req.substr (cut + 2);
+	if (!item.empty () && item.back () == '\0') item.pop_back ();
 
+	for (int i = 0; i < 3; ++i) {
+		dup2 (fds[i], i);
+		::close (fds[i]);
+	}
+	if (chdir (cwd.c_str ()) < 0) {
+		cerr << "cannot enter '" << cwd << "'" << endl;
+		return 1;
+	}
+	string name = item, src;
+	if (kind == 's') {
+		src.swap (item);
+		name = "<stdin>";
+	} else if (!read_file (name, src)) {
+		cerr << "cannot open '" << name << "'" << endl;
+		return 1;
+	}
 	try {
-		bool interactive = false;
+		env.exec (src, name);
+	} catch (Error& e) {
+		cerr << RED << format_error (e) << RESET << endl;
+		return 1;
+	} catch (std::exception& e) {
+		cerr << RED << "error: " << e.what () << RESET << endl;
+		return 1;
+	}
+	return 0;
+}
+
+static int g_child_pipe[2] = {-1, -1};
+static void on_child (int) {
+	int saved = errno;
+	char c = 0;
+	if (::write (g_child_pipe[1], &c, 1) < 0) {}
+	errno = saved;
+}
+
+// forks one job per connection; the server keeps the connection and sends
+// the job's exit status back when it is reaped
+static void serve (Environment& env, const string& path) {
+	sockaddr_un addr = socket_address (path);
+	int probe = connect_to (path);
+	if (probe >= 0) {
+		::close (probe);
+		throw runtime_error ("'" + path + "' is already being served");
+	}
+	unlink (path.c_str ());
+
+	int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind (fd, (sockaddr*) &addr, sizeof (addr)) < 0 || listen (fd, 64) < 0)
+		throw runtime_error ("cannot listen on '" + path + "': " + strerror (errno));
+	if (pipe (g_child_pipe) < 0) throw runtime_error ("cannot create pipe");
+	fcntl (g_child_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl (g_child_pipe[1], F_SETFL, O_NONBLOCK);
+
+	struct sigaction sa {};
+	sa.sa_handler = on_stop;
+	sigaction (SIGINT, &sa, nullptr);
+	sigaction (SIGTERM, &sa, nullptr);
+	sa.sa_handler = on_child;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction (SIGCHLD, &sa, nullptr);
+	signal (SIGPIPE, SIG_IGN);
+
+	cout << "serving on " << path << endl;
+	std::map<pid_t, int> jobs;   // pid -> client connection
+	while (!g_stop) {
+		pollfd p[2] = {{fd, POLLIN, 0}, {g_child_pipe[0], POLLIN, 0}};
+		if (poll (p, 2, -1) < 0) continue;
+		if (p[1].revents) {
+			char drain[64];
+			while (::read (g_child_pipe[0], drain, sizeof (drain)) > 0) {}
+			int ws = 0;
+			pid_t pid;
+			while ((pid = waitpid (-1, &ws, WNOHANG)) > 0) {
+				auto it = jobs.find (pid);
+				if (it == jobs.end ()) continue;
+				int32_t status = WIFEXITED (ws) ? WEXITSTATUS (ws) : 128 + WTERMSIG (ws);
+				write_all (it->second, &status, sizeof (status));
+				::close (it->second);
+				jobs.erase (it);
+			}
+		}
+		if (!(p[0].revents & POLLIN)) continue;
+		int conn = accept (fd, nullptr, nullptr);
+		if (conn < 0) continue;
+		pid_t pid = fork ();
+		if (pid == 0) {
+			for (int s : {SIGINT, SIGTERM, SIGCHLD, SIGPIPE}) signal (s, SIG_DFL);
+			::close (fd);
+			::close (g_child_pipe[0]);
+			::close (g_child_pipe[1]);
+			for (auto& j : jobs) ::close (j.second);
+			rng ().reseed (Rng::entropy ());   // not the server's stream
+			int status = handle (env, conn);
+			cout.flush ();
+			cerr.flush ();
+			fflush (nullptr);
+			_exit (status);   // no static destructors: they belong to the server
+		}
+		if (pid > 0) jobs[pid] = conn;
+		else ::close (conn);
+	}
+	for (auto& j : jobs) ::close (j.second);
+	::close (fd);
+	unlink (path.c_str ());
+}
+
+// libraries kept resident in the server (skipped by the jobs' load() calls)
+static void preload (Environment& env, const vector<string>& libs) {
+	namespace fs = std::filesystem;
+	for (auto& lib : libs) {
+		string path = fs::absolute (lib).lexically_normal ().string (), src;
+		if (!read_file (path, src)) {
+			const char* home = getenv ("HOME");
+			path = home ? (fs::path (home) / ".musil" / lib).lexically_normal ().string () : "";
+			if (path.empty () || !read_file (path, src))
+				throw runtime_error ("cannot open '" + lib + "'");
+		}
+		env.preload (src, path);
+	}
+}
+
+int main (int argc, char* argv[]) {
+	try {
+		bool interactive = false, optimize = true;
+		size_t mem_limit = 0;
+		string serve_path, client_path;
 		int opt = 0;
-		while ((opt = getopt(argc, argv, "i")) != -1) {
+		static struct option long_opts[] = {
+			{"mem-limit", required_argument, nullptr, 'm'},
+			{"no-opt", no_argument, nullptr, 'O'},
+			{"serve", required_argument, nullptr, 'S'},
+			{"client", required_argument, nullptr, 'C'},
+			{nullptr, 0, nullptr, 0}
+		};
+		while ((opt = getopt_long(argc, argv, "i", long_opts, nullptr)) != -1) {
 		    switch (opt) {
 		    case 'i': interactive = true; break;
+		    case 'm': mem_limit = parse_size (optarg); break;
+		    case 'O': optimize = false; break;
+		    case 'S': serve_path = optarg; break;
+		    case 'C': client_path = optarg; break;
 		    default:
 		        std::stringstream msg;
-		        msg << "usage is " << argv[0] << " [-i] [file...]";
+		        msg << "usage is " << argv[0] << " [-i] [--mem-limit SIZE] [--no-opt] [file...]" << endl
+		        	<< "         " << argv[0] << " --serve SOCK [--mem-limit SIZE] [--no-opt] [library...]" << endl
+		        	<< "         " << argv[0] << " --client SOCK [file...]";
 		        throw runtime_error (msg.str ());
 		    }
 		}
-		if (argc - optind == 0) {
+		vector<string> files (argv + optind, argv + argc);
+		if (!client_path.empty ()) return run_client (client_path, files);
+
+		Environment interpreter;
+
+		add_scientific(interpreter);
+		add_system(interpreter);
+		add_signals(interpreter);
+		add_plotting(interpreter);
+		add_rtsound(interpreter);
+		if (mem_limit) interpreter.set_mem_limit (mem_limit);
+		interpreter.optimize = optimize;
+
+		if (!serve_path.empty ()) {
+			if (files.empty ()) files = {"stdlib.mu", "scientific.mu", "signals.mu"};
+			preload (interpreter, files);
+			serve (interpreter, serve_path);
+		} else if (files.empty ()) {
 			cout << BOLDBLUE << "[musil, version "
 				<< VERSION <<"]" << RESET << endl << endl;
 
@@ -42,14 +356,13 @@ int main (int argc, char* argv[]) {
 
 			repl(interpreter);
 		} else {
-			for (int i = optind; i < argc; ++i) {
-                std::ifstream f(argv[i]);
-                if (!f) {
-                    std::cerr << "cannot open '" << argv[i] << "'\n";
-                    return 1;
-                }
-                std::string src(std::istreambuf_iterator<char>(f), {});
-                interpreter.exec(src, argv[i]);
+			for (auto& file : files) {
+				std::string src;
+				if (!read_file (file, src)) {
+					std::cerr << "cannot open '" << file << "'\n";
+					return 1;
+				}
+				interpreter.exec(src, file);
 			}
 			if (interactive) repl(interpreter);
 		}
@@ -62,7 +375,7 @@ int main (int argc, char* argv[]) {
 	} catch (...) {
 		cerr << RED << "fatal unknown error" << RESET << endl;
 	}
-	
+
 	return 0;
 }
 // eof
@@ -226,7 +226,10 @@ struct CoutRedirect {
     }
 };
 
-// Called periodically from the interpreter on the worker thread.
+// Called from the interpreter on the worker thread whenever its yield
+// budget runs out, or right away after musil_env.request_yield(); also on
+// pool threads running the script's pmap chunks, spawned tasks and
+// generators, which have no redirect of their own.
 // - flushes redirected stdout to the GUI console
 // - aborts evaluation quickly when Stop was requested
 static void musil_ide_yield() {
@@ -615,19 +618,21 @@ static Fl_Font musil_bold_font(Fl_Font f) {
 static const char* musil_builtin_keywords[] = {
     // Language keywords
     "var", "proc", "if", "else", "while", "for", "in",
-    "return", "break", "and", "or", "not", "print",
+    "return", "break", "yield", "and", "or", "not", "print",
     // Builtins
-    "abs", "asc", "append", "apply",
-    "arr", "ceil", "char", "clock", "concat", "copy",
-    "cos", "eval", "exec", "exit", "exp",
-    "filter", "find", "floor",
+    "abs", "append", "apply", "argsort", "asc",
+    "arr", "await", "await_all", "ceil", "char", "clock", "concat", "copy",
+    "cos", "del", "eval", "exec", "exit", "exp",
+    "filter", "find", "floor", "gc", "get", "has",
     "input", "join", "keys", "len",
     "linspace", "load", "log", "log2", "lower",
-    "map", "num", "ones", "pop", "pow",
-    "push", "rand", "range", "read",
-    "reduce", "remove", "shuffle", "sin", "slice",
-    "split", "sqrt", "str", "sub", "sum",
-    "tan", "to_arr", "to_vec", "type", "upper",
+    "map", "memstats", "next", "num", "ones", "pad", "pmap", "pop", "pow",
+    "push", "rand", "randn", "range", "read",
+    "reduce", "remove", "replace",
+    "sb_add", "sb_new", "sb_str", "seed", "set", "shuffle", "sin", "slice",
+    "sort", "sort_by",
+    "spawn", "split", "sqrt", "str", "str_repeat", "sub", "sum",
+    "tan", "to_arr", "to_vec", "type", "upper", "values",
     "vec", "write", "zeros"
 };
 const int N_BUILTIN_KEYWORDS =
@@ -1246,6 +1251,7 @@ void menu_stop_callback(Fl_Widget*, void*) {
         return;
     }
     g_eval_stop_requested = true;
+    musil_env.request_yield();
     console_append("\n[Stop requested — takes effect between statements]\n");
 }
 
@@ -1507,6 +1513,7 @@ void menu_quit_callback(Fl_Widget*, void*) {
 
     if (g_eval_running) {
         g_eval_stop_requested = true;
+        musil_env.request_yield();
         console_append("[Waiting for evaluation to stop...]\n");
         int wait = 0;
         while (g_eval_running && wait < 50) {
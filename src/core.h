@@ -11,6 +11,7 @@
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <functional>
 #include <memory>
@@ -21,6 +22,19 @@
 #include <cstdlib>
 #include <stdexcept>
 #include <filesystem>
+#include <atomic>
+#include <thread>
+#include <pthread.h>
+#include <cstdint>
+#include <new>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <chrono>
+#include <random>
+#include <cstring>
 
 #define BOLDBLUE    "\033[1m\033[34m"
 #define RED     	"\033[31m"
@@ -32,17 +46,600 @@ struct Error {
     std::string msg;
     std::vector<std::string> trace;   // proc call stack at point of error
 };
+
+// ── Memory accounting ────────────────────────────────────────────────────────
+// NumVal buffers, array and map storage (with the containers themselves)
+// and string builders are charged to the slot of the Environment that is
+// executing on the current thread when they are built; slot 0 collects
+// everything else. Each buffer remembers its slot, so it is credited
+// correctly when freed from any thread. Plain strings are checked against
+// the limit where concatenation builds them but not charged; nothing else
+// (the interpreter's own tokens and scopes, an embedding application) goes
+// through the accounting.
+static constexpr unsigned MEM_SLOTS = 64;
+struct MemSlot {
+    std::atomic<int64_t> live{0};
+    std::atomic<int64_t> peak{0};
+    std::atomic<int64_t> limit{0};        // bytes, 0 = unlimited
+    std::atomic<bool>    in_use{false};
+    std::atomic<bool>    tripped{false};  // limit hit; disarmed until reset
+};
+inline MemSlot               g_mem_slots[MEM_SLOTS];
+inline thread_local unsigned t_mem_slot = 0;
+// Per-thread byte delta not yet published to the current slot; it is
+// flushed once it exceeds MEM_FLUSH_BYTES either way (and when the slot
+// changes), so the hot path touches no shared cache line.
+static constexpr int64_t     MEM_FLUSH_BYTES = 64 * 1024;
+inline thread_local int64_t  t_mem_pending = 0;
+
+inline void mem_peak(MemSlot& s, int64_t live) {
+    int64_t peak = s.peak.load(std::memory_order_relaxed);
+    while (live > peak && !s.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+inline void mem_flush() {
+    MemSlot& s = g_mem_slots[t_mem_slot];
+    int64_t live = s.live.fetch_add(t_mem_pending, std::memory_order_relaxed) + t_mem_pending;
+    t_mem_pending = 0;
+    mem_peak(s, live);
+}
+
+struct MemoryLimitError : std::bad_alloc {
+    std::size_t requested = 0;
+    const char* what() const noexcept override {
+        return "memory limit exceeded";
+    }
+};
+
+inline unsigned mem_acquire_slot() {
+    for (unsigned i = 1; i < MEM_SLOTS; i++) {
+        bool expected = false;
+        if (g_mem_slots[i].in_use.compare_exchange_strong(expected, true)) {
+            g_mem_slots[i].live.store(0);
+            g_mem_slots[i].peak.store(0);
+            g_mem_slots[i].limit.store(0);
+            g_mem_slots[i].tripped.store(false);
+            return i;
+        }
+    }
+    return 0;   // out of slots: share the unattributed one, never limited
+}
+inline void mem_release_slot(unsigned i) {
+    if (i) g_mem_slots[i].in_use.store(false);
+}
+
+// Charges allocations on this thread to a slot for the scope's lifetime.
+struct MemScope {
+    unsigned prev;
+    explicit MemScope(unsigned slot) : prev(t_mem_slot) {
+        mem_flush();
+        t_mem_slot = slot;
+    }
+    ~MemScope() {
+        mem_flush();
+        t_mem_slot = prev;
+    }
+};
+
+// Going over a limit throws only while the thread is armed. The
+// interpreter arms each statement, where the error becomes an ordinary
+// Error; anything else (embedders, noexcept paths) is accounted but never
+// sees the throw.
+inline thread_local bool t_mem_armed = false;
+struct MemArm {
+    bool prev;
+    explicit MemArm(bool on) : prev(t_mem_armed) {
+        t_mem_armed = on;
+    }
+    ~MemArm() {
+        t_mem_armed = prev;
+    }
+};
+
+// Throws if n more bytes would take the slot over its limit; called
+// before the allocation, so an oversized request never touches memory.
+inline std::size_t mem_check(unsigned slot, std::size_t n) {
+    MemSlot& s = g_mem_slots[slot];
+    int64_t lim = s.limit.load(std::memory_order_relaxed);
+    if (lim > 0 && t_mem_armed && n &&
+            s.live.load(std::memory_order_relaxed) + (slot == t_mem_slot ? t_mem_pending : 0) + (int64_t)n > lim &&
+            std::uncaught_exceptions() == 0 && !s.tripped.exchange(true)) {
+        MemoryLimitError e;
+        e.requested = n;
+        throw e;
+    }
+    return n;
+}
+inline void mem_add(unsigned slot, int64_t n) noexcept {
+    if (slot == t_mem_slot) {
+        t_mem_pending += n;
+        if (t_mem_pending > MEM_FLUSH_BYTES || t_mem_pending < -MEM_FLUSH_BYTES) mem_flush();
+    } else {
+        MemSlot& s = g_mem_slots[slot];
+        mem_peak(s, s.live.fetch_add(n, std::memory_order_relaxed) + n);
+    }
+}
+
+// Bytes of one buffer charged to a slot, credited back on release.
+struct MemCharge {
+    std::size_t bytes = 0;
+    unsigned    slot  = 0;
+    MemCharge() = default;
+    explicit MemCharge(std::size_t n) {
+        charge(n);
+    }
+    MemCharge(const MemCharge&) = delete;
+    MemCharge& operator=(const MemCharge&) = delete;
+    ~MemCharge() {
+        release();
+    }
+    void charge(std::size_t n) {
+        if (!n) return;
+        slot = t_mem_slot;
+        mem_check(slot, n);
+        mem_add(slot, (int64_t)n);
+        bytes = n;
+    }
+    void release() noexcept {
+        if (bytes) mem_add(slot, -(int64_t)bytes);
+        bytes = 0;
+    }
+    void swap(MemCharge& o) noexcept {
+        std::swap(bytes, o.bytes);
+        std::swap(slot, o.slot);
+    }
+};
+
+// Charges the container it is a member of for its own footprint (the
+// object and the shared_ptr control block next to it); a copy is a new
+// object and is charged again.
+struct MemSelf {
+    MemCharge c;
+    explicit MemSelf(std::size_t n) : c(n + 2 * sizeof(long)) {}
+    MemSelf(const MemSelf& o) : c(o.c.bytes) {}
+    MemSelf& operator=(const MemSelf&) {
+        return *this;
+    }
+};
+
+// Allocator of the array storage: charges the slot that was current when
+// the container was built, which a copy does not inherit.
+template <typename T>
+struct MemAlloc {
+    using value_type                             = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap            = std::true_type;
+    using is_always_equal                        = std::false_type;
+    unsigned slot;
+    MemAlloc() noexcept : slot(t_mem_slot) {}
+    template <typename U> MemAlloc(const MemAlloc<U>& o) noexcept : slot(o.slot) {}
+    MemAlloc select_on_container_copy_construction() const {
+        return MemAlloc();
+    }
+    T* allocate(std::size_t n) {
+        mem_check(slot, n * sizeof(T));
+        T* p = std::allocator<T>().allocate(n);
+        mem_add(slot, (int64_t)(n * sizeof(T)));
+        return p;
+    }
+    void deallocate(T* p, std::size_t n) noexcept {
+        std::allocator<T>().deallocate(p, n);
+        mem_add(slot, -(int64_t)(n * sizeof(T)));
+    }
+    template <typename U> bool operator==(const MemAlloc<U>& o) const noexcept {
+        return slot == o.slot;
+    }
+    template <typename U> bool operator!=(const MemAlloc<U>& o) const noexcept {
+        return slot != o.slot;
+    }
+};
+template <typename T> using MemVector = std::vector<T, MemAlloc<T>>;
+
 struct Env;
 struct Proc;
-using NumVal   = std::valarray<double>;
+// A std::valarray<double> whose buffer is charged to a memory slot: the
+// constructors that take a size check the limit before allocating, and
+// every change of size through NumVal moves the charge along. Scalars are
+// left out, so arithmetic on them never touches the accounting; a
+// container still charges the slot each one takes up.
+struct NumVal : std::valarray<double> {
+    using Base = std::valarray<double>;
+    using Base::Base;
+    NumVal() noexcept : mem_() {}
+    explicit NumVal(std::size_t n) : Base(checked(n)), mem_(bytes()) {}
+    NumVal(const double& x, std::size_t n) : Base(x, checked(n)), mem_(bytes()) {}
+    NumVal(const double* p, std::size_t n) : Base(p, checked(n)), mem_(bytes()) {}
+    NumVal(const NumVal& o) : Base(o), mem_(bytes()) {}
+    NumVal(NumVal&& o) noexcept : Base(std::move(o)), mem_() {
+        mem_.swap(o.mem_);
+    }
+    NumVal(const Base& o) : Base(o), mem_(bytes()) {}
+    NumVal(Base&& o) : Base(std::move(o)), mem_(bytes()) {}
+
+    NumVal& operator=(const NumVal& o) {
+        Base::operator=(o);
+        recharge();
+        return *this;
+    }
+    NumVal& operator=(NumVal&& o) noexcept {
+        Base::operator=(std::move(o));
+        mem_.release();
+        mem_.swap(o.mem_);
+        return *this;
+    }
+    template <typename X> NumVal& operator=(X&& x) {
+        Base::operator=(std::forward<X>(x));
+        recharge();
+        return *this;
+    }
+    void resize(std::size_t n, double x = 0) {
+        Base::resize(checked(n), x);
+        recharge();
+    }
+    void swap(NumVal& o) noexcept {
+        Base::swap(o);
+        mem_.swap(o.mem_);
+    }
+
+private:
+    static std::size_t checked(std::size_t n) {
+        if (n > 1) mem_check(t_mem_slot, n * sizeof(double));
+        return n;
+    }
+    std::size_t bytes() const {
+        return size() > 1 ? size() * sizeof(double) : 0;
+    }
+    void recharge() {
+        if (mem_.bytes == bytes()) return;
+        mem_.release();
+        mem_.charge(bytes());
+    }
+    MemCharge mem_{bytes()};
+};
 struct Array;
-using EnvPtr   = std::shared_ptr<Env>;
-using ArrayPtr = std::shared_ptr<Array>;
-using ProcVal  = std::shared_ptr<Proc>;
-using Value    = std::variant<NumVal, std::string, ArrayPtr, ProcVal>;
+struct Map;
+struct Native;
+struct Interpreter;
+using EnvPtr    = std::shared_ptr<Env>;
+using ArrayPtr  = std::shared_ptr<Array>;
+using ProcVal   = std::shared_ptr<Proc>;
+using MapPtr    = std::shared_ptr<Map>;
+using NativePtr = std::shared_ptr<Native>;
+using Value     = std::variant<NumVal, std::string, ArrayPtr, ProcVal, MapPtr, NativePtr>;
+// Set on the arrays and maps a running pmap() shares between its chunks;
+// copies of a container start out unshared.
+struct ShareMark {
+    bool on = false;
+    ShareMark() = default;
+    ShareMark(const ShareMark&) {}
+    ShareMark& operator=(const ShareMark&) {
+        return *this;
+    }
+};
+
+// Arrays whose elements are all scalar numbers are packed into one
+// contiguous double buffer (8 bytes per element instead of a boxed Value
+// with its own heap allocation). Storing any other value switches the array
+// to boxed storage for good. get() returns elements by value in either
+// representation; at() and boxed() give references and require/force the
+// boxed form.
 struct Array {
-    std::vector<Value> elems;
+    Array() = default;
+    explicit Array(std::vector<Value> v) : packed_(false) {
+        try_pack(v);
+    }
+    explicit Array(const std::vector<double>& v) : nums_(v.begin(), v.end()) {}
+
+    ShareMark shared;
+    MemSelf   footprint{sizeof(Array)};
+
+    std::size_t size() const {
+        return packed_ ? nums_.size() : vals_.size();
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+    bool packed() const {
+        return packed_;
+    }
+    const MemVector<double>& nums() const {
+        return nums_;
+    }
+    Value get(std::size_t i) const {
+        if (packed_) return NumVal{nums_[i]};
+        return vals_[i];
+    }
+    const Value& at(std::size_t i) const {
+        if (packed_) throw std::logic_error("Array::at on packed array");
+        return vals_[i];
+    }
+    MemVector<Value>& boxed() {
+        box();
+        return vals_;
+    }
+    std::vector<Value> values() const {
+        if (!packed_) return {vals_.begin(), vals_.end()};
+        std::vector<Value> r;
+        r.reserve(nums_.size());
+        for (double x : nums_) r.push_back(NumVal{x});
+        return r;
+    }
+    template <typename F> void each(F f) const {
+        if (packed_) {
+            for (double x : nums_) f(Value{NumVal{x}});
+        } else {
+            for (const Value& v : vals_) f(v);
+        }
+    }
+
+    void set(std::size_t i, Value v) {
+        if (packed_) {
+            if (const double* x = scalar_of(v)) {
+                nums_[i] = *x;
+                return;
+            }
+            box();
+        }
+        vals_[i] = std::move(v);
+    }
+    void push(Value v) {
+        if (packed_) {
+            if (const double* x = scalar_of(v)) {
+                nums_.push_back(*x);
+                return;
+            }
+            box();
+        }
+        vals_.push_back(std::move(v));
+    }
+    void push_num(double x) {
+        if (packed_) nums_.push_back(x);
+        else vals_.push_back(NumVal{x});
+    }
+    void insert(std::size_t i, Value v) {
+        if (packed_) {
+            if (const double* x = scalar_of(v)) {
+                nums_.insert(nums_.begin() + i, *x);
+                return;
+            }
+            box();
+        }
+        vals_.insert(vals_.begin() + i, std::move(v));
+    }
+    void erase(std::size_t i) {
+        if (packed_) nums_.erase(nums_.begin() + i);
+        else vals_.erase(vals_.begin() + i);
+    }
+    void pop_back() {
+        if (packed_) nums_.pop_back();
+        else vals_.pop_back();
+    }
+    void reserve(std::size_t n) {
+        if (packed_) nums_.reserve(n);
+        else vals_.reserve(n);
+    }
+    void resize(std::size_t n, const Value& fill) {
+        if (packed_) {
+            if (const double* x = scalar_of(fill)) {
+                nums_.resize(n, *x);
+                return;
+            }
+            box();
+        }
+        vals_.resize(n, fill);
+    }
+    void append(const Array& o, std::size_t lo, std::size_t hi) {
+        if (packed_ && o.packed_) {
+            nums_.insert(nums_.end(), o.nums_.begin() + lo, o.nums_.begin() + hi);
+            return;
+        }
+        box();
+        vals_.reserve(vals_.size() + (hi - lo));
+        for (std::size_t i = lo; i < hi; i++) vals_.push_back(o.get(i));
+    }
+    void append(const Array& o) {
+        append(o, 0, o.size());
+    }
+    void swap_elems(std::size_t i, std::size_t j) {
+        if (packed_) std::swap(nums_[i], nums_[j]);
+        else std::swap(vals_[i], vals_[j]);
+    }
+    void box() {
+        if (!packed_) return;
+        vals_.reserve(nums_.size());
+        for (double x : nums_) vals_.push_back(NumVal{x});
+        MemVector<double>().swap(nums_);
+        packed_ = false;
+    }
+
+private:
+    static const double* scalar_of(const Value& v) {
+        auto* nv = std::get_if<NumVal>(&v);
+        return nv && nv->size() == 1 ? &(*nv)[0] : nullptr;
+    }
+    void try_pack(std::vector<Value>& v) {
+        for (const Value& x : v)
+            if (!scalar_of(x)) {
+                vals_.assign(std::make_move_iterator(v.begin()), std::make_move_iterator(v.end()));
+                return;
+            }
+        nums_.reserve(v.size());
+        for (const Value& x : v) nums_.push_back(*scalar_of(x));
+        packed_ = true;
+    }
+
+    MemVector<double> nums_;
+    MemVector<Value>  vals_;
+    bool                packed_ = true;
+};
+
+// Opaque handle for values implemented in C++ (string builders, ...).
+// Scripts see them through type() and the builtins that accept them;
+// they compare by identity and are always true.
+struct Native {
+    virtual ~Native() = default;
+    virtual const char* type_name() const = 0;
+};
+template <typename T> T* native_cast(const Value& v) {
+    auto* p = std::get_if<NativePtr>(&v);
+    return p ? dynamic_cast<T*>(p->get()) : nullptr;
+}
+
+// Growable text buffer: sb_add appends in amortised O(1).
+struct StringBuilder : Native {
+    std::string buf;
+    MemCharge   mem;   // capacity of buf, moved along by sb_add
+    const char* type_name() const override {
+        return "stringbuilder";
+    }
+};
+
+// Result slot of spawn(): filled once by the task, read by await().
+struct Future : Native {
+    std::atomic<bool>       done{false};
+    std::mutex              m;
+    std::condition_variable cv;
+    Value                   result;
+    std::unique_ptr<Error>  error;
+    const char* type_name() const override {
+        return "future";
+    }
+    void finish(Value v, std::unique_ptr<Error> e) {
+        std::lock_guard<std::mutex> lk(m);
+        result = std::move(v);
+        error = std::move(e);
+        done = true;
+        cv.notify_all();
+    }
+};
+
+// Lazy sequence consumed by for-in and next(). Native generators (file
+// readers, framewise analysis) implement pull(); a proc whose body
+// contains `yield` returns a ProcGenerator when called.
+struct Generator : Native {
+    const char* type_name() const override {
+        return "generator";
+    }
+    // Stores the next item in `out`; false once the sequence is exhausted.
+    virtual bool pull(Value& out, Interpreter& I) = 0;
+};
+
+// A proc body suspended at each `yield`. It runs on the puller's thread,
+// in an interpreter of its own that outlives the pull: `yield` records
+// the token after it and unwinds, and each if/while/for around it saves
+// its loop state on the way out (Frame). The next pull re-enters those
+// statements from the outermost in, and the body carries on after the
+// yield. A suspended body holds no thread or stack, so any number of
+// generators can be live at once; dropping one just drops its scopes.
+// Pulls from different threads take turns; a body that pulls itself is
+// an error.
+struct ProcGenerator : Generator {
+    // An if/while/for statement the pending yield is inside of.
+    struct Frame {
+        size_t             start = 0;   // its first token
+        size_t             mark  = 0;   // while: the condition; for: the body
+        size_t             next  = 0;   // for: index of the next item
+        Value              seq;         // for: what is iterated
+        std::vector<Value> keys;        // for over a map: its keys at the start
+        std::string        var;         // for: the loop variable
+    };
+    std::vector<Frame> frames;          // innermost first
+    size_t             resume_pos = 0;  // token after the pending yield
+    bool               started = false, suspended = false, resuming = false, finished = false;
+    Value              item;
+    // Runs the body from the start, or from where it suspended, until it
+    // yields or ends.
+    std::function<void()> body;
+    std::mutex                   m;
+    std::atomic<std::thread::id> owner{};
+
+    bool pull(Value& out, Interpreter& I) override;
+    // Drops the body's scopes once it can run no further.
+    void finish() {
+        finished = true;
+        frames.clear();
+        body = nullptr;
+    }
+};
+
+// Map keys are strings or scalar numbers, hashed natively.
+struct MapKey {
+    bool        is_num = false;
+    double      num    = 0.0;
+    std::string str;
+    bool operator==(const MapKey& o) const {
+        return is_num == o.is_num && (is_num ? num == o.num : str == o.str);
+    }
 };
+struct MapKeyHash {
+    std::size_t operator()(const MapKey& k) const {
+        return k.is_num ? std::hash<double>{}(k.num) : std::hash<std::string>{}(k.str);
+    }
+};
+// Hash map with insertion-order iteration. Erased slots become tombstones
+// and are compacted once they outnumber the live entries.
+struct Map {
+    MemVector<MapKey> keys;
+    MemVector<Value>  vals;
+    MemVector<char>   dead;
+    std::unordered_map<MapKey, std::size_t, MapKeyHash, std::equal_to<MapKey>,
+                       MemAlloc<std::pair<const MapKey, std::size_t>>> index;
+    ShareMark         shared;
+    MemSelf           footprint{sizeof(Map)};
+
+    std::size_t size() const {
+        return index.size();
+    }
+    Value* find(const MapKey& k) {
+        auto it = index.find(k);
+        return it == index.end() ? nullptr : &vals[it->second];
+    }
+    Value& slot(const MapKey& k) {
+        auto it = index.find(k);
+        if (it != index.end()) return vals[it->second];
+        index.emplace(k, keys.size());
+        keys.push_back(k);
+        vals.push_back(NumVal{0.0});
+        dead.push_back(0);
+        return vals.back();
+    }
+    void set(const MapKey& k, Value v) {
+        slot(k) = std::move(v);
+    }
+    bool erase(const MapKey& k) {
+        auto it = index.find(k);
+        if (it == index.end()) return false;
+        std::size_t i = it->second;
+        index.erase(it);
+        dead[i] = 1;
+        vals[i] = NumVal{};
+        if (keys.size() > 16 && index.size() < keys.size() / 2) compact();
+        return true;
+    }
+    void compact() {
+        std::size_t j = 0;
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            if (dead[i]) continue;
+            if (i != j) {
+                keys[j] = std::move(keys[i]);
+                vals[j] = std::move(vals[i]);
+            }
+            index[keys[j]] = j;
+            j++;
+        }
+        keys.resize(j);
+        vals.resize(j);
+        dead.assign(j, 0);
+    }
+    template <typename F> void each(F f) const {
+        for (std::size_t i = 0; i < keys.size(); i++)
+            if (!dead[i]) f(keys[i], vals[i]);
+    }
+};
+inline Value map_key_value(const MapKey& k) {
+    if (k.is_num) return NumVal{k.num};
+    return k.str;
+}
 
 inline double nv_scalar(const NumVal& v) {
     return v[0];
@@ -56,11 +653,12 @@ bool values_equal(const Value& a, const Value& b);  // forward declaration
 
 enum TK {
     NUM, STR, IDENT,
-    VAR, PROC, WHILE, FOR, IN, IF, ELSE, RETURN, PRINT, BREAK, CONTINUE,
+    VAR, PROC, WHILE, FOR, IN, IF, ELSE, RETURN, PRINT, BREAK, CONTINUE, YIELD,
     AND, OR, NOT,
     ASSIGN, PLUS, MINUS, STAR, SLASH,
     LT, GT, LE, GE, EQ, NEQ,
-    LPAREN, RPAREN, LBRACE, RBRACE, LBRACKET, RBRACKET, COMMA, END
+    LPAREN, RPAREN, LBRACE, RBRACE, LBRACKET, RBRACKET, COMMA, END,
+    UNVAR   // never lexed: TokenOptimizer's removal of a hoisted variable
 };
 struct Token {
     TK type;
@@ -154,6 +752,7 @@ std::vector<Token> lex(const std::string& src, const std::string& filename = "<s
             else if (s=="print")  t=PRINT;
             else if (s=="break")  t=BREAK;
             else if (s=="continue") t=CONTINUE;
+            else if (s=="yield")  t=YIELD;
             else if (s=="and")    t=AND;
             else if (s=="or")     t=OR;
             else if (s=="not")    t=NOT;
@@ -199,6 +798,499 @@ std::vector<Token> lex(const std::string& src, const std::string& filename = "<s
     return toks;
 }
 
+// Token-stream optimizer, run on every lexed source unless disabled
+// (Environment::optimize, musil --no-opt). The interpreter walks tokens
+// directly, so each pass rewrites the stream and leaves parsing to the
+// interpreter:
+//
+//  - literal arithmetic is folded where the parser would group the
+//    literals anyway: `2 * 3.14159 * f` becomes `6.2831800000000003 * f`,
+//    `x / 2 * 3` is left alone;
+//  - if/else branches with a constant condition and `while (0)` loops are
+//    removed;
+//  - calls to pure builtins whose arguments a loop never modifies are
+//    evaluated once before the loop, identical calls sharing one variable.
+//    Loops calling procs, or builtins that may run script code, are left
+//    alone. Calls moved out of the body only run when the body would: a
+//    while loop is guarded by its condition, evaluated once more, so only
+//    if that calls nothing but pure builtins. len()/sum()/str() are only
+//    moved when the loop changes no container, since arrays and maps may
+//    be aliased. The variables are removed once the loop is done.
+//
+// Anything the optimizer cannot parse is passed through unchanged for the
+// interpreter to report.
+inline std::atomic<unsigned> g_opt_serial{0};
+struct TokenOptimizer {
+    using Toks = std::vector<Token>;
+    struct Bail {};
+    struct LoopInfo {
+        bool ok = true;            // only calls the optimizer knows
+        bool mutates = false;      // changes an array or map
+        bool cond_pure = true;     // condition calls only pure builtins
+        std::unordered_set<std::string> modified;
+    };
+    enum Kind { UNKNOWN, PURE, PURE_ANY, READONLY, MUTATOR };
+
+    std::function<bool(const std::string&)> shadowed;   // procs defined before this source
+    std::unordered_set<std::string> bound;              // names (re)bound in this source
+    mutable std::unordered_set<std::string> assumed;    // builtins the result relies on
+
+    Toks run(Toks t) {
+        try {
+            for (size_t i = 0; i + 1 < t.size(); i++) {
+                if (t[i].type == PROC || t[i].type == VAR) {
+                    if (t[i+1].type == IDENT) bound.insert(t[i+1].val);
+                    if (t[i].type == PROC) {   // parameters may hold procs too
+                        size_t p = t[i+1].type == IDENT ? i + 2 : i + 1;
+                        if (t[p].type == LPAREN)
+                            for (size_t k = p + 1; k < match(t, p); k++)
+                                if (t[k].type == IDENT) bound.insert(t[k].val);
+                    }
+                } else if (t[i].type == IDENT && t[i+1].type == ASSIGN) {
+                    bound.insert(t[i].val);
+                }
+            }
+            fold(t);
+            Toks d, h;
+            dead(t, 0, t.size(), d);
+            hoist(d, 0, d.size(), h);
+            return h;
+        } catch (Bail&) {
+            return t;
+        }
+    }
+
+    static size_t match(const Toks& t, size_t i) {
+        TK open = t[i].type, close = open == LPAREN ? RPAREN : open == LBRACE ? RBRACE : RBRACKET;
+        int depth = 0;
+        for (size_t j = i; j < t.size() && t[j].type != END; j++) {
+            if (t[j].type == open) depth++;
+            else if (t[j].type == close && --depth == 0) return j;
+        }
+        throw Bail{};
+    }
+    static size_t expect_at(const Toks& t, size_t i, TK type) {
+        if (i >= t.size() || t[i].type != type) throw Bail{};
+        return i;
+    }
+    // tokens after which '-' is unary and '(' only groups
+    static bool opens_operand(TK t) {
+        switch (t) {
+        case LPAREN: case LBRACKET: case COMMA: case ASSIGN:
+        case PLUS: case MINUS: case STAR: case SLASH:
+        case LT: case GT: case LE: case GE: case EQ: case NEQ:
+        case AND: case OR: case NOT: case RETURN: case YIELD: case PRINT: case IN:
+            return true;
+        default:
+            return false;
+        }
+    }
+    static Token num_token(double x, int line) {
+        char buf[32];
+        std::snprintf(buf, sizeof buf, "%.17g", x);
+        return {NUM, buf, line};
+    }
+
+    // ── constant folding ───────────────────────────────────────────────────
+    static void fold(Toks& t) {
+        auto type = [&](size_t i) {
+            return i < t.size() ? t[i].type : END;
+        };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = 1; i + 1 < t.size(); i++) {
+                TK prev = t[i-1].type;
+                if (t[i].type == MINUS && t[i+1].type == NUM && opens_operand(prev) && type(i+2) != LBRACKET) {
+                    t[i] = num_token(-std::stod(t[i+1].val), t[i].line);
+                    t.erase(t.begin() + i + 1);
+                    changed = true;
+                } else if (t[i].type == LPAREN && t[i+1].type == NUM && type(i+2) == RPAREN && opens_operand(prev)) {
+                    t.erase(t.begin() + i + 2);
+                    t.erase(t.begin() + i);
+                    changed = true;
+                } else if (t[i].type == NUM && type(i+2) == NUM) {
+                    TK op = t[i+1].type, next = type(i+3);
+                    bool mul = op == STAR || op == SLASH, add = op == PLUS || op == MINUS;
+                    if (!(mul && prev != STAR && prev != SLASH && next != LBRACKET) &&
+                            !(add && prev != PLUS && prev != MINUS && prev != STAR && prev != SLASH &&
+                              next != STAR && next != SLASH && next != LBRACKET)) continue;
+                    double a = std::stod(t[i].val), b = std::stod(t[i+2].val);
+                    double r = op == STAR ? a * b : op == SLASH ? a / b : op == PLUS ? a + b : a - b;
+                    if (!std::isfinite(r)) continue;
+                    t[i] = num_token(r, t[i].line);
+                    t.erase(t.begin() + i + 1, t.begin() + i + 3);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // ── dead branches ──────────────────────────────────────────────────────
+    struct Clause {
+        size_t c0, c1;   // condition tokens, empty for a plain else
+        size_t b0, b1;   // braces of the block
+    };
+    static int constant(const Toks& t, const Clause& c) {   // -1: not constant
+        if (c.c1 - c.c0 != 1 || t[c.c0].type != NUM) return -1;
+        return std::stod(t[c.c0].val) != 0.0;
+    }
+    static void dead(const Toks& t, size_t lo, size_t hi, Toks& out) {
+        for (size_t i = lo; i < hi; i++) {
+            if (t[i].type == WHILE) {
+                size_t p = expect_at(t, i + 1, LPAREN), q = match(t, p);
+                size_t b = expect_at(t, q + 1, LBRACE);
+                if (constant(t, {p + 1, q, b, 0}) == 0) {
+                    i = match(t, b);
+                    continue;
+                }
+            }
+            if (t[i].type != IF) {
+                out.push_back(t[i]);
+                continue;
+            }
+            std::vector<Clause> chain;
+            size_t j = i;
+            while (true) {
+                Clause c{0, 0, 0, 0};
+                if (t[j].type == IF) {
+                    size_t p = expect_at(t, j + 1, LPAREN), q = match(t, p);
+                    c.c0 = p + 1;
+                    c.c1 = q;
+                    j = q + 1;
+                }
+                c.b0 = expect_at(t, j, LBRACE);
+                c.b1 = match(t, c.b0);
+                chain.push_back(c);
+                j = c.b1 + 1;
+                if (c.c1 == 0 || j >= hi || t[j].type != ELSE) break;
+                j++;
+            }
+            std::vector<Clause> kept;
+            for (auto c : chain) {
+                int k = c.c1 ? constant(t, c) : 1;
+                if (k == 0) continue;
+                if (k == 1 && !kept.empty()) c.c0 = c.c1 = 0;   // becomes the final else
+                kept.push_back(c);
+                if (k == 1) break;
+            }
+            int line = t[i].line;
+            for (size_t k = 0; k < kept.size(); k++) {
+                const Clause& c = kept[k];
+                if (k) out.push_back({ELSE, "else", line});
+                if (c.c1 || k == 0) {
+                    out.push_back({IF, "if", line});
+                    out.push_back({LPAREN, "(", line});
+                    if (c.c1) dead(t, c.c0, c.c1, out);
+                    else out.push_back({NUM, "1", line});
+                    out.push_back({RPAREN, ")", line});
+                }
+                out.push_back(t[c.b0]);
+                dead(t, c.b0 + 1, c.b1, out);
+                out.push_back(t[c.b1]);
+            }
+            i = j - 1;
+        }
+    }
+
+    // ── loop-invariant calls ───────────────────────────────────────────────
+    Kind kind(const std::string& n) const {
+        static const std::unordered_map<std::string, Kind> known = {
+            {"floor", PURE}, {"ceil", PURE}, {"abs", PURE}, {"sqrt", PURE}, {"sin", PURE},
+            {"cos", PURE}, {"tan", PURE}, {"exp", PURE}, {"log", PURE}, {"log2", PURE},
+            {"atan2", PURE}, {"pow", PURE}, {"linspace", PURE}, {"zeros", PURE}, {"ones", PURE},
+            {"window", PURE},
+            {"len", PURE_ANY}, {"sum", PURE_ANY}, {"str", PURE_ANY}, {"num", PURE_ANY},
+            {"vec", READONLY}, {"to_vec", READONLY}, {"to_arr", READONLY}, {"all", READONLY},
+            {"any", READONLY}, {"sub", READONLY}, {"find", READONLY}, {"upper", READONLY},
+            {"lower", READONLY}, {"char", READONLY}, {"asc", READONLY}, {"type", READONLY},
+            {"arr", READONLY}, {"slice", READONLY}, {"concat", READONLY}, {"join", READONLY},
+            {"replace", READONLY}, {"str_repeat", READONLY}, {"pad", READONLY}, {"split", READONLY},
+            {"copy", READONLY}, {"range", READONLY}, {"shuffle", READONLY}, {"sort", READONLY},
+            {"argsort", READONLY}, {"keys", READONLY}, {"values", READONLY}, {"get", READONLY},
+            {"has", READONLY}, {"rand", READONLY}, {"randn", READONLY}, {"clock", READONLY}, {"fft", READONLY},
+            {"ifft", READONLY}, {"car2pol", READONLY}, {"pol2car", READONLY}, {"vslice", READONLY},
+            {"vaddat", READONLY}, {"mix", READONLY}, {"energy", READONLY}, {"rfft", READONLY},
+            {"irfft", READONLY}, {"stft", READONLY}, {"istft", READONLY},
+            {"push", MUTATOR}, {"pop", MUTATOR}, {"insert", MUTATOR}, {"remove", MUTATOR},
+            {"set", MUTATOR}, {"del", MUTATOR}, {"sb_add", MUTATOR}
+        };
+        auto it = known.find(n);
+        if (it == known.end() || bound.count(n) || (shadowed && shadowed(n))) return UNKNOWN;
+        assumed.insert(n);
+        return it->second;
+    }
+    // a proc (literal or declaration) starting at i: index of its closing brace
+    static size_t skip_proc(const Toks& t, size_t i) {
+        size_t p = t[i+1].type == IDENT ? i + 2 : i + 1;
+        return match(t, expect_at(t, match(t, expect_at(t, p, LPAREN)) + 1, LBRACE));
+    }
+    void scan(const Toks& t, LoopInfo& info, bool cond) const {
+        for (size_t i = 0; i < t.size() && info.ok; i++) {
+            TK ty = t[i].type;
+            TK next = i + 1 < t.size() ? t[i+1].type : END;
+            if (ty == PROC) {
+                if (next == IDENT) info.modified.insert(t[i+1].val);
+                i = skip_proc(t, i);
+            } else if (ty == YIELD || (ty == LPAREN && i && (t[i-1].type == RPAREN || t[i-1].type == RBRACKET))) {
+                info.ok = false;   // hands control to other code, or calls a proc value
+            } else if (ty == FOR) {
+                // the collection may be a generator running script code
+                size_t e = i + 5;
+                if (e + 1 >= t.size() || t[e].type != IDENT || t[e+1].type != LPAREN ||
+                        kind(t[e].val) == UNKNOWN || match(t, e + 1) + 1 != match(t, i + 1))
+                    info.ok = false;
+            } else if (ty == VAR && next == IDENT) {
+                info.modified.insert(t[i+1].val);
+            } else if (ty == IDENT && next == ASSIGN) {
+                info.modified.insert(t[i].val);
+            } else if (ty == IDENT && next == LBRACKET) {
+                size_t j = i + 1;
+                while (j < t.size() && t[j].type == LBRACKET) j = match(t, j) + 1;
+                if (j < t.size() && t[j].type == ASSIGN) {
+                    info.modified.insert(t[i].val);
+                    info.mutates = true;
+                }
+            } else if (ty == IDENT && next == LPAREN) {
+                Kind k = kind(t[i].val);
+                if (k == UNKNOWN) info.ok = false;
+                if (cond && k != PURE && k != PURE_ANY) info.cond_pure = false;   // rand(), clock()...
+                if (k == MUTATOR) {
+                    info.mutates = true;
+                    if (i + 2 < t.size() && t[i+2].type == IDENT) info.modified.insert(t[i+2].val);
+                }
+            }
+        }
+    }
+    // end of a hoistable call starting at i, or 0
+    size_t invariant_call(const Toks& t, size_t i, const LoopInfo& info) const {
+        Kind k = kind(t[i].val);
+        if (k != PURE && !(k == PURE_ANY && !info.mutates)) return 0;
+        size_t e = match(t, i + 1);
+        for (size_t j = i + 2; j < e; j++) {
+            switch (t[j].type) {
+            case NUM: case STR: case COMMA: case RPAREN:
+            case PLUS: case MINUS: case STAR: case SLASH:
+            case LT: case GT: case LE: case GE: case EQ: case NEQ:
+            case AND: case OR: case NOT:
+                break;
+            case LPAREN:
+                if (t[j-1].type == RPAREN) return 0;
+                break;
+            case IDENT:
+                if (t[j+1].type == LPAREN) {
+                    size_t n = invariant_call(t, j, info);
+                    if (!n) return 0;
+                    j = n;
+                } else if (info.modified.count(t[j].val)) {
+                    return 0;
+                }
+                break;
+            default:
+                return 0;
+            }
+        }
+        return e;
+    }
+    struct Site {
+        size_t lo, hi;
+    };
+    // invariant calls of t; with top_only, those at brace depth 0 that run
+    // before any break, continue or return
+    std::vector<Site> sites(const Toks& t, const LoopInfo& info, bool top_only) const {
+        std::vector<Site> s;
+        int depth = 0;
+        for (size_t i = 0; i < t.size(); i++) {
+            TK ty = t[i].type;
+            if (ty == PROC) i = skip_proc(t, i);
+            else if (ty == LBRACE) depth++;
+            else if (ty == RBRACE) depth--;
+            else if (top_only && (ty == BREAK || ty == CONTINUE || ty == RETURN)) break;
+            else if (ty == IDENT && i + 1 < t.size() && t[i+1].type == LPAREN && (depth == 0 || !top_only)) {
+                if (size_t e = invariant_call(t, i, info)) {
+                    s.push_back({i, e});
+                    i = e;
+                }
+            }
+        }
+        return s;
+    }
+    static std::string text(const Toks& t, Site s) {
+        std::string k;
+        for (size_t i = s.lo; i <= s.hi; i++) k += std::to_string(t[i].type) + t[i].val + ' ';
+        return k;
+    }
+    // replaces each site with a variable, declaring new ones into decls
+    static Toks replace(const Toks& t, const std::vector<Site>& s, std::map<std::string, std::string>& names,
+                        Toks& decls, int line) {
+        Toks r;
+        size_t at = 0;
+        for (auto& site : s) {
+            r.insert(r.end(), t.begin() + at, t.begin() + site.lo);
+            std::string& n = names[text(t, site)];
+            if (n.empty()) {
+                n = "__inv" + std::to_string(g_opt_serial++);
+                decls.push_back({VAR, "var", line});
+                decls.push_back({IDENT, n, line});
+                decls.push_back({ASSIGN, "=", line});
+                decls.insert(decls.end(), t.begin() + site.lo, t.begin() + site.hi + 1);
+            }
+            r.push_back({IDENT, n, t[site.lo].line});
+            at = site.hi + 1;
+        }
+        r.insert(r.end(), t.begin() + at, t.end());
+        return r;
+    }
+    // collections a moved call can be guarded on: len() gives their size
+    static bool sized(const std::string& n) {
+        static const std::unordered_set<std::string> names = {
+            "range", "linspace", "zeros", "ones", "keys", "values", "split", "sort", "argsort"
+        };
+        return names.count(n) > 0;
+    }
+    void hoist(const Toks& t, size_t lo, size_t hi, Toks& out) const {
+        for (size_t i = lo; i < hi; i++) {
+            if (t[i].type != WHILE && t[i].type != FOR) {
+                out.push_back(t[i]);
+                continue;
+            }
+            bool is_for = t[i].type == FOR;
+            int line = t[i].line;
+            size_t p = expect_at(t, i + 1, LPAREN), q = match(t, p);
+            size_t b = expect_at(t, q + 1, LBRACE), e = match(t, b);
+            size_t c0 = p + 1;
+            if (is_for) {
+                expect_at(t, p + 1, VAR);
+                expect_at(t, p + 2, IDENT);
+                c0 = expect_at(t, p + 3, IN) + 1;
+            }
+            Toks cond, body;
+            hoist(t, c0, q, cond);
+            hoist(t, b + 1, e, body);
+
+            LoopInfo info;
+            if (is_for) info.modified.insert(t[p+2].val);
+            scan(cond, info, true);
+            scan(body, info, false);
+            std::vector<Site> cs, bs;
+            if (info.ok) {
+                if (!is_for) cs = sites(cond, info, false);
+                // calls moved out of the body need a guard: the (pure)
+                // condition, or the length of a collection
+                bool guard = is_for
+                             ? cond.size() > 2 && cond[0].type == IDENT && sized(cond[0].val) &&
+                             kind(cond[0].val) != UNKNOWN && kind("len") != UNKNOWN &&
+                             cond[1].type == LPAREN && match(cond, 1) + 1 == cond.size()
+                             : info.cond_pure;
+                if (guard) bs = sites(body, info, true);
+            }
+
+            std::map<std::string, std::string> names;
+            Toks decls, inner;
+            cond = replace(cond, cs, names, decls, line);
+            body = replace(body, bs, names, inner, line);
+            out.insert(out.end(), decls.begin(), decls.end());
+            auto tok = [&](TK ty, const std::string& v) {
+                out.push_back({ty, v, line});
+            };
+            auto loop = [&](const Toks& c) {
+                out.insert(out.end(), t.begin() + i, t.begin() + c0);
+                out.insert(out.end(), c.begin(), c.end());
+                out.push_back(t[q]);
+                out.push_back(t[b]);
+                out.insert(out.end(), body.begin(), body.end());
+                out.push_back(t[e]);
+            };
+            if (bs.empty()) {
+                loop(cond);
+            } else if (is_for) {
+                std::string seq = "__seq" + std::to_string(g_opt_serial++);
+                tok(VAR, "var");
+                tok(IDENT, seq);
+                tok(ASSIGN, "=");
+                out.insert(out.end(), cond.begin(), cond.end());
+                for (const char* s : {"if", "(", "len", "(", seq.c_str(), ")", ")", "{"}) {
+                    std::string v = s;
+                    tok(v == "if" ? IF : v == "(" ? LPAREN : v == ")" ? RPAREN : v == "{" ? LBRACE : IDENT, v);
+                }
+                out.insert(out.end(), inner.begin(), inner.end());
+                loop({{IDENT, seq, line}});
+                tok(RBRACE, "}");
+                tok(UNVAR, seq);
+            } else {
+                tok(IF, "if");
+                tok(LPAREN, "(");
+                out.insert(out.end(), cond.begin(), cond.end());
+                tok(RPAREN, ")");
+                tok(LBRACE, "{");
+                out.insert(out.end(), inner.begin(), inner.end());
+                loop(cond);
+                tok(RBRACE, "}");
+            }
+            for (auto& kv : names)   // neither the names nor their values outlive the loop
+                tok(UNVAR, kv.second);
+            i = e;
+        }
+    }
+};
+
+// Recently compiled (lexed and optimized) sources of one environment, so
+// scripts that eval() the same strings in a loop skip the front end. LRU,
+// keyed by a hash of the source text and checked against the full text. An
+// entry the optimizer built around a builtin that a proc now shadows is
+// compiled again.
+static constexpr size_t CODE_CACHE_DEFAULT = 64;
+struct CodeCache {
+    struct Entry {
+        std::string              src;
+        bool                     optimized;
+        std::vector<Token>       toks;
+        std::vector<std::string> assumed;
+    };
+    std::list<Entry> lru;   // most recent first
+    std::unordered_map<std::size_t, std::list<Entry>::iterator> index;
+    std::size_t capacity = CODE_CACHE_DEFAULT;
+    std::size_t hits     = 0;
+    std::size_t misses   = 0;
+
+    CodeCache() = default;
+    CodeCache(const CodeCache& o) : capacity(o.capacity) {}   // entries stay behind
+    CodeCache& operator=(const CodeCache& o) {
+        lru.clear();
+        index.clear();
+        capacity = o.capacity;
+        return *this;
+    }
+    template <typename Shadowed>
+    const std::vector<Token>* find(const std::string& src, bool optimized, Shadowed shadowed) {
+        auto it = index.find(std::hash<std::string>{}(src));
+        if (it != index.end() && it->second->src == src && it->second->optimized == optimized &&
+                std::none_of(it->second->assumed.begin(), it->second->assumed.end(), shadowed)) {
+            lru.splice(lru.begin(), lru, it->second);
+            hits++;
+            return &lru.front().toks;
+        }
+        misses++;
+        return nullptr;
+    }
+    void store(const std::string& src, bool optimized, const std::vector<Token>& toks,
+               std::vector<std::string> assumed) {
+        if (capacity == 0) return;
+        std::size_t h = std::hash<std::string>{}(src);
+        auto it = index.find(h);
+        if (it != index.end()) lru.erase(it->second);
+        lru.push_front({src, optimized, toks, std::move(assumed)});
+        index[h] = lru.begin();
+        trim();
+    }
+    void trim() {
+        while (lru.size() > capacity) {
+            index.erase(std::hash<std::string>{}(lru.back().src));
+            lru.pop_back();
+        }
+    }
+};
+
 static constexpr size_t MAX_CALL_DEPTH = 128;
 struct ReturnSignal {
     Value val;
@@ -210,54 +1302,320 @@ struct Proc {
     std::vector<Token>       body;
     std::string              def_file;
     EnvPtr                   closure;
+    bool                     generator = false;   // body yields
 };
 
+// True if `body` has a yield outside the nested procs it defines.
+inline bool body_yields(const std::vector<Token>& body) {
+    for (size_t i = 0; i < body.size(); i++) {
+        if (body[i].type == YIELD) return true;
+        if (body[i].type != PROC) continue;
+        while (i < body.size() && body[i].type != LBRACE) i++;
+        for (int depth = 0; i < body.size(); i++) {
+            if (body[i].type == LBRACE) depth++;
+            else if (body[i].type == RBRACE && --depth == 0) break;
+        }
+    }
+    return false;
+}
+
 struct Env {
     std::unordered_map<std::string, Value> vars;
     EnvPtr parent;
+    bool   gc_tracked = false;
+    bool   frozen     = false;   // read-only: a prelude, or scopes under pmap
+    bool   sealed     = false;   // frozen for good (a prelude)
     Env(EnvPtr p = nullptr) : parent(std::move(p)) {}
 };
 
-std::string to_str(const Value& v) {
+// Globals of the environment executing on this thread. They shadow every
+// frozen scope, so prelude procs see (and write into) the globals of the
+// fork that calls them; see Environment::fork().
+inline thread_local Env* t_globals = nullptr;
+struct GlobalsScope {
+    Env* prev;
+    explicit GlobalsScope(Env* g) : prev(t_globals) {
+        t_globals = g;
+    }
+    ~GlobalsScope() {
+        t_globals = prev;
+    }
+};
+
+// Scopes replaced by private snapshots while a spawned task runs: scope
+// walks and new call frames use the copy instead of the caller's original.
+using ScopeMap = std::unordered_map<const Env*, EnvPtr>;
+inline thread_local std::shared_ptr<const ScopeMap> t_remap;
+inline Env* scope_of(Env* e) {
+    if (t_remap && e) {
+        auto it = t_remap->find(e);
+        if (it != t_remap->end()) return it->second.get();
+    }
+    return e;
+}
+
+// Cycle collector for call environments.
+//
+// A proc created inside a call closes over the call environment, which
+// usually also stores the proc, so the pair is never freed by reference
+// counting alone. Such environments are tracked (weakly) when they first
+// become a closure and collected by trial deletion: for every object
+// reachable from the candidates, the references coming from other
+// candidates are subtracted from its shared_ptr use count. Objects left
+// with a positive count are held from outside (globals, running
+// interpreters, C++ locals) and keep everything they reach alive; the rest
+// is unreachable garbage and is cleared to break the cycles.
+//
+// Collection is generational: newly tracked environments are scanned when
+// GC_YOUNG_LIMIT of them accumulate, survivors are promoted and the old
+// generation is rescanned whenever it doubles. Environments outside the
+// candidate set (the global one, or the old generation during a young
+// pass) are never traversed; their references count as external, which is
+// conservative.
+static constexpr size_t GC_YOUNG_LIMIT = 1024;
+static constexpr size_t GC_OLD_MIN     = 4096;
+struct Collector {
+    size_t collections = 0;
+    size_t freed       = 0;
+
+    void track(const EnvPtr& e) {
+        if (e->gc_tracked || !e->parent) return;
+        e->gc_tracked = true;
+        young_.push_back(e);
+        if (young_.size() >= GC_YOUNG_LIMIT) collect(false);
+    }
+    size_t tracked() const {
+        return young_.size() + old_.size();
+    }
+    // Returns the number of objects freed.
+    size_t collect(bool full) {
+        std::vector<std::weak_ptr<Env>> cand;
+        cand.reserve(young_.size() + (full || old_.size() >= old_limit_ ? old_.size() : 0));
+        for (auto& w : young_) if (!w.expired()) cand.push_back(std::move(w));
+        young_.clear();
+        bool with_old = full || old_.size() >= old_limit_;
+        if (with_old) {
+            for (auto& w : old_) if (!w.expired()) cand.push_back(std::move(w));
+            old_.clear();
+        }
+        size_t n = scan(cand);
+        for (auto& w : cand) if (!w.expired()) old_.push_back(std::move(w));
+        if (with_old) old_limit_ = std::max(GC_OLD_MIN, 2 * old_.size());
+        collections++;
+        freed += n;
+        return n;
+    }
+
+private:
+    enum Kind { K_ENV, K_PROC, K_ARRAY, K_MAP };
+    struct Node {
+        Kind                 kind;
+        const void*          ptr;
+        long                 refs;
+        std::weak_ptr<void>  owner;
+        std::vector<size_t>  kids;
+        bool                 reached = false;
+    };
+
+    size_t scan(const std::vector<std::weak_ptr<Env>>& cand) {
+        std::vector<Node> nodes;
+        std::unordered_map<const void*, size_t> index;
+        std::unordered_map<const Env*, bool> in_set;
+        for (auto& w : cand) {
+            EnvPtr e = w.lock();
+            if (e) in_set[e.get()] = true;
+        }
+        auto add = [&](Kind k, const void* p, long refs, std::weak_ptr<void> owner) -> size_t {
+            auto it = index.find(p);
+            if (it != index.end()) return it->second;
+            index.emplace(p, nodes.size());
+            nodes.push_back(Node{k, p, refs, std::move(owner), {}});
+            return nodes.size() - 1;
+        };
+        auto edge = [&](size_t from, size_t to) {
+            nodes[from].kids.push_back(to);
+        };
+        auto env_edge = [&](size_t from, const EnvPtr& e) {
+            if (e && in_set.count(e.get())) edge(from, add(K_ENV, e.get(), e.use_count(), e));
+        };
+        auto value_edge = [&](size_t from, const Value& v) {
+            if (auto* p = std::get_if<ProcVal>(&v))
+                edge(from, add(K_PROC, p->get(), p->use_count(), *p));
+            else if (auto* a = std::get_if<ArrayPtr>(&v))
+                edge(from, add(K_ARRAY, a->get(), a->use_count(), *a));
+            else if (auto* m = std::get_if<MapPtr>(&v))
+                edge(from, add(K_MAP, m->get(), m->use_count(), *m));
+        };
+        // weak_ptr::use_count() reads the strong count without adding to it
+        for (auto& w : cand) {
+            const void* p = w.lock().get();
+            if (p) add(K_ENV, p, w.use_count(), w);
+        }
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const void* p = nodes[i].ptr;
+            switch (nodes[i].kind) {
+            case K_ENV: {
+                const Env* e = static_cast<const Env*>(p);
+                for (auto& kv : e->vars) value_edge(i, kv.second);
+                env_edge(i, e->parent);
+                break;
+            }
+            case K_PROC:
+                env_edge(i, static_cast<const Proc*>(p)->closure);
+                break;
+            case K_ARRAY: {
+                const Array* a = static_cast<const Array*>(p);
+                if (!a->packed())
+                    for (size_t j = 0; j < a->size(); j++) value_edge(i, a->at(j));
+                break;
+            }
+            case K_MAP:
+                static_cast<const Map*>(p)->each([&](const MapKey&, const Value& v) {
+                    value_edge(i, v);
+                });
+                break;
+            }
+        }
+        for (auto& n : nodes)
+            for (size_t k : n.kids) nodes[k].refs--;
+        std::vector<size_t> stack;
+        for (size_t i = 0; i < nodes.size(); i++)
+            if (nodes[i].refs > 0) {
+                nodes[i].reached = true;
+                stack.push_back(i);
+            }
+        while (!stack.empty()) {
+            size_t i = stack.back();
+            stack.pop_back();
+            for (size_t k : nodes[i].kids)
+                if (!nodes[k].reached) {
+                    nodes[k].reached = true;
+                    stack.push_back(k);
+                }
+        }
+        // Hold every garbage object while its links are cut, so nothing is
+        // destroyed mid-sweep; the whole cycle goes when holds is released.
+        std::vector<std::shared_ptr<void>> holds;
+        for (auto& n : nodes)
+            if (!n.reached) holds.push_back(n.owner.lock());
+        for (auto& n : nodes) {
+            if (n.reached) continue;
+            switch (n.kind) {
+            case K_ENV: {
+                Env* e = const_cast<Env*>(static_cast<const Env*>(n.ptr));
+                e->vars.clear();
+                e->parent.reset();
+                break;
+            }
+            case K_PROC:
+                const_cast<Proc*>(static_cast<const Proc*>(n.ptr))->closure.reset();
+                break;
+            case K_ARRAY:
+                const_cast<Array*>(static_cast<const Array*>(n.ptr))->boxed().clear();
+                break;
+            case K_MAP:
+                *const_cast<Map*>(static_cast<const Map*>(n.ptr)) = Map{};
+                break;
+            }
+        }
+        return holds.size();
+    }
+
+    std::vector<std::weak_ptr<Env>> young_, old_;
+    size_t old_limit_ = GC_OLD_MIN;
+};
+
+// Appends the printed form of v to out; containers recurse into the same
+// buffer so printing is linear in the size of the output.
+void to_str_into(std::string& out, const Value& v, bool quote = false) {
+    auto num = [&out](double x) {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "%.15g", x);
+        out.append(buf, (size_t)n);
+    };
     if (auto* nv = std::get_if<NumVal>(&v)) {
         if (nv->size() == 1) {
-            char buf[32];
-            snprintf(buf, sizeof(buf), "%.15g", (*nv)[0]);
-            return buf;
+            num((*nv)[0]);
+            return;
         }
-        std::string r = "<";
+        out.reserve(out.size() + 2 + nv->size() * 12);
+        out += '<';
         for (size_t i = 0; i < nv->size(); i++) {
-            if (i) r += " ";
-            char buf[32];
-            snprintf(buf, sizeof(buf), "%.15g", (*nv)[i]);
-            r += buf;
+            if (i) out += ' ';
+            num((*nv)[i]);
         }
-        return r + ">";
+        out += '>';
+        return;
+    }
+    if (auto* s = std::get_if<std::string>(&v)) {
+        if (quote) out += '"';
+        out += *s;
+        if (quote) out += '"';
+        return;
     }
-    if (auto* s = std::get_if<std::string>(&v)) return *s;
     if (auto* p = std::get_if<ProcVal>(&v)) {
-        std::string r = "<proc(";
+        out += "<proc(";
         for (size_t i = 0; i < (*p)->params.size(); i++) {
-            if (i) r += ", ";
-            r += (*p)->params[i];
+            if (i) out += ", ";
+            out += (*p)->params[i];
         }
-        return r + ")>";
+        out += ")>";
+        return;
     }
-    const auto& el = std::get<ArrayPtr>(v)->elems;
-    std::string r = "[";
-    for (size_t i = 0; i < el.size(); i++) {
-        if (i) r += ", ";
-        if (std::holds_alternative<std::string>(el[i]))
-            r += '"' + std::get<std::string>(el[i]) + '"';
-        else r += to_str(el[i]);
+    if (auto* m = std::get_if<MapPtr>(&v)) {
+        out += '{';
+        bool first = true;
+        (*m)->each([&](const MapKey& k, const Value& x) {
+            if (!first) out += ", ";
+            first = false;
+            if (k.is_num) num(k.num);
+            else {
+                out += '"';
+                out += k.str;
+                out += '"';
+            }
+            out += ": ";
+            to_str_into(out, x, true);
+        });
+        out += '}';
+        return;
     }
-    return r + "]";
+    if (auto* n = std::get_if<NativePtr>(&v)) {
+        out += '<';
+        out += (*n)->type_name();
+        out += '>';
+        return;
+    }
+    const Array& arr = *std::get<ArrayPtr>(v);
+    out += '[';
+    if (arr.packed()) {
+        const auto& xs = arr.nums();
+        out.reserve(out.size() + 2 + xs.size() * 12);
+        for (size_t i = 0; i < xs.size(); i++) {
+            if (i) out += ", ";
+            num(xs[i]);
+        }
+    } else {
+        for (size_t i = 0; i < arr.size(); i++) {
+            if (i) out += ", ";
+            to_str_into(out, arr.at(i), true);
+        }
+    }
+    out += ']';
+}
+std::string to_str(const Value& v) {
+    if (auto* s = std::get_if<std::string>(&v)) return *s;
+    std::string r;
+    to_str_into(r, v);
+    return r;
 }
 double to_bool(const Value& v) {
     if (auto* nv = std::get_if<NumVal>(&v))    return nv->size() > 0 && (*nv)[0] != 0.0 ? 1.0 : 0.0;
     if (auto* s = std::get_if<std::string>(&v)) return s->empty() ? 0.0 : 1.0;
     if (std::holds_alternative<ProcVal>(v))     return 1.0;
-    return std::get<ArrayPtr>(v)->elems.empty() ? 0.0 : 1.0;
+    if (auto* m = std::get_if<MapPtr>(&v))      return (*m)->size() == 0 ? 0.0 : 1.0;
+    if (std::holds_alternative<NativePtr>(v))   return 1.0;
+    return std::get<ArrayPtr>(v)->empty() ? 0.0 : 1.0;
 }
 bool values_equal(const Value& a, const Value& b) {
     if (a.index() != b.index()) return false;
@@ -270,8 +1628,44 @@ bool values_equal(const Value& a, const Value& b) {
     if (auto* sa = std::get_if<std::string>(&a)) return *sa == std::get<std::string>(b);
     if (std::holds_alternative<ProcVal>(a))
         return std::get<ProcVal>(a) == std::get<ProcVal>(b);
+    if (std::holds_alternative<MapPtr>(a))
+        return std::get<MapPtr>(a) == std::get<MapPtr>(b);
+    if (std::holds_alternative<NativePtr>(a))
+        return std::get<NativePtr>(a) == std::get<NativePtr>(b);
     return std::get<ArrayPtr>(a) == std::get<ArrayPtr>(b);
 }
+// Recursive copy of arrays and maps; other values are returned as is.
+// `seen` maps originals to copies, so shared and cyclic structure is kept.
+using CopyMemo = std::unordered_map<const void*, Value>;
+Value deep_copy(const Value& v, CopyMemo& seen) {
+    const void* key = nullptr;
+    if (auto* a = std::get_if<ArrayPtr>(&v)) key = a->get();
+    else if (auto* m = std::get_if<MapPtr>(&v)) key = m->get();
+    else return v;
+    auto it = seen.find(key);
+    if (it != seen.end()) return it->second;
+    if (auto* a = std::get_if<ArrayPtr>(&v)) {
+        if ((*a)->packed()) return seen[key] = std::make_shared<Array>(**a);
+        auto r = std::make_shared<Array>();
+        seen[key] = r;
+        r->reserve((*a)->size());
+        (*a)->each([&](const Value& x) {
+            r->push(deep_copy(x, seen));
+        });
+        return r;
+    }
+    auto r = std::make_shared<Map>();
+    seen[key] = r;
+    std::get<MapPtr>(v)->each([&](const MapKey& k, const Value& x) {
+        r->set(k, deep_copy(x, seen));
+    });
+    return r;
+}
+Value deep_copy(const Value& v) {
+    CopyMemo seen;
+    return deep_copy(v, seen);
+}
+
 static double scalar(const Value& v, const std::string& ctx) {
     if (!std::holds_alternative<NumVal>(v))
         throw Error{"scientific", -1, ctx + ": expected number"};
@@ -283,19 +1677,463 @@ static const NumVal& nvec(const Value& v, const std::string& ctx) {
     return std::get<NumVal>(v);
 }
 
+// Work-stealing thread pool shared by every environment in the process.
+// Each worker owns a deque: it pops its own tasks LIFO and steals FIFO from
+// the others when empty. Tasks submitted from a worker go to its own deque,
+// the rest are spread round-robin. A thread waiting on a TaskGroup runs
+// queued tasks meanwhile, so nested parallel calls cannot starve the pool.
+// The size is MUSIL_THREADS if set, the hardware concurrency otherwise.
+struct WorkPool {
+    using Task = std::function<void()>;
+
+    explicit WorkPool(unsigned n) : queues_(n) {
+        for (unsigned i = 0; i < n; i++)
+            threads_.emplace_back([this, i] { work(i); });
+    }
+    ~WorkPool() {
+        {
+            std::lock_guard<std::mutex> lk(idle_m_);
+            stop_ = true;
+        }
+        idle_cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+    unsigned size() const {
+        return (unsigned)queues_.size();
+    }
+    void submit(Task t) {
+        unsigned q = self_ >= 0 ? (unsigned)self_ : next_++ % size();
+        {
+            std::lock_guard<std::mutex> lk(queues_[q].m);
+            queues_[q].tasks.push_back(std::move(t));
+        }
+        {
+            std::lock_guard<std::mutex> lk(idle_m_);
+            queued_++;
+        }
+        idle_cv_.notify_one();
+    }
+    // Runs one queued task on the calling thread; false if none was found.
+    bool run_one() {
+        Task t;
+        if (!take(self_ >= 0 ? (unsigned)self_ : next_ % size(), t)) return false;
+        t();
+        return true;
+    }
+
+private:
+    struct Queue {
+        std::mutex       m;
+        std::deque<Task> tasks;
+    };
+    bool take(unsigned home, Task& t) {
+        for (unsigned k = 0; k < size(); k++) {
+            Queue& q = queues_[(home + k) % size()];
+            std::lock_guard<std::mutex> lk(q.m);
+            if (q.tasks.empty()) continue;
+            if (k == 0) {
+                t = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            std::lock_guard<std::mutex> lk2(idle_m_);
+            queued_--;
+            return true;
+        }
+        return false;
+    }
+    void work(unsigned i) {
+        self_ = (int)i;
+        for (;;) {
+            Task t;
+            if (take(i, t)) {
+                t();
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(idle_m_);
+            idle_cv_.wait(lk, [this] { return stop_ || queued_ > 0; });
+            if (stop_) return;
+        }
+    }
+
+    std::vector<Queue>       queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<unsigned>    next_{0};
+    std::mutex               idle_m_;
+    std::condition_variable  idle_cv_;
+    size_t                   queued_ = 0;
+    bool                     stop_   = false;
+    static inline thread_local int self_ = -1;
+};
+
+inline unsigned pool_threads() {
+    const char* s = std::getenv("MUSIL_THREADS");
+    int n = s ? std::atoi(s) : 0;
+    if (n > 0) return (unsigned)n;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+// The shared pool, started on first use. It is never destroyed, so the
+// process may exit with its threads idle. A child forked while the pool
+// runs (musil --serve) has none of its threads: the child starts a pool
+// of its own on first use instead and leaves the parent's alone.
+inline std::atomic<WorkPool*> g_work_pool{nullptr};
+inline void work_pool_forget() {
+    g_work_pool.store(nullptr);
+}
+inline WorkPool& work_pool() {
+    WorkPool* p = g_work_pool.load(std::memory_order_acquire);
+    if (p) return *p;
+    static const int forget = pthread_atfork(nullptr, nullptr, work_pool_forget);
+    (void)forget;
+    auto* fresh = new WorkPool(pool_threads());
+    if (g_work_pool.compare_exchange_strong(p, fresh, std::memory_order_acq_rel)) return *fresh;
+    delete fresh;
+    return *p;
+}
+
+// Tasks that a caller waits for as a whole. Tasks must not throw; the
+// waiting thread helps with queued work and otherwise sleeps until the
+// last task of the group finishes.
+struct TaskGroup {
+    std::atomic<size_t>     pending{0};
+    std::mutex              m;
+    std::condition_variable cv;
+
+    void run(WorkPool::Task t) {
+        pending++;
+        work_pool().submit([this, t = std::move(t)] {
+            t();
+            std::lock_guard<std::mutex> lk(m);
+            if (--pending == 0) cv.notify_all();
+        });
+    }
+    void wait() {
+        while (pending.load() > 0) {
+            if (work_pool().run_one()) continue;
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait_for(lk, std::chrono::milliseconds(1), [this] { return pending.load() == 0; });
+        }
+        std::lock_guard<std::mutex> lk(m);   // the last task has left run()
+    }
+};
+
+// Random numbers. Each thread draws from its own xoshiro256** stream, so
+// generation takes no locks. Streams start from OS entropy; seed(n) makes
+// the current one reproducible. Work that leaves the thread (pmap chunks,
+// spawned tasks, generator bodies) runs under an RngScope seeded from the
+// creator's stream when the work is set up, so a seeded script draws the
+// same numbers however the pool schedules it.
+struct Rng {
+    uint64_t s[4];
+
+    explicit Rng(uint64_t seed = entropy()) {
+        reseed(seed);
+    }
+    static uint64_t entropy() {
+        static std::atomic<uint64_t> counter{0};
+        std::random_device rd;
+        uint64_t x = ((uint64_t)rd() << 32) ^ rd();
+        return x ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^
+               (counter++ * 0x9E3779B97F4A7C15ull);
+    }
+    static uint64_t splitmix(uint64_t& x) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+    void reseed(uint64_t seed) {
+        for (auto& w : s) w = splitmix(seed);
+    }
+    uint64_t next() {
+        uint64_t r = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return r;
+    }
+    double uniform() {   // [0, 1)
+        return (double)(next() >> 11) * 0x1.0p-53;
+    }
+    uint64_t below(uint64_t n) {   // [0, n), without modulo bias
+        uint64_t threshold = (0 - n) % n;
+        while (true) {
+            uint64_t r = next();
+            if (r >= threshold) return r % n;
+        }
+    }
+
+    // Uniform [lo, hi) in bulk: RNG_LANES independent xoshiro256+ streams
+    // forked from this one advance side by side in plain arrays, which the
+    // compiler turns into vector code. The top 52 bits become the mantissa
+    // of a double in [1, 2), so no integer-to-float conversion is needed.
+    static constexpr size_t RNG_LANES = 8;
+    void fill_uniform(double* out, size_t n, double lo, double hi) {
+        uint64_t a[RNG_LANES], b[RNG_LANES], c[RNG_LANES], d[RNG_LANES];
+        for (size_t l = 0; l < RNG_LANES; l++) {
+            a[l] = next() | 1;   // never the all-zero state
+            b[l] = next();
+            c[l] = next();
+            d[l] = next();
+        }
+        double scale = hi - lo, base = lo - scale;
+        size_t i = 0;
+        for (; i + RNG_LANES <= n; i += RNG_LANES) {
+            for (size_t l = 0; l < RNG_LANES; l++) {
+                uint64_t r = a[l] + d[l];
+                uint64_t t = b[l] << 17;
+                c[l] ^= a[l];
+                d[l] ^= b[l];
+                b[l] ^= c[l];
+                a[l] ^= d[l];
+                c[l] ^= t;
+                d[l] = (d[l] << 45) | (d[l] >> 19);
+                uint64_t bits = (r >> 12) | 0x3FF0000000000000ull;
+                double u;
+                std::memcpy(&u, &bits, sizeof u);
+                out[i + l] = base + u * scale;
+            }
+        }
+        for (; i < n; i++) out[i] = lo + uniform() * scale;
+    }
+
+    // Standard normal deviates: 128-layer ziggurat (Marsaglia-Tsang, in
+    // Doornik's formulation). One 64-bit draw gives the layer and the
+    // abscissa; about 98.8% of samples take the first branch.
+    struct Ziggurat {
+        static constexpr int    LAYERS = 128;
+        static constexpr double R = 3.442619855899;
+        static constexpr double V = 9.91256303526217e-3;
+        double x[LAYERS + 1], ratio[LAYERS];
+        Ziggurat() {
+            double f = std::exp(-0.5 * R * R);
+            x[0] = V / f;
+            x[1] = R;
+            x[LAYERS] = 0;
+            for (int i = 2; i < LAYERS; i++) {
+                x[i] = std::sqrt(-2.0 * std::log(V / x[i-1] + f));
+                f = std::exp(-0.5 * x[i] * x[i]);
+            }
+            for (int i = 0; i < LAYERS; i++) ratio[i] = x[i+1] / x[i];
+        }
+    };
+    static const Ziggurat& ziggurat() {
+        static const Ziggurat z;
+        return z;
+    }
+    double open_uniform() {   // (0, 1)
+        return ((double)(next() >> 11) + 0.5) * 0x1.0p-53;
+    }
+    double normal() {
+        const Ziggurat& z = ziggurat();
+        while (true) {
+            uint64_t r = next();
+            int    i = (int)(r & (Ziggurat::LAYERS - 1));
+            double u = (double)(r >> 11) * 0x1.0p-52 - 1.0;
+            if (std::fabs(u) < z.ratio[i]) return u * z.x[i];
+            if (i == 0) {   // base layer: sample the tail beyond R
+                double tx, ty;
+                do {
+                    tx = std::log(open_uniform()) / Ziggurat::R;
+                    ty = std::log(open_uniform());
+                } while (-2.0 * ty < tx * tx);
+                return u < 0 ? tx - Ziggurat::R : Ziggurat::R - tx;
+            }
+            double v = u * z.x[i];
+            double f0 = std::exp(-0.5 * (z.x[i] * z.x[i] - v * v));
+            double f1 = std::exp(-0.5 * (z.x[i+1] * z.x[i+1] - v * v));
+            if (f1 + uniform() * (f0 - f1) < 1.0) return v;
+        }
+    }
+    void fill_normal(double* out, size_t n) {
+        for (size_t i = 0; i < n; i++) out[i] = normal();
+    }
+};
+inline thread_local Rng* t_rng = nullptr;
+inline Rng& rng() {
+    if (!t_rng) {
+        thread_local Rng own;
+        t_rng = &own;
+    }
+    return *t_rng;
+}
+// Gives the scope its own stream, e.g. rng().next() drawn by the creator
+// of a task.
+struct RngScope {
+    Rng  own;
+    Rng* prev;
+    explicit RngScope(uint64_t seed) : own(seed), prev(t_rng) {
+        t_rng = &own;
+    }
+    ~RngScope() {
+        t_rng = prev;
+    }
+};
+
+// Total order on doubles for sorting: NaNs go last.
+inline bool num_less(double a, double b) {
+    return std::isnan(b) ? !std::isnan(a) : a < b;
+}
+
+// Stable sort. Inputs of at least PAR_SORT_MIN elements are split into
+// power-of-two runs sorted on the shared pool, then merged pairwise
+// (each merge level also runs in parallel).
+static constexpr size_t PAR_SORT_MIN = 1 << 16;
+template <typename T, typename Less>
+void par_stable_sort(T* p, size_t n, Less less) {
+    size_t hw = work_pool().size() + 1;
+    size_t parts = 1;
+    while (parts * 2 <= hw && n / (parts * 2) >= PAR_SORT_MIN / 2) parts *= 2;
+    if (parts < 2) {
+        std::stable_sort(p, p + n, less);
+        return;
+    }
+    std::vector<size_t> cut(parts + 1);
+    for (size_t i = 0; i <= parts; i++) cut[i] = n * i / parts;
+    std::exception_ptr failed;
+    std::mutex         failed_m;
+    unsigned           slot = t_mem_slot;
+    auto level = [&](const std::vector<size_t>& starts, auto step) {
+        TaskGroup group;
+        for (size_t i : starts)
+            group.run([&, i] {
+                MemScope mem{slot};
+                try {
+                    step(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lk(failed_m);
+                    if (!failed) failed = std::current_exception();
+                }
+            });
+        group.wait();
+        if (failed) std::rethrow_exception(failed);
+    };
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < parts; i++) starts.push_back(i);
+    level(starts, [&](size_t i) {
+        std::stable_sort(p + cut[i], p + cut[i + 1], less);
+    });
+    for (size_t w = 1; w < parts; w *= 2) {
+        starts.clear();
+        for (size_t i = 0; i + w < parts; i += 2 * w) starts.push_back(i);
+        level(starts, [&](size_t i) {
+            std::inplace_merge(p + cut[i], p + cut[i + w], p + cut[std::min(i + 2 * w, parts)], less);
+        });
+    }
+}
+
+// Runs body(lo, hi) over [0, n) split into contiguous blocks of at least
+// min_block items, at most one per pool thread plus the caller, on the
+// shared pool. Blocks charge memory to the caller's slot; the first
+// exception a block throws is rethrown here once all blocks are done.
+template <typename Body>
+void par_blocks(size_t n, size_t min_block, Body body) {
+    size_t parts = std::min<size_t>(work_pool().size() + 1, n / std::max<size_t>(min_block, 1));
+    if (parts < 2) {
+        if (n) body(size_t(0), n);
+        return;
+    }
+    std::exception_ptr failed;
+    std::mutex         failed_m;
+    unsigned           slot = t_mem_slot;
+    TaskGroup          group;
+    for (size_t i = 0; i < parts; i++)
+        group.run([&, i] {
+            MemScope mem{slot};
+            try {
+                body(n * i / parts, n * (i + 1) / parts);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk(failed_m);
+                if (!failed) failed = std::current_exception();
+            }
+        });
+    group.wait();
+    if (failed) std::rethrow_exception(failed);
+}
+
 
 struct Interpreter;
 using Builtin = std::function<Value(std::vector<Value>&, Interpreter&)>;
 using YieldFn = std::function<void()>;
+
+// Cooperative yield gate. The interpreter ticks it at every statement,
+// expression and loop iteration; the hot path is two relaxed loads, a
+// branch and a decrement. The host hook only runs when the budget is
+// exhausted or when another thread calls request() (e.g. the IDE Stop
+// button), so hook latency is bounded by YIELD_BUDGET ticks. Builtins tick
+// with a larger cost per block of samples via sig_yield().
+//
+// Only the owning thread touches the budget; request() bumps a counter
+// instead, shared with the gates of work started from this one on other
+// threads (pmap chunks, spawned tasks, generator bodies), which run the
+// same hook. The hook must therefore be safe to call from pool threads.
+static constexpr int32_t YIELD_BUDGET = 4096;
+static constexpr int32_t YIELD_BLOCK_COST = 64;
+struct YieldLink {
+    YieldFn                                fn;
+    std::shared_ptr<std::atomic<uint32_t>> requests;
+    uint32_t                               seen;
+};
+struct YieldGate {
+    YieldFn                                fn;
+    int32_t                                budget = YIELD_BUDGET;
+    std::shared_ptr<std::atomic<uint32_t>> requests = std::make_shared<std::atomic<uint32_t>>(0);
+    uint32_t                               seen = 0;
+
+    YieldGate() = default;
+    explicit YieldGate(const YieldLink& l) : fn(l.fn), requests(l.requests), seen(l.seen) {}
+    YieldGate(const YieldGate& o) : fn(o.fn) {}
+    YieldGate& operator=(const YieldGate& o) {
+        fn = o.fn;
+        budget = YIELD_BUDGET;
+        return *this;
+    }
+    // What a gate on another thread needs to follow this one; a request
+    // still pending here is delivered there too.
+    YieldLink link() const {
+        return {fn, requests, seen};
+    }
+    void request() {
+        requests->fetch_add(1, std::memory_order_relaxed);
+    }
+    void tick(int32_t cost = 1) {
+        if (budget > cost && requests->load(std::memory_order_relaxed) == seen) {
+            budget -= cost;
+            return;
+        }
+        budget = YIELD_BUDGET;
+        seen = requests->load(std::memory_order_relaxed);
+        if (fn) {
+            MemArm hook{false};
+            fn();
+        }
+    }
+};
+
 struct Interpreter {
     std::vector<Token>              T;
     size_t                          pos = 0;
     EnvPtr                          env;
     std::map<std::string, Builtin>& builtins;
     std::function<void(const std::string&, const std::string&)> load_fn;
-    YieldFn                         yield_fn;
+    YieldGate&                      yield;
+    Collector&                      gc;
     std::string                     filename;
     std::vector<std::string>&       call_stack;
+    const CodeCache*                code_cache = nullptr;   // for memstats()
+    // The builtins as one immutable table, for tasks that may outlive
+    // this context; see builtin_table().
+    std::shared_ptr<std::map<std::string, Builtin>> shared_builtins;
+    ProcGenerator*                  gen = nullptr;   // set while running a generator body
 
     std::filesystem::path current_base_dir() const {
         namespace fs = std::filesystem;
@@ -336,8 +2174,8 @@ struct Interpreter {
         }
     }
 
-    void maybe_yield() {
-        if (yield_fn) yield_fn();
+    void maybe_yield(int32_t cost = 1) {
+        yield.tick(cost);
     }
     Token consume()    {
         return T[pos++];
@@ -368,32 +2206,84 @@ struct Interpreter {
         while (e && e->parent) e = e->parent;
         return e;
     }
-    Value get_var(const std::string& n) {
-        for (EnvPtr e = env; e; e = e->parent) {
-            auto it = e->vars.find(n);
-            if (it != e->vars.end()) return it->second;
-        }
-        throw make_err("undefined '" + n + "'");
+    // Walks the scope chain. Before a frozen scope, the thread's globals
+    // are searched (unless we just came from them) together with the
+    // scopes they overlay up to the prelude: under pmap, a chunk's private
+    // globals, then the caller's. `frozen` tells whether the hit is in
+    // shared storage, `sealed` whether that storage is a prelude's.
+    Value* find_var(const std::string& n, bool& frozen, bool* sealed = nullptr) {
+        return find_var_from(env.get(), n, frozen, sealed);
     }
-    Value* get_var_ptr(const std::string& n) {
-        for (EnvPtr e = env; e; e = e->parent) {
+    Value* find_var_from(Env* from, const std::string& n, bool& frozen, bool* sealed = nullptr) {
+        Env* prev = nullptr;
+        for (Env* e = scope_of(from); e; prev = e, e = scope_of(e->parent.get())) {
+            if (e->frozen && t_globals && t_globals != prev) {
+                for (Env* g = t_globals; g && !g->sealed; g = g->parent.get()) {
+                    auto it = g->vars.find(n);
+                    if (it != g->vars.end()) {
+                        frozen = g->frozen;
+                        return &it->second;
+                    }
+                }
+            }
             auto it = e->vars.find(n);
-            if (it != e->vars.end()) return &it->second;
+            if (it != e->vars.end()) {
+                frozen = e->frozen;
+                if (sealed) *sealed = e->sealed;
+                return &it->second;
+            }
         }
         return nullptr;
     }
+    // Copy-on-write: gives this thread's globals a private deep copy of a
+    // prelude value before it can be changed.
+    Value* unshare(const std::string& n, const Value& v) {
+        if (!t_globals) throw make_err("cannot modify '" + n + "': environment is frozen");
+        return &(t_globals->vars[n] = deep_copy(v));
+    }
+    Value get_var(const std::string& n) {
+        Value* v = get_var_ptr(n);
+        if (!v) throw make_err("undefined '" + n + "'");
+        return *v;
+    }
+    // `write` unshares any frozen value, and gives a variable holding a
+    // container pmap shares a copy of its own. A prelude's containers are
+    // unshared even for reads, since the caller receives an alias it may
+    // mutate; those pmap shares are read in place by every chunk.
+    Value* get_var_ptr(const std::string& n, bool write = false) {
+        bool frozen = false, sealed = false;
+        Value* v = find_var(n, frozen, &sealed);
+        if (frozen && (write || (sealed && (std::holds_alternative<ArrayPtr>(*v) ||
+                                            std::holds_alternative<MapPtr>(*v)))))
+            return unshare(n, *v);
+        if (write && v && shared_container(*v)) *v = deep_copy(*v);
+        return v;
+    }
+    static bool shared_container(const Value& v) {
+        if (auto* a = std::get_if<ArrayPtr>(&v)) return (*a)->shared.on;
+        if (auto* m = std::get_if<MapPtr>(&v)) return (*m)->shared.on;
+        return false;
+    }
+    static bool mutator(const std::string& n) {
+        return n == "push" || n == "pop" || n == "insert" || n == "remove" || n == "set" || n == "del";
+    }
+    // A container pmap shares that is reached other than through a
+    // variable, e.g. as an element of another, cannot be unshared: writes
+    // to it are refused.
+    void writable(const Value& v, const std::string& fn) {
+        if (shared_container(v))
+            throw make_err(fn + ": cannot modify a container shared by pmap; copy() it first");
+    }
     void decl_var(const std::string& n, Value v) {
         env->vars[n] = std::move(v);
     }
     void assign_var(const std::string& n, Value v) {
-        for (EnvPtr e = env; e; e = e->parent) {
-            auto it = e->vars.find(n);
-            if (it != e->vars.end()) {
-                it->second = std::move(v);
-                return;
-            }
-        }
-        env->vars[n] = std::move(v);
+        bool frozen = false;
+        Value* slot = find_var(n, frozen);
+        if (!slot) env->vars[n] = std::move(v);
+        else if (!frozen) *slot = std::move(v);
+        else if (t_globals) t_globals->vars[n] = std::move(v);
+        else throw make_err("cannot modify '" + n + "': environment is frozen");
     }
 
     NumVal nv_binop(const NumVal& a, const NumVal& b, char op) {
@@ -493,7 +2383,22 @@ struct Interpreter {
             stmt();
         }
     }
+    // Allocation failures surface as ordinary errors at the innermost
+    // statement, so they carry its line and the proc call stack.
     void stmt() {
+        try {
+            MemArm armed{true};
+            exec_stmt();
+        } catch (const MemoryLimitError& e) {
+            const MemSlot& s = g_mem_slots[t_mem_slot];
+            throw make_err("memory limit exceeded: allocating " + std::to_string(e.requested >> 20) +
+                           " MB with " + std::to_string(s.live.load() >> 20) + " MB live (limit " +
+                           std::to_string(s.limit.load() >> 20) + " MB)");
+        } catch (const std::bad_alloc&) {
+            throw make_err("out of memory");
+        }
+    }
+    void exec_stmt() {
         maybe_yield();
         if (check(VAR)) {
             consume();
@@ -510,6 +2415,8 @@ struct Interpreter {
             for_stmt();
         } else if (check(PRINT))  {
             print_stmt();
+        } else if (check(UNVAR))  {
+            env->vars.erase(consume().val);
         } else if (check(RETURN)) {
             consume();
             throw ReturnSignal{expr()};
@@ -519,6 +2426,13 @@ struct Interpreter {
         } else if (check(CONTINUE)) {
             consume();
             throw ContinueSignal{};
+        } else if (check(YIELD))  {
+            consume();
+            Value v = expr();
+            if (!gen) throw make_err("yield outside a generator");
+            gen->item = std::move(v);
+            gen->resume_pos = pos;
+            gen->suspended = true;
         } else if (check(IDENT) && T[pos+1].type == LBRACKET) {
             indexed_assign();
         } else if (check(IDENT) && T[pos+1].type == ASSIGN) {
@@ -536,41 +2450,99 @@ struct Interpreter {
         Value idx = expr();
         expect(RBRACKET);
         if (check(LBRACKET)) {
-            Value outer = get_var(n);
-            auto& ap = std::get<ArrayPtr>(outer);
-            int i = checked_arr_index(ap, idx, n);
+            Value* op = get_var_ptr(n, true);
+            if (!op) throw make_err("undefined '" + n + "'");
+            Value outer = *op;
+            writable(outer, n);
             expect(LBRACKET);
             Value idx2 = expr();
             expect(RBRACKET);
             expect(ASSIGN);
             Value rhs = expr();
-            auto& inner = std::get<ArrayPtr>(ap->elems[i]);
-            int j = checked_arr_index(inner, idx2, n);
-            inner->elems[j] = rhs;
+            if (std::holds_alternative<ArrayPtr>(outer)) {
+                auto& ap = std::get<ArrayPtr>(outer);
+                store_index(ap->boxed()[checked_arr_index(ap, idx, n)], idx2, rhs, n);
+            } else if (std::holds_alternative<MapPtr>(outer)) {
+                Value* inner = std::get<MapPtr>(outer)->find(map_key(idx, n));
+                if (!inner) throw make_err("key '" + to_str(idx) + "' not found in '" + n + "'");
+                store_index(*inner, idx2, rhs, n);
+            } else {
+                throw make_err("cannot index into '" + n + "'");
+            }
             return;
         }
         expect(ASSIGN);
         Value rhs = expr();
-        Value* stored = get_var_ptr(n);
+        Value* stored = get_var_ptr(n, true);
         if (!stored) throw make_err("undefined '" + n + "'");
-        if (std::holds_alternative<NumVal>(*stored)) {
-            NumVal& nv = std::get<NumVal>(*stored);
+        store_index(*stored, idx, rhs, n);
+    }
+    void store_index(Value& target, const Value& idx, const Value& rhs, const std::string& n) {
+        writable(target, n);
+        if (std::holds_alternative<NumVal>(target)) {
+            NumVal& nv = std::get<NumVal>(target);
             int i = (int)nv_scalar(std::get<NumVal>(idx));
             if (i < 0) i += (int)nv.size();
             if (i < 0 || i >= (int)nv.size())
                 throw make_err("index " + std::to_string(i) + " out of bounds for '" + n + "'");
             nv[i] = nv_scalar(std::get<NumVal>(rhs));
-        } else if (std::holds_alternative<ArrayPtr>(*stored)) {
-            auto& ap = std::get<ArrayPtr>(*stored);
-            ap->elems[checked_arr_index(ap, idx, n)] = rhs;
+        } else if (std::holds_alternative<ArrayPtr>(target)) {
+            auto& ap = std::get<ArrayPtr>(target);
+            ap->set(checked_arr_index(ap, idx, n), rhs);
+        } else if (std::holds_alternative<MapPtr>(target)) {
+            std::get<MapPtr>(target)->set(map_key(idx, n), rhs);
         } else {
             throw make_err("cannot index into '" + n + "'");
         }
     }
+    // Stable ordering of sort keys; keys must be all numbers or all strings.
+    std::vector<size_t> sort_order(const std::vector<Value>& ks, const std::string& fn) {
+        std::vector<size_t> order(ks.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        if (ks.empty()) return order;
+        if (std::holds_alternative<std::string>(ks[0])) {
+            std::vector<const std::string*> sk(ks.size());
+            for (size_t i = 0; i < ks.size(); i++) {
+                sk[i] = std::get_if<std::string>(&ks[i]);
+                if (!sk[i]) throw make_err(fn + ": cannot compare strings and non-strings");
+            }
+            std::stable_sort(order.begin(), order.end(),
+                             [&sk](size_t x, size_t y) { return *sk[x] < *sk[y]; });
+            return order;
+        }
+        std::vector<double> nk(ks.size());
+        for (size_t i = 0; i < ks.size(); i++) {
+            auto* nv = std::get_if<NumVal>(&ks[i]);
+            if (!nv || nv->size() != 1)
+                throw make_err(fn + ": elements must be numbers or strings");
+            nk[i] = (*nv)[0];
+        }
+        par_stable_sort(order.data(), order.size(),
+                        [&nk](size_t x, size_t y) { return num_less(nk[x], nk[y]); });
+        return order;
+    }
+    static ArrayPtr permuted(const Array& src, const std::vector<size_t>& order) {
+        auto r = std::make_shared<Array>();
+        r->reserve(order.size());
+        for (size_t i : order) r->push(src.get(i));
+        return r;
+    }
+    MapKey map_key(const Value& v, const std::string& fn) {
+        MapKey k;
+        if (auto* s = std::get_if<std::string>(&v)) {
+            k.str = *s;
+        } else if (auto* nv = std::get_if<NumVal>(&v); nv && nv->size() == 1) {
+            k.is_num = true;
+            k.num = (*nv)[0] == 0.0 ? 0.0 : (*nv)[0];   // fold -0 into 0
+        } else {
+            throw make_err(fn + ": map keys must be strings or numbers");
+        }
+        return k;
+    }
     int checked_arr_index(const ArrayPtr& ap, const Value& idx, const std::string& name) {
         int i = (int)nv_scalar(std::get<NumVal>(idx));
-        if (i < 0) i += (int)ap->elems.size();
-        if (i < 0 || i >= (int)ap->elems.size())
+        if (i < 0) i += (int)ap->size();
+        if (i < 0 || i >= (int)ap->size())
             throw make_err("index " + std::to_string(i) + " out of bounds for '" + name + "'");
         return i;
     }
@@ -594,12 +2566,30 @@ struct Interpreter {
         }
         body.push_back({END, ""});
         auto pv = std::make_shared<Proc>(Proc{std::move(params), std::move(body), filename, env});
+        pv->generator = body_yields(pv->body);
+        gc.track(env);
         decl_var(name, pv);
     }
     void run_block() {
-        expect(LBRACE);
+        bool resumed = gen && gen->resuming;
+        if (!resumed) expect(LBRACE);
         try {
-            while (!check(RBRACE) && !check(END)) stmt();
+            if (resumed) {
+                // back into the block a generator suspended in: at the
+                // statement holding the pending yield, or right after it
+                if (gen->frames.empty()) {
+                    pos = gen->resume_pos;
+                    gen->resuming = false;
+                } else {
+                    pos = gen->frames.back().start;
+                    stmt();
+                    if (gen->suspended) return;
+                }
+            }
+            while (!check(RBRACE) && !check(END)) {
+                stmt();
+                if (suspended()) return;
+            }
         } catch (...) {
             int depth = 0;
             while (!check(END)) {
@@ -627,13 +2617,37 @@ struct Interpreter {
             pos++;
         }
     }
+    // A suspending generator unwinds through the if/while/for statements
+    // around its yield, each leaving a frame; resuming hands them back.
+    bool suspended() const {
+        return gen && gen->suspended;
+    }
+    bool take_frame(ProcGenerator::Frame* f = nullptr) {
+        if (!gen || !gen->resuming || gen->frames.empty()) return false;
+        if (f) *f = std::move(gen->frames.back());
+        gen->frames.pop_back();
+        return true;
+    }
+    void save_frame(size_t start, ProcGenerator::Frame f = {}) {
+        f.start = start;
+        gen->frames.push_back(std::move(f));
+    }
     void if_stmt() {
-        consume();
-        expect(LPAREN);
-        bool taken = to_bool(expr()) != 0.0;
-        expect(RPAREN);
-        if (taken) run_block();
-        else skip_block();
+        size_t start = pos;
+        bool taken = take_frame();
+        if (taken) {
+            run_block();
+            if (suspended()) return save_frame(start);
+        } else {
+            consume();
+            expect(LPAREN);
+            taken = to_bool(expr()) != 0.0;
+            expect(RPAREN);
+            if (taken) {
+                run_block();
+                if (suspended()) return save_frame(start);
+            } else skip_block();
+        }
         while (check(ELSE)) {
             consume();
             if (check(IF)) {
@@ -643,27 +2657,39 @@ struct Interpreter {
                 expect(RPAREN);
                 if (!taken && c) {
                     run_block();
+                    if (suspended()) return save_frame(start);
                     taken = true;
                 } else skip_block();
             } else {
-                if (!taken) run_block();
-                else skip_block();
+                if (!taken) {
+                    run_block();
+                    if (suspended()) return save_frame(start);
+                } else skip_block();
                 break;
             }
         }
     }
     void while_stmt() {
-        consume();
-        size_t cond = pos;
+        size_t start = pos;
+        ProcGenerator::Frame f;
+        bool resumed = take_frame(&f);
+        if (!resumed) {
+            consume();
+            f.mark = pos;
+        }
         while (true) {
-            maybe_yield();
-            pos = cond;
-            expect(LPAREN);
-            bool c = to_bool(expr()) != 0.0;
-            expect(RPAREN);
-            if (!c) {
-                skip_block();
-                break;
+            if (resumed) {
+                resumed = false;
+            } else {
+                maybe_yield();
+                pos = f.mark;
+                expect(LPAREN);
+                bool c = to_bool(expr()) != 0.0;
+                expect(RPAREN);
+                if (!c) {
+                    skip_block();
+                    break;
+                }
             }
             try {
                 run_block();
@@ -672,73 +2698,73 @@ struct Interpreter {
             } catch (BreakSignal&) {
                 break;
             }
+            if (suspended()) return save_frame(start, std::move(f));
         }
     }
+    // Next item of a for loop over f.seq; false once it is exhausted.
+    bool for_next(ProcGenerator::Frame& f, Value& item) {
+        if (auto* nv = std::get_if<NumVal>(&f.seq)) {
+            if (f.next >= nv->size()) return false;
+            item = NumVal{(*nv)[f.next++]};
+        } else if (auto* a = std::get_if<ArrayPtr>(&f.seq)) {
+            if (f.next >= (*a)->size()) return false;
+            item = (*a)->get(f.next++);
+        } else if (auto* s = std::get_if<std::string>(&f.seq)) {
+            if (f.next >= s->size()) return false;
+            item = std::string(1, (*s)[f.next++]);
+        } else if (std::holds_alternative<MapPtr>(f.seq)) {
+            if (f.next >= f.keys.size()) return false;
+            item = std::move(f.keys[f.next++]);
+        } else {
+            return native_cast<Generator>(f.seq)->pull(item, *this);
+        }
+        return true;
+    }
     void for_stmt() {
-        consume();
-        expect(LPAREN);
-        expect(VAR);
-        std::string var_name = expect(IDENT).val;
-        expect(IN);
-        Value collection = expr();
-        expect(RPAREN);
-        size_t body_start = pos;
-
-        auto run_body_with = [&](Value v) {
-            maybe_yield();
-            pos = body_start;
-            env->vars[var_name] = std::move(v);
-            try {
-                run_block();
-            } catch (ContinueSignal&) {
-                return;
-            }
-        };
-
-        if (std::holds_alternative<NumVal>(collection)) {
-            const NumVal& nv = std::get<NumVal>(collection);
-            bool broken = false;
-            for (size_t i = 0; i < nv.size() && !broken; i++) {
-                try {
-                    run_body_with(NumVal{nv[i]});
-                } catch (BreakSignal&) {
-                    broken = true;
-                }
-            }
-            if (!broken) {
-                pos = body_start;
-                skip_block();
-            }
-        } else if (std::holds_alternative<ArrayPtr>(collection)) {
-            const auto& elems = std::get<ArrayPtr>(collection)->elems;
-            bool broken = false;
-            for (size_t i = 0; i < elems.size() && !broken; i++) {
-                try {
-                    run_body_with(elems[i]);
-                } catch (BreakSignal&) {
-                    broken = true;
-                }
-            }
-            if (!broken) {
-                pos = body_start;
-                skip_block();
+        size_t start = pos;
+        ProcGenerator::Frame f;
+        bool resumed = take_frame(&f);
+        if (!resumed) {
+            consume();
+            expect(LPAREN);
+            expect(VAR);
+            f.var = expect(IDENT).val;
+            expect(IN);
+            f.seq = expr();   // holding a generator keeps it alive
+            expect(RPAREN);
+            f.mark = pos;
+            if (auto* m = std::get_if<MapPtr>(&f.seq)) {
+                // iterate over a snapshot of the keys, in insertion order
+                (*m)->each([&](const MapKey& k, const Value&) {
+                    f.keys.push_back(map_key_value(k));
+                });
+            } else if (!std::holds_alternative<NumVal>(f.seq) && !std::holds_alternative<ArrayPtr>(f.seq) &&
+                       !std::holds_alternative<std::string>(f.seq) && !native_cast<Generator>(f.seq)) {
+                throw make_err("'for in' requires number, array, map, string or generator");
             }
-        } else if (std::holds_alternative<std::string>(collection)) {
-            const std::string& s = std::get<std::string>(collection);
-            bool broken = false;
-            for (size_t i = 0; i < s.size() && !broken; i++) {
-                try {
-                    run_body_with(std::string(1, s[i]));
-                } catch (BreakSignal&) {
-                    broken = true;
+        }
+        Value item;
+        while (true) {
+            if (resumed) {
+                resumed = false;
+            } else {
+                if (!for_next(f, item)) {
+                    pos = f.mark;
+                    skip_block();
+                    break;
                 }
+                maybe_yield();
+                pos = f.mark;
+                env->vars[f.var] = std::move(item);
             }
-            if (!broken) {
-                pos = body_start;
-                skip_block();
+            try {
+                run_block();
+            } catch (ContinueSignal&) {
+                continue;
+            } catch (BreakSignal&) {
+                break;
             }
-        } else {
-            throw make_err("'for in' requires number, array, or string");
+            if (suspended()) return save_frame(start, std::move(f));
         }
     }
     void print_stmt() {
@@ -748,23 +2774,96 @@ struct Interpreter {
         while (!check(END)   && !check(RBRACE) && !check(VAR)   && !check(PROC)
                 && !check(WHILE) && !check(FOR)    && !check(IF)    && !check(ELSE)
                 && !check(BREAK) && !check(CONTINUE) && !check(PRINT)  && !check(RETURN)
+                && !check(YIELD)
                 && !(check(IDENT) && T[pos+1].type == ASSIGN)
                 && T[pos].line == pl)
-            out += to_str(expr());
+            to_str_into(out, expr());
         std::cout << out << "\n";
     }
 
     Value call_procval(const ProcVal& pv, std::vector<Value> args, const std::string& label = "<proc>") {
         if (args.size() != pv->params.size())
             throw make_err("arity mismatch: expected " + std::to_string(pv->params.size()) + " args");
+        if (pv->generator) return make_generator(pv, std::move(args), label);
+        return run_proc(pv, std::move(args), label);
+    }
+    std::shared_ptr<std::map<std::string, Builtin>> builtin_table() {
+        if (!shared_builtins) shared_builtins = std::make_shared<std::map<std::string, Builtin>>(builtins);
+        return shared_builtins;
+    }
+    // Calling a generator proc only binds its arguments; the body starts
+    // on the first pull, in the caller's scopes and memory slot, and keeps
+    // them (with a random stream of its own) from one pull to the next.
+    NativePtr make_generator(const ProcVal& pv, std::vector<Value> args, const std::string& label) {
+        if (call_stack.size() >= MAX_CALL_DEPTH)
+            throw make_err("maximum recursion depth exceeded");
+        EnvPtr scope = pv->closure ? pv->closure : env;
+        if (t_remap) {
+            auto it = t_remap->find(scope.get());
+            if (it != t_remap->end()) scope = it->second;
+        }
+        EnvPtr call_env = std::make_shared<Env>(std::move(scope));
+        for (size_t i = 0; i < args.size(); i++) call_env->vars[pv->params[i]] = std::move(args[i]);
 
+        struct Body {
+            std::shared_ptr<std::map<std::string, Builtin>> table;
+            YieldGate                       y;
+            Collector                       c;
+            std::vector<std::string>        stack;
+            Rng                             random;
+            unsigned                        slot    = t_mem_slot;
+            Env*                            globals = t_globals;
+            std::shared_ptr<const ScopeMap> remap   = t_remap;
+            Interpreter                     ctx;
+            Body(Interpreter& I, const ProcVal& pv, EnvPtr call_env, const std::string& label)
+                : table(I.builtin_table()), y(I.yield.link()), stack(I.call_stack), random(rng().next()),
+                  ctx{pv->body, 0, std::move(call_env), *table, {}, y, c, pv->def_file, stack} {
+                stack.push_back(label);
+                ctx.shared_builtins = table;
+            }
+        };
+        auto g = std::make_shared<ProcGenerator>();
+        auto body = std::make_shared<Body>(*this, pv, std::move(call_env), label);
+        body->ctx.gen = g.get();
+        g->body = [body] {
+            struct Use {
+                Rng*                            rng;
+                std::shared_ptr<const ScopeMap> remap;
+                explicit Use(Body& b) : rng(t_rng), remap(std::move(t_remap)) {
+                    t_rng = &b.random;
+                    t_remap = b.remap;
+                }
+                ~Use() {
+                    t_rng = rng;
+                    t_remap = std::move(remap);
+                }
+            };
+            MemScope     mem{body->slot};
+            GlobalsScope scope{body->globals};
+            Use          use{*body};
+            try {
+                body->ctx.run_block();
+            } catch (ReturnSignal&) {
+            }
+            if (!body->ctx.gen->suspended && body->c.tracked()) body->c.collect(true);
+        };
+        return g;
+    }
+    Value run_proc(const ProcVal& pv, std::vector<Value> args, const std::string& label) {
         if (call_stack.size() >= MAX_CALL_DEPTH)
             throw make_err("maximum recursion depth exceeded");
 
         call_stack.push_back(label);
-        EnvPtr call_env = std::make_shared<Env>(pv->closure ? pv->closure : env);
+        EnvPtr scope = pv->closure ? pv->closure : env;
+        if (t_remap) {
+            auto it = t_remap->find(scope.get());
+            if (it != t_remap->end()) scope = it->second;
+        }
+        EnvPtr call_env = std::make_shared<Env>(std::move(scope));
         for (size_t i = 0; i < args.size(); i++) call_env->vars[pv->params[i]] = args[i];
-        Interpreter sub{pv->body, 0, call_env, builtins, load_fn, yield_fn, pv->def_file, call_stack};
+        Interpreter sub{pv->body, 0, call_env, builtins, load_fn, yield, gc, pv->def_file, call_stack};
+        sub.code_cache = code_cache;
+        sub.shared_builtins = shared_builtins;
         Value result{NumVal{0.0}};
         try {
             sub.run_block();
@@ -777,6 +2876,246 @@ struct Interpreter {
         call_stack.pop_back();
         return result;
     }
+    // Parallel map behind pmap(). Chunks run on the shared pool, each in a
+    // context of its own (stack, collector, yield gate) charged to this
+    // environment's memory slot, with a random stream per element so
+    // seeded results do not depend on the chunking. The scopes the proc
+    // can see and the caller's globals are frozen meanwhile; each chunk's
+    // globals overlay the caller's, so every chunk (prelude procs
+    // included) reads them in place and keeps its writes private, as a
+    // fork does. Their arrays and maps are shared too, not copied: a chunk
+    // copies one only when it writes to it through a variable (NAME[i] =
+    // x, push(NAME, x), set(NAME, k, v)...). The error of the lowest
+    // failing element is rethrown once all chunks are done.
+    ArrayPtr par_map(const Value& coll, const ProcVal& f, size_t chunk) {
+        const NumVal* vec = std::get_if<NumVal>(&coll);
+        const Array*  arr = vec ? nullptr : std::get<ArrayPtr>(coll).get();
+        size_t n = vec ? vec->size() : arr->size();
+        std::vector<Value> out(n);
+        if (chunk == 0) chunk = std::max<size_t>(1, n / (4 * work_pool().size()));
+
+        std::vector<Env*> thawed;
+        auto freeze = [&thawed](Env* e) {
+            if (e && !e->frozen) {
+                e->frozen = true;
+                thawed.push_back(e);
+            }
+        };
+        for (Env* e = (f->closure ? f->closure : env).get(); e; e = e->parent.get()) freeze(e);
+        for (Env* g = t_globals; g && !g->sealed; g = g->parent.get()) freeze(g);
+        EnvPtr caller_globals{EnvPtr{}, t_globals};   // not owned: outlives the chunks
+        // the containers in those scopes, and the elements, are read in
+        // place by every chunk
+        std::vector<ShareMark*> marked;
+        std::function<void(const Value&)> mark = [&](const Value& v) {
+            if (auto* a = std::get_if<ArrayPtr>(&v)) {
+                if ((*a)->shared.on) return;
+                (*a)->shared.on = true;
+                marked.push_back(&(*a)->shared);
+                if (!(*a)->packed()) (*a)->each(mark);
+            } else if (auto* m = std::get_if<MapPtr>(&v)) {
+                if ((*m)->shared.on) return;
+                (*m)->shared.on = true;
+                marked.push_back(&(*m)->shared);
+                (*m)->each([&](const MapKey&, const Value& x) {
+                    mark(x);
+                });
+            }
+        };
+        for (Env* e : thawed)
+            for (auto& kv : e->vars) mark(kv.second);
+        if (arr) mark(coll);
+        struct Thaw {
+            std::vector<Env*>&      envs;
+            std::vector<ShareMark*>& marks;
+            ~Thaw() {
+                for (Env* e : envs) e->frozen = false;
+                for (ShareMark* m : marks) m->on = false;
+            }
+        } thaw{thawed, marked};
+
+        std::mutex          err_m;
+        Error               err;
+        std::atomic<size_t> err_at{SIZE_MAX};
+        unsigned            slot = t_mem_slot;
+        int                 line = cur_line();
+        YieldLink           gate = yield.link();
+        auto                table = builtin_table();
+        uint64_t            seed = rng().next();   // element i draws from stream seed + i
+        TaskGroup           group;
+        for (size_t lo = 0; lo < n; lo += chunk) {
+            size_t hi = std::min(n, lo + chunk);
+            group.run([&, lo, hi] {
+                MemScope     mem{slot};
+                RngScope     random{seed};
+                Env          scratch{caller_globals};
+                GlobalsScope globals{&scratch};
+                YieldGate    y{gate};
+                Collector    c;
+                std::vector<std::string> stack = call_stack;
+                Interpreter ctx{{Token{END, "", line}}, 0, env, builtins, {}, y, c, filename, stack};
+                ctx.shared_builtins = table;
+                auto fail = [&](size_t i, Error e) {
+                    std::lock_guard<std::mutex> lk(err_m);
+                    if (i < err_at.load()) {
+                        err = std::move(e);
+                        err_at = i;
+                    }
+                };
+                size_t i = lo;
+                try {
+                    for (; i < hi && i < err_at.load(); i++) {
+                        random.own.reseed(seed + i);
+                        out[i] = ctx.call_procval(f, {vec ? Value{NumVal{(*vec)[i]}} : arr->get(i)}, "pmap");
+                    }
+                } catch (Error& e) {
+                    fail(i, std::move(e));
+                } catch (std::exception& e) {
+                    fail(i, ctx.make_err(std::string("pmap: ") + e.what()));
+                } catch (...) {
+                    fail(i, ctx.make_err("pmap: unexpected control flow"));
+                }
+                if (c.tracked()) c.collect(true);
+            });
+        }
+        group.wait();
+        if (err_at.load() != SIZE_MAX) throw err;
+        return std::make_shared<Array>(std::move(out));
+    }
+
+    // Names a task running `todo` may look up: the identifiers and strings
+    // in the procs' bodies and, transitively, in the bodies of the procs
+    // these names hold, directly or inside arrays and maps.
+    std::unordered_set<std::string> reachable_names(std::vector<ProcVal> todo) {
+        std::unordered_set<std::string> names;
+        std::unordered_set<const void*> done;
+        std::function<void(const Value&)> procs_in = [&](const Value& v) {
+            if (auto* p = std::get_if<ProcVal>(&v)) {
+                if (!done.count(p->get())) todo.push_back(*p);
+            } else if (auto* a = std::get_if<ArrayPtr>(&v)) {
+                if (!(*a)->packed() && done.insert(a->get()).second) (*a)->each(procs_in);
+            } else if (auto* m = std::get_if<MapPtr>(&v)) {
+                if (done.insert(m->get()).second)
+                    (*m)->each([&](const MapKey&, const Value& x) { procs_in(x); });
+            }
+        };
+        while (!todo.empty()) {
+            ProcVal p = std::move(todo.back());
+            todo.pop_back();
+            if (!done.insert(p.get()).second) continue;
+            Env* from = p->closure ? p->closure.get() : env.get();
+            for (const Token& t : p->body) {
+                if (t.type != IDENT && t.type != STR) continue;
+                names.insert(t.val);
+                bool frozen = false;
+                if (Value* v = find_var_from(from, t.val, frozen)) procs_in(*v);
+            }
+        }
+        return names;
+    }
+    // Copies the scopes reachable from `from` up to the first sealed one,
+    // containers included, and records original -> copy in `remap`; only
+    // the variables in `names` are copied.
+    static void snapshot_scopes(Env* from, ScopeMap& remap, CopyMemo& seen,
+                                const std::unordered_set<std::string>& names) {
+        std::vector<Env*> chain;
+        for (Env* e = from; e && !e->sealed && !remap.count(e); e = e->parent.get()) chain.push_back(e);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            Env* e = *it;
+            EnvPtr parent = e->parent;
+            auto up = parent ? remap.find(parent.get()) : remap.end();
+            auto c = std::make_shared<Env>(up != remap.end() ? up->second : parent);
+            c->gc_tracked = true;
+            for (auto& [k, v] : e->vars)
+                if (names.count(k)) c->vars.emplace(k, deep_copy(v, seen));
+            remap[e] = c;
+        }
+    }
+    // spawn(): runs a proc (or a builtin, by name) on the shared pool and
+    // returns its future. The task works on a snapshot, taken now, of the
+    // variables the proc (and any proc among the arguments) can reach, so
+    // the caller can go on changing its variables; preludes are read in
+    // place, and a builtin given no procs needs no snapshot at all. Like
+    // pmap chunks, the task has its own context charged to this
+    // environment.
+    NativePtr spawn_task(const Value& what, std::vector<Value> args) {
+        ProcVal     proc;
+        std::string name;
+        if (auto* p = std::get_if<ProcVal>(&what)) {
+            proc = *p;
+        } else if (auto* s = std::get_if<std::string>(&what)) {
+            name = *s;
+            bool frozen = false;
+            Value* v = find_var(name, frozen);
+            if (v && std::holds_alternative<ProcVal>(*v)) proc = std::get<ProcVal>(*v);
+        } else {
+            throw make_err("spawn: first argument must be a proc or a builtin name");
+        }
+        std::vector<ProcVal> roots;
+        if (proc) roots.push_back(proc);
+        for (auto& x : args)
+            if (auto* p = std::get_if<ProcVal>(&x)) roots.push_back(*p);
+        auto     remap = std::make_shared<ScopeMap>();
+        CopyMemo seen;
+        EnvPtr   start = std::make_shared<Env>(), globals;
+        if (!roots.empty()) {
+            auto names = reachable_names(roots);
+            snapshot_scopes(scope_of(env.get()), *remap, seen, names);
+            for (auto& p : roots)
+                if (p->closure) snapshot_scopes(scope_of(p->closure.get()), *remap, seen, names);
+            Env* root = scope_of(env.get());
+            while (root->parent && !root->parent->sealed) root = root->parent.get();
+            start   = remap->count(scope_of(env.get())) ? remap->at(scope_of(env.get())) : env;
+            globals = remap->count(root) ? remap->at(root) : nullptr;
+        }
+        for (auto& x : args) x = deep_copy(x, seen);
+
+        auto fut   = std::make_shared<Future>();
+        auto table = builtin_table();
+        std::string label = proc ? (name.empty() ? "spawn" : name) : name;
+        work_pool().submit([fut, table, remap, start, globals, proc, name, label, args,
+                                 slot = t_mem_slot, file = filename, stack = call_stack, line = cur_line(),
+                                 seed = rng().next(), gate = yield.link()]() mutable {
+            MemScope     mem{slot};
+            RngScope     random{seed};
+            GlobalsScope scope{globals.get()};
+            auto prev = std::move(t_remap);
+            t_remap = remap;
+            YieldGate    y{gate};
+            Collector    c;
+            Interpreter  ctx{{Token{END, "", line}}, 0, start, *table, {}, y, c, file, stack};
+            ctx.shared_builtins = table;
+            Value        result;
+            std::unique_ptr<Error> err;
+            try {
+                result = proc ? ctx.call_procval(proc, std::move(args), label) : ctx.call_builtin(name, args);
+            } catch (Error& e) {
+                err = std::make_unique<Error>(std::move(e));
+            } catch (std::exception& e) {
+                err = std::make_unique<Error>(ctx.make_err(label + ": " + e.what()));
+            } catch (...) {
+                err = std::make_unique<Error>(ctx.make_err(label + ": unexpected control flow"));
+            }
+            if (c.tracked()) c.collect(true);
+            t_remap = std::move(prev);
+            fut->finish(std::move(result), std::move(err));
+        });
+        return fut;
+    }
+    Value await_future(const Value& v, const std::string& fn) {
+        auto* f = native_cast<Future>(v);
+        if (!f) throw make_err(fn + ": argument must be a future");
+        while (!f->done.load()) {
+            maybe_yield(YIELD_BLOCK_COST);
+            if (work_pool().run_one()) continue;
+            std::unique_lock<std::mutex> lk(f->m);
+            f->cv.wait_for(lk, std::chrono::milliseconds(1), [f] { return f->done.load(); });
+        }
+        std::lock_guard<std::mutex> lk(f->m);
+        if (f->error) throw *f->error;
+        return f->result;
+    }
+
     Value call_builtin(const std::string& nm, std::vector<Value>& a) {
         auto it = builtins.find(nm);
         if (it != builtins.end()) return it->second(a, *this);
@@ -801,6 +3140,11 @@ struct Interpreter {
             if (!std::holds_alternative<ArrayPtr>(a[i]))
                 throw make_err(fn + ": argument must be an array");
         };
+        auto mp = [&](int i, const std::string& fn) -> Map& {
+            if (!std::holds_alternative<MapPtr>(a[i]))
+                throw make_err(fn + ": argument must be a map");
+            return *std::get<MapPtr>(a[i]);
+        };
 
         if (nm=="floor") {
             chk(1);
@@ -894,12 +3238,13 @@ struct Interpreter {
         if (nm=="to_vec") {
             chk(1);
             chk_arr(0, "to_vec");
-            const auto& el = ap(0)->elems;
+            const Array& el = *ap(0);
+            if (el.packed()) return NumVal(el.nums().data(), el.size());
             NumVal r(el.size());
             for (size_t i = 0; i < el.size(); i++) {
-                if (!std::holds_alternative<NumVal>(el[i]))
+                if (!std::holds_alternative<NumVal>(el.at(i)))
                     throw make_err("to_vec: all array elements must be numbers");
-                r[i] = nv_scalar(std::get<NumVal>(el[i]));
+                r[i] = nv_scalar(std::get<NumVal>(el.at(i)));
             }
             return r;
         }
@@ -908,15 +3253,14 @@ struct Interpreter {
             if (!std::holds_alternative<NumVal>(a[0]))
                 throw make_err("to_arr: argument must be a vector");
             const NumVal& v = std::get<NumVal>(a[0]);
-            auto r = std::make_shared<Array>();
-            r->elems.reserve(v.size());
-            for (size_t i = 0; i < v.size(); i++) r->elems.push_back(NumVal{v[i]});
-            return r;
+            return std::make_shared<Array>(std::vector<double>(std::begin(v), std::end(v)));
         }
         if (nm=="len") {
             chk(1);
-            if (std::holds_alternative<ArrayPtr>(a[0])) return NumVal{(double)ap(0)->elems.size()};
+            if (std::holds_alternative<ArrayPtr>(a[0])) return NumVal{(double)ap(0)->size()};
             if (std::holds_alternative<NumVal>(a[0]))   return NumVal{(double)std::get<NumVal>(a[0]).size()};
+            if (std::holds_alternative<MapPtr>(a[0]))   return NumVal{(double)std::get<MapPtr>(a[0])->size()};
+            if (auto* sb = native_cast<StringBuilder>(a[0])) return NumVal{(double)sb->buf.size()};
             return NumVal{(double)sv(0).size()};
         }
 
@@ -969,6 +3313,9 @@ struct Interpreter {
             }
             if (std::holds_alternative<std::string>(a[0])) return std::string{"string"};
             if (std::holds_alternative<ProcVal>(a[0]))     return std::string{"proc"};
+            if (std::holds_alternative<MapPtr>(a[0]))      return std::string{"map"};
+            if (std::holds_alternative<NativePtr>(a[0]))
+                return std::string{std::get<NativePtr>(a[0])->type_name()};
             return std::string{"array"};
         }
 
@@ -977,70 +3324,137 @@ struct Interpreter {
             if (a.empty()) return a_;
             int n = (int)d(0);
             Value fill = a.size() >= 2 ? a[1] : Value{NumVal{0.0}};
-            a_->elems.resize(n, fill);
+            a_->resize(n, fill);
             return a_;
         }
         if (nm=="push") {
             if (a.size() < 2) throw make_err("push: needs array and value");
             chk_arr(0, "push");
-            for (size_t i = 1; i < a.size(); i++) ap(0)->elems.push_back(a[i]);
+            writable(a[0], "push");
+            for (size_t i = 1; i < a.size(); i++) ap(0)->push(a[i]);
             return a[0];
         }
         if (nm=="pop") {
             chk(1);
             chk_arr(0, "pop");
-            if (ap(0)->elems.empty()) throw make_err("pop: empty array");
-            Value v = ap(0)->elems.back();
-            ap(0)->elems.pop_back();
+            writable(a[0], "pop");
+            if (ap(0)->empty()) throw make_err("pop: empty array");
+            Value v = ap(0)->get(ap(0)->size() - 1);
+            ap(0)->pop_back();
             return v;
         }
         if (nm=="insert") {
             if (a.size() != 3) throw make_err("insert: needs 3 args");
             chk_arr(0, "insert");
+            writable(a[0], "insert");
             int i = (int)d(1);
-            if (i < 0 || i > (int)ap(0)->elems.size()) throw make_err("insert: index out of bounds");
-            ap(0)->elems.insert(ap(0)->elems.begin() + i, a[2]);
+            if (i < 0 || i > (int)ap(0)->size()) throw make_err("insert: index out of bounds");
+            ap(0)->insert(i, a[2]);
             return a[0];
         }
         if (nm=="remove") {
             chk(2);
             chk_arr(0, "remove");
+            writable(a[0], "remove");
             int i = (int)d(1);
-            if (i < 0) i += (int)ap(0)->elems.size();
-            if (i < 0 || i >= (int)ap(0)->elems.size()) throw make_err("remove: index out of bounds");
-            Value v = ap(0)->elems[i];
-            ap(0)->elems.erase(ap(0)->elems.begin() + i);
+            if (i < 0) i += (int)ap(0)->size();
+            if (i < 0 || i >= (int)ap(0)->size()) throw make_err("remove: index out of bounds");
+            Value v = ap(0)->get(i);
+            ap(0)->erase(i);
             return v;
         }
         if (nm=="slice") {
             chk(3);
             chk_arr(0, "slice");
-            int lo=(int)d(1), hi=(int)d(2), sz=(int)ap(0)->elems.size();
+            int lo=(int)d(1), hi=(int)d(2), sz=(int)ap(0)->size();
             if (lo<0) lo=0;
             if (hi>sz) hi=sz;
             auto r = std::make_shared<Array>();
-            if (lo < hi) r->elems.assign(ap(0)->elems.begin()+lo, ap(0)->elems.begin()+hi);
+            if (lo < hi) r->append(*ap(0), lo, hi);
             return r;
         }
         if (nm=="concat") {
             chk(2);
             chk_arr(0, "concat");
             chk_arr(1, "concat");
-            auto r = std::make_shared<Array>(Array{ap(0)->elems});
-            r->elems.insert(r->elems.end(), ap(1)->elems.begin(), ap(1)->elems.end());
+            auto r = std::make_shared<Array>(*ap(0));
+            r->append(*ap(1));
             return r;
         }
         if (nm=="join") {
             chk(2);
             chk_arr(0, "join");
             std::string sep = sv(1), out;
-            const auto& el = ap(0)->elems;
-            for (size_t i = 0; i < el.size(); i++) {
-                if(i) out+=sep;
-                out+=to_str(el[i]);
+            size_t i = 0;
+            ap(0)->each([&](const Value& x) {
+                if(i++) out+=sep;
+                to_str_into(out, x);
+            });
+            return out;
+        }
+        // sb_new([s]) / sb_add(sb, x...) / sb_str(sb): linear-time string building
+        if (nm=="sb_new") {
+            if (a.size() > 1) throw make_err("sb_new: 0 or 1 args");
+            auto sb = std::make_shared<StringBuilder>();
+            if (a.size() == 1) to_str_into(sb->buf, a[0]);
+            return NativePtr{sb};
+        }
+        if (nm=="sb_add") {
+            if (a.empty()) throw make_err("sb_add: needs a string builder");
+            auto* sb = native_cast<StringBuilder>(a[0]);
+            if (!sb) throw make_err("sb_add: first argument must be a string builder");
+            for (size_t i = 1; i < a.size(); i++) to_str_into(sb->buf, a[i]);
+            if (sb->mem.bytes != sb->buf.capacity()) {
+                sb->mem.release();
+                sb->mem.charge(sb->buf.capacity());
+            }
+            return a[0];
+        }
+        if (nm=="sb_str") {
+            chk(1);
+            auto* sb = native_cast<StringBuilder>(a[0]);
+            if (!sb) throw make_err("sb_str: argument must be a string builder");
+            return sb->buf;
+        }
+        if (nm=="replace") {
+            chk(3);
+            const std::string& s = sv(0);
+            const std::string& from = sv(1);
+            const std::string& to = sv(2);
+            if (from.empty()) return s;
+            std::string out;
+            out.reserve(s.size());
+            size_t p = 0;
+            for (size_t q; (q = s.find(from, p)) != std::string::npos; p = q + from.size()) {
+                out.append(s, p, q - p);
+                out += to;
             }
+            out.append(s, p, std::string::npos);
+            return out;
+        }
+        if (nm=="str_repeat") {
+            chk(2);
+            const std::string& s = sv(0);
+            long n = (long)d(1);
+            std::string out;
+            if (n <= 0 || s.empty()) return out;
+            out.reserve(mem_check(t_mem_slot, s.size() * (size_t)n));
+            for (long i = 0; i < n; i++) out += s;
             return out;
         }
+        // pad(s, w [, fill]): pad to |w| chars; w > 0 pads on the left
+        // (right-aligns), w < 0 pads on the right. fill defaults to " ".
+        if (nm=="pad") {
+            if (a.size() < 2 || a.size() > 3) throw make_err("pad: 2 or 3 args (s, width [, fill])");
+            std::string s = to_str(a[0]);
+            long w = (long)d(1);
+            std::string fill = a.size() == 3 ? sv(2) : std::string{" "};
+            size_t width = (size_t)std::labs(w);
+            if (fill.empty() || s.size() >= width) return s;
+            std::string padding(width - s.size(), ' ');
+            for (size_t i = 0; i < padding.size(); i++) padding[i] = fill[i % fill.size()];
+            return w > 0 ? padding + s : s + padding;
+        }
         if (nm=="split") {
             chk(2);
             std::string s=sv(0), delim=sv(1);
@@ -1049,40 +3463,100 @@ struct Interpreter {
             while (true) {
                 size_t p = s.find(delim);
                 if (p == std::string::npos) {
-                    r->elems.push_back(s);
+                    r->push(s);
                     break;
                 }
-                r->elems.push_back(s.substr(0, p));
+                r->push(s.substr(0, p));
                 s = s.substr(p + dlen);
             }
             return r;
         }
         if (nm=="copy") {
             chk(1);
+            if (std::holds_alternative<MapPtr>(a[0]))
+                return std::make_shared<Map>(*std::get<MapPtr>(a[0]));
             chk_arr(0, "copy");
-            return std::make_shared<Array>(Array{ap(0)->elems});
+            return std::make_shared<Array>(*ap(0));
         }
         if (nm=="range") {
             if (a.size() < 2 || a.size() > 3) throw make_err("range: needs 2 or 3 args");
             double lo=d(0), hi=d(1), step = a.size()==3 ? d(2) : 1.0;
             if (step == 0) throw make_err("range: step cannot be 0");
             auto r = std::make_shared<Array>();
-            for (double x = lo; step>0 ? x<hi : x>hi; x += step) r->elems.push_back(NumVal{x});
+            for (double x = lo; step>0 ? x<hi : x>hi; x += step) r->push_num(x);
             return r;
         }
         if (nm=="shuffle") {
             chk(1);
             chk_arr(0, "shuffle");
-            auto r = std::make_shared<Array>(Array{ap(0)->elems});
-            auto& el = r->elems;
-            if (!el.empty()) {
-                for (size_t i = el.size()-1; i > 0; i--) {
-                    size_t j = (size_t)std::rand() % (i + 1);
-                    std::swap(el[i], el[j]);
+            auto r = std::make_shared<Array>(*ap(0));
+            if (!r->empty()) {
+                for (size_t i = r->size()-1; i > 0; i--) {
+                    size_t j = (size_t)rng().below(i + 1);
+                    r->swap_elems(i, j);
                 }
             }
             return r;
         }
+        // sort(x)          -> ascending copy of a vector, or of an array of
+        //                     numbers or of strings (stable)
+        // sort_by(x, key)  -> stable sort by key(elem), key called once each
+        // argsort(x)       -> vector of indices that would sort x
+        if (nm=="sort") {
+            chk(1);
+            if (std::holds_alternative<NumVal>(a[0])) {
+                NumVal r = std::get<NumVal>(a[0]);
+                par_stable_sort(std::begin(r), r.size(), num_less);
+                return r;
+            }
+            chk_arr(0, "sort");
+            return permuted(*ap(0), sort_order(ap(0)->values(), "sort"));
+        }
+        if (nm=="sort_by") {
+            chk(2);
+            if (!std::holds_alternative<ProcVal>(a[1]))
+                throw make_err("sort_by: second argument must be a proc");
+            const ProcVal& f = std::get<ProcVal>(a[1]);
+            std::vector<Value> ks;
+            if (std::holds_alternative<NumVal>(a[0])) {
+                const NumVal& v = std::get<NumVal>(a[0]);
+                ks.reserve(v.size());
+                for (size_t i = 0; i < v.size(); i++) ks.push_back(call_procval(f, {NumVal{v[i]}}));
+                std::vector<size_t> order = sort_order(ks, "sort_by");
+                NumVal r(order.size());
+                for (size_t i = 0; i < order.size(); i++) r[i] = v[order[i]];
+                return r;
+            }
+            chk_arr(0, "sort_by");
+            ArrayPtr src = ap(0);
+            ks.reserve(src->size());
+            for (size_t i = 0; i < src->size(); i++) ks.push_back(call_procval(f, {src->get(i)}));
+            return permuted(*src, sort_order(ks, "sort_by"));
+        }
+        if (nm=="argsort") {
+            chk(1);
+            std::vector<size_t> order;
+            if (std::holds_alternative<NumVal>(a[0])) {
+                const NumVal& v = std::get<NumVal>(a[0]);
+                order.resize(v.size());
+                for (size_t i = 0; i < order.size(); i++) order[i] = i;
+                par_stable_sort(order.data(), order.size(),
+                                [&v](size_t x, size_t y) { return num_less(v[x], v[y]); });
+            } else {
+                chk_arr(0, "argsort");
+                order = sort_order(ap(0)->values(), "argsort");
+            }
+            NumVal r(order.size());
+            for (size_t i = 0; i < order.size(); i++) r[i] = (double)order[i];
+            return r;
+        }
+        if (nm=="keys" && a.size() == 1) {
+            auto r = std::make_shared<Array>();
+            mp(0, "keys").each([&](const MapKey& k, const Value&) {
+                r->push(map_key_value(k));
+            });
+            return r;
+        }
         if (nm=="keys") {
             chk(0);
             auto r = std::make_shared<Array>();
@@ -1090,12 +3564,129 @@ struct Interpreter {
             for (EnvPtr e = env; e; e = e->parent) {
                 for (auto& [k, _] : e->vars) if (!seen[k]) {
                         seen[k] = true;
-                        r->elems.push_back(k);
+                        r->push(k);
                     }
             }
             return r;
         }
 
+        // map()                  -> empty map
+        // map(k1, v1, k2, v2...) -> map built from key/value pairs
+        // map(coll, proc) -> array of proc(x) for each x a for-in over coll
+        // visits (vector elements, array elements, map keys, characters,
+        // generator items); map(k1, v1, ...) -> a new map
+        if (nm=="map") {
+            if (a.size() == 2 && std::holds_alternative<ProcVal>(a[1])) {
+                auto r = std::make_shared<Array>();
+                const ProcVal& f = std::get<ProcVal>(a[1]);
+                if (std::holds_alternative<NumVal>(a[0])) {
+                    const NumVal& v = std::get<NumVal>(a[0]);
+                    r->reserve(v.size());
+                    for (size_t i = 0; i < v.size(); i++)
+                        r->push(call_procval(f, {NumVal{v[i]}}));
+                } else if (std::holds_alternative<ArrayPtr>(a[0])) {
+                    ArrayPtr src = ap(0);
+                    r->reserve(src->size());
+                    for (size_t i = 0; i < src->size(); i++)
+                        r->push(call_procval(f, {src->get(i)}));
+                } else if (std::holds_alternative<std::string>(a[0])) {
+                    const std::string& str = sv(0);
+                    r->reserve(str.size());
+                    for (char ch : str) r->push(call_procval(f, {std::string(1, ch)}));
+                } else if (std::holds_alternative<MapPtr>(a[0])) {
+                    std::vector<Value> ks;
+                    std::get<MapPtr>(a[0])->each([&](const MapKey& k, const Value&) {
+                        ks.push_back(map_key_value(k));
+                    });
+                    for (auto& k : ks) r->push(call_procval(f, {k}));
+                } else if (auto* g = native_cast<Generator>(a[0])) {
+                    NativePtr keep = std::get<NativePtr>(a[0]);
+                    Value item;
+                    while (g->pull(item, *this)) r->push(call_procval(f, {std::move(item)}));
+                } else {
+                    throw make_err("map: first argument must be a number, array, map, string or generator");
+                }
+                return r;
+            }
+            if (a.size() % 2 != 0) throw make_err("map: expected key/value pairs");
+            auto m = std::make_shared<Map>();
+            for (size_t i = 0; i < a.size(); i += 2) m->set(map_key(a[i], "map"), a[i+1]);
+            return m;
+        }
+        // pmap(coll, proc [, chunk]) -> map(coll, proc) evaluated in parallel,
+        // `chunk` elements per task (default: about 4 tasks per thread).
+        // proc should be pure: writes to outer variables are not seen after.
+        if (nm=="pmap") {
+            if (a.size() != 2 && a.size() != 3) throw make_err("pmap: 2 or 3 args (coll, proc [, chunk])");
+            if (!std::holds_alternative<ProcVal>(a[1])) throw make_err("pmap: second argument must be a proc");
+            if (!std::holds_alternative<NumVal>(a[0])) chk_arr(0, "pmap");
+            double chunk = a.size() == 3 ? d(2) : 0.0;
+            if (chunk < 0) throw make_err("pmap: chunk must be positive");
+            return par_map(a[0], std::get<ProcVal>(a[1]), (size_t)chunk);
+        }
+        // spawn(proc, args...) -> future; spawn("fft", x) runs a builtin.
+        // await(f) -> result of the task, rethrowing its error;
+        // await_all(arr) -> array of results, in order.
+        if (nm=="spawn") {
+            if (a.empty()) throw make_err("spawn: needs a proc and its args");
+            return spawn_task(a[0], std::vector<Value>(a.begin() + 1, a.end()));
+        }
+        // next(gen [, default]) -> next item of a generator; once it is
+        // exhausted, default (or an error without one).
+        if (nm=="next") {
+            if (a.size() != 1 && a.size() != 2) throw make_err("next: 1 or 2 args (generator [, default])");
+            auto* g = native_cast<Generator>(a[0]);
+            if (!g) throw make_err("next: argument must be a generator");
+            Value item;
+            if (g->pull(item, *this)) return item;
+            if (a.size() == 2) return a[1];
+            throw make_err("next: generator exhausted");
+        }
+        if (nm=="await") {
+            chk(1);
+            return await_future(a[0], "await");
+        }
+        if (nm=="await_all") {
+            chk(1);
+            chk_arr(0, "await_all");
+            std::vector<Value> r;
+            r.reserve(ap(0)->size());
+            ap(0)->each([&](const Value& x) {
+                r.push_back(await_future(x, "await_all"));
+            });
+            return std::make_shared<Array>(std::move(r));
+        }
+        if (nm=="get") {
+            if (a.size() != 2 && a.size() != 3) throw make_err("get: 2 or 3 args (map, key [, default])");
+            Value* v = mp(0, "get").find(map_key(a[1], "get"));
+            if (v) return *v;
+            if (a.size() == 3) return a[2];
+            throw make_err("get: key '" + to_str(a[1]) + "' not found");
+        }
+        if (nm=="set") {
+            chk(3);
+            writable(a[0], "set");
+            mp(0, "set").set(map_key(a[1], "set"), a[2]);
+            return a[0];
+        }
+        if (nm=="has") {
+            chk(2);
+            return NumVal{mp(0, "has").find(map_key(a[1], "has")) ? 1.0 : 0.0};
+        }
+        if (nm=="del") {
+            chk(2);
+            writable(a[0], "del");
+            return NumVal{mp(0, "del").erase(map_key(a[1], "del")) ? 1.0 : 0.0};
+        }
+        if (nm=="values") {
+            chk(1);
+            auto r = std::make_shared<Array>();
+            mp(0, "values").each([&](const MapKey&, const Value& v) {
+                r->push(v);
+            });
+            return r;
+        }
+
         if (nm=="read") {
             chk(1);
             std::string path = resolve_path(sv(0));
@@ -1156,7 +3747,7 @@ struct Interpreter {
         if (nm=="apply") {
             if (a.size() != 2) throw make_err("apply: needs 2 args (proc or name, array)");
             chk_arr(1, "apply");
-            std::vector<Value> args = ap(1)->elems;
+            std::vector<Value> args = ap(1)->values();
             if (std::holds_alternative<ProcVal>(a[0]))
                 return call_procval(std::get<ProcVal>(a[0]), args);
             std::string proc_name = sv(0);
@@ -1165,6 +3756,31 @@ struct Interpreter {
                 return call_procval(std::get<ProcVal>(*vp), args, proc_name);
             return call_builtin(proc_name, args);
         }
+        // gc() runs a full cycle collection and returns the objects freed.
+        // memstats(): live/peak/limit bytes of this environment plus the
+        // collector and code cache counters, as a map.
+        if (nm=="gc") {
+            chk(0);
+            return NumVal{(double)gc.collect(true)};
+        }
+        if (nm=="memstats") {
+            chk(0);
+            mem_flush();
+            const MemSlot& ms = g_mem_slots[t_mem_slot];
+            auto m = std::make_shared<Map>();
+            m->set(MapKey{false, 0, "live_bytes"},     NumVal{(double)ms.live.load()});
+            m->set(MapKey{false, 0, "peak_bytes"},     NumVal{(double)ms.peak.load()});
+            m->set(MapKey{false, 0, "limit_bytes"},    NumVal{(double)ms.limit.load()});
+            m->set(MapKey{false, 0, "gc_collections"}, NumVal{(double)gc.collections});
+            m->set(MapKey{false, 0, "gc_freed"},       NumVal{(double)gc.freed});
+            m->set(MapKey{false, 0, "gc_tracked"},     NumVal{(double)gc.tracked()});
+            if (code_cache) {
+                m->set(MapKey{false, 0, "code_cache_hits"},    NumVal{(double)code_cache->hits});
+                m->set(MapKey{false, 0, "code_cache_misses"},  NumVal{(double)code_cache->misses});
+                m->set(MapKey{false, 0, "code_cache_entries"}, NumVal{(double)code_cache->lru.size()});
+            }
+            return m;
+        }
         if (nm=="exit")  {
             chk(1);
             std::exit((int)d(0));
@@ -1233,6 +3849,20 @@ struct Interpreter {
                 if (op==NEQ) return NumVal{!eq ? 1.0 : 0.0};
                 throw make_err("procs only support == and !=");
             }
+            if (std::holds_alternative<MapPtr>(l) || std::holds_alternative<MapPtr>(r)) {
+                bool eq = values_equal(l, r);
+                if (op==EQ)  return NumVal{eq ? 1.0 : 0.0};
+                if (op==NEQ) return NumVal{!eq ? 1.0 : 0.0};
+                throw make_err("maps only support == and !=");
+            }
+            if (std::holds_alternative<NativePtr>(l) || std::holds_alternative<NativePtr>(r)) {
+                bool eq = values_equal(l, r);
+                if (op==EQ)  return NumVal{eq ? 1.0 : 0.0};
+                if (op==NEQ) return NumVal{!eq ? 1.0 : 0.0};
+                throw make_err(std::string{"type '"} + (std::holds_alternative<NativePtr>(l)
+                               ? std::get<NativePtr>(l) : std::get<NativePtr>(r))->type_name()
+                               + "' only supports == and !=");
+            }
             return nv_cmp(std::get<NumVal>(l), std::get<NumVal>(r), op);
         }
         return l;
@@ -1251,6 +3881,7 @@ struct Interpreter {
                 }
                 std::string ls = to_str(l);
                 std::string rs = to_str(r);
+                mem_check(t_mem_slot, ls.size() + rs.size());
                 l = ls + rs;
                 continue;
             }
@@ -1311,30 +3942,52 @@ struct Interpreter {
         }
         return index_expr();
     }
+    Value subscript(const Value& v, const Value& idx) {
+        if (std::holds_alternative<NumVal>(v)) {
+            const NumVal& n = std::get<NumVal>(v);
+            int i = (int)nv_scalar(std::get<NumVal>(idx));
+            if (i < 0) i += (int)n.size();
+            if (i < 0 || i >= (int)n.size())
+                throw make_err("index " + std::to_string(i) + " out of bounds");
+            return NumVal{n[i]};
+        } else if (std::holds_alternative<ArrayPtr>(v)) {
+            auto& ap = std::get<ArrayPtr>(v);
+            int i = (int)nv_scalar(std::get<NumVal>(idx));
+            if (i < 0) i += (int)ap->size();
+            if (i < 0 || i >= (int)ap->size())
+                throw make_err("index " + std::to_string(i) + " out of bounds");
+            return ap->get(i);
+        } else if (std::holds_alternative<MapPtr>(v)) {
+            Value* x = std::get<MapPtr>(v)->find(map_key(idx, "index"));
+            if (!x) throw make_err("key '" + to_str(idx) + "' not found");
+            return *x;
+        }
+        throw make_err("subscript on non-indexable value");
+    }
+    // Indexing a container in a prelude reads it in place: only the
+    // element is copied, rather than unsharing the whole container as a
+    // plain read of the name does.
+    bool shared_subscript(Value& out) {
+        if (!check(IDENT) || T[pos+1].type != LBRACKET) return false;
+        bool frozen = false, sealed = false;
+        Value* v = find_var(T[pos].val, frozen, &sealed);
+        if (!v || !sealed || std::holds_alternative<NumVal>(*v)) return false;
+        consume();
+        consume();
+        Value idx = expr();
+        expect(RBRACKET);
+        out = deep_copy(subscript(*v, idx));
+        return true;
+    }
     Value index_expr() {
-        Value v = atom();
+        Value v;
+        if (!shared_subscript(v)) v = atom();
         while (check(LBRACKET) || (check(LPAREN) && std::holds_alternative<ProcVal>(v))) {
             if (check(LBRACKET)) {
                 consume();
                 Value idx = expr();
                 expect(RBRACKET);
-                if (std::holds_alternative<NumVal>(v)) {
-                    const NumVal& n = std::get<NumVal>(v);
-                    int i = (int)nv_scalar(std::get<NumVal>(idx));
-                    if (i < 0) i += (int)n.size();
-                    if (i < 0 || i >= (int)n.size())
-                        throw make_err("index " + std::to_string(i) + " out of bounds");
-                    v = NumVal{n[i]};
-                } else if (std::holds_alternative<ArrayPtr>(v)) {
-                    auto& ap = std::get<ArrayPtr>(v);
-                    int i = (int)nv_scalar(std::get<NumVal>(idx));
-                    if (i < 0) i += (int)ap->elems.size();
-                    if (i < 0 || i >= (int)ap->elems.size())
-                        throw make_err("index " + std::to_string(i) + " out of bounds");
-                    v = ap->elems[i];
-                } else {
-                    throw make_err("subscript on non-indexable value");
-                }
+                v = subscript(v, idx);
             } else {
                 consume();
                 std::vector<Value> args;
@@ -1376,14 +4029,17 @@ struct Interpreter {
                 body.push_back(consume());
             }
             body.push_back({END, ""});
-            return std::make_shared<Proc>(Proc{std::move(params), std::move(body), filename, env});
+            auto pv = std::make_shared<Proc>(Proc{std::move(params), std::move(body), filename, env});
+            pv->generator = body_yields(pv->body);
+            gc.track(env);
+            return pv;
         }
 
         if (check(LBRACKET)) {
             consume();
             auto arr = std::make_shared<Array>();
             while (!check(RBRACKET)) {
-                arr->elems.push_back(expr());
+                arr->push(expr());
                 if (!check(RBRACKET)) expect(COMMA);
             }
             expect(RBRACKET);
@@ -1394,6 +4050,12 @@ struct Interpreter {
             std::string n = consume().val;
             if (check(LPAREN)) {
                 consume();
+                if (check(IDENT) && mutator(n)) {
+                    // push(NAME, ...), set(NAME[i], ...): the container is
+                    // written, so it is unshared like NAME[i] = x would be
+                    TK next = T[pos+1].type;
+                    if (next == COMMA || next == RPAREN || next == LBRACKET) get_var_ptr(T[pos].val, true);
+                }
                 std::vector<Value> args;
                 while (!check(RPAREN)) {
                     args.push_back(expr());
@@ -1415,30 +4077,200 @@ struct Interpreter {
 };
 
 
+inline bool ProcGenerator::pull(Value& out, Interpreter& I) {
+    if (owner.load() == std::this_thread::get_id()) throw I.make_err("generator is already running");
+    std::lock_guard<std::mutex> lk(m);
+    if (finished) return false;
+    struct Own {
+        std::atomic<std::thread::id>& id;
+        explicit Own(std::atomic<std::thread::id>& o) : id(o) {
+            id = std::this_thread::get_id();
+        }
+        ~Own() {
+            id = std::thread::id();
+        }
+    } own{owner};
+    resuming = started;
+    started = true;
+    suspended = false;
+    try {
+        body();
+    } catch (Error&) {
+        finish();
+        throw;
+    } catch (std::exception& e) {
+        finish();
+        throw Error{"generator", -1, e.what(), {}};
+    } catch (...) {
+        finish();
+        throw Error{"generator", -1, "unexpected control flow", {}};
+    }
+    if (!suspended) {
+        finish();
+        return false;
+    }
+    out = std::move(item);
+    return true;
+}
+
 static inline void sig_yield(Interpreter& I) {
-    I.maybe_yield();
+    I.maybe_yield(YIELD_BLOCK_COST);
 }
+// Threading. An Environment and everything it owns (globals, builtins,
+// call stack, collector, memory slot) is confined to the thread running
+// exec(); only request_yield() may be called from elsewhere. Distinct
+// environments share no interpreter state and may run concurrently on
+// different threads.
+//
+// To host many jobs, load the libraries once into an environment, freeze()
+// it and fork() one environment per job. A fork reads the prelude's
+// globals in place; assignments land in the fork's own globals, and arrays
+// and maps are deep-copied into them on first access, so forks never write
+// shared storage. Prelude procs resolve globals through the calling fork.
+// Process-wide resources stay shared: standard streams, the working
+// directory and the realtime audio device (serialized by rtsound).
 struct Environment {
     void register_builtin(const std::string& name, Builtin fn) {
         builtins[name] = std::move(fn);
+        builtin_table.reset();
     }
     void set_yield(YieldFn fn) {
-        yield_fn = std::move(fn);
+        yield.fn = std::move(fn);
+    }
+    // Thread-safe: asks the running interpreter to call the yield hook
+    // at its next tick instead of waiting for the budget to run out.
+    void request_yield() {
+        yield.request();
+    }
+    // Number of compiled sources kept for repeated exec()/eval() of the
+    // same text (0 disables the cache).
+    void set_code_cache(std::size_t entries) {
+        code_cache.capacity = entries;
+        code_cache.trim();
+    }
+    // Caps the bytes this environment may hold live (0 = no limit). Going
+    // over raises a normal Error at the allocating statement. Only
+    // MEM_SLOTS - 1 environments can be accounted at once; past that a
+    // limit is refused rather than applied to the shared slot.
+    void set_mem_limit(std::size_t bytes) {
+        if (bytes && !mem.slot)
+            throw Error{"system", -1, "set_mem_limit: too many environments to account memory for", {}};
+        g_mem_slots[mem.slot].limit.store((int64_t)bytes);
+    }
+    // Makes the current globals a read-only prelude for fork(). Load the
+    // libraries and register builtins first; a frozen environment no longer
+    // runs scripts itself.
+    void freeze() {
+        global->frozen = true;
+        global->sealed = true;
+    }
+    // A fresh environment over a frozen prelude: builtins, search paths and
+    // the memory limit are copied, globals start empty and fall through to
+    // the prelude. Cost is one map copy, independent of the prelude size.
+    Environment fork() const {
+        if (!global->frozen) throw Error{"system", -1, "fork: environment is not frozen", {}};
+        Environment e;
+        e.global->parent = global;
+        e.global->gc_tracked = true;   // a root, never a collection candidate
+        e.builtins = builtins;
+        e.builtin_table = builtin_table;
+        e.paths = paths;
+        e.resident = resident;
+        e.optimize = optimize;
+        e.code_cache.capacity = code_cache.capacity;
+        e.set_mem_limit((std::size_t)g_mem_slots[mem.slot].limit.load());
+        return e;
     }
     void exec(const std::string& src, const std::string& filename = "<stdin>") {
-        auto toks = lex(src, filename);
-        Interpreter interp{std::move(toks), 0, global, builtins, {}, yield_fn, filename, call_stack};
+        if (global->frozen) throw Error{filename, 0, "environment is frozen; run scripts in a fork()", {}};
+        MemScope scope{mem.slot};
+        GlobalsScope globals{global.get()};
+        struct Rearm {
+            Environment& e;
+            ~Rearm() {
+                if (--e.exec_depth == 0) g_mem_slots[e.mem.slot].tripped.store(false);
+            }
+        } rearm{*this};
+        exec_depth++;
+        auto shadowed = [this](const std::string& n) {
+            for (Env* e = global.get(); e; e = e->parent.get()) {
+                auto it = e->vars.find(n);
+                if (it != e->vars.end()) return std::holds_alternative<ProcVal>(it->second);
+            }
+            return false;
+        };
+        std::vector<Token> toks;
+        if (auto* cached = code_cache.find(src, optimize, shadowed)) {
+            toks = *cached;
+        } else {
+            toks = lex(src, filename);
+            std::vector<std::string> assumed;
+            if (optimize) {
+                TokenOptimizer opt;
+                opt.shadowed = shadowed;
+                toks = opt.run(std::move(toks));
+                assumed.assign(opt.assumed.begin(), opt.assumed.end());
+            }
+            code_cache.store(src, optimize, toks, std::move(assumed));
+        }
+        Interpreter interp{std::move(toks), 0, global, builtins, {}, yield, gc, filename, call_stack};
+        interp.code_cache = &code_cache;
+        if (!builtin_table || builtin_table->size() != builtins.size())
+            builtin_table = std::make_shared<std::map<std::string, Builtin>>(builtins);
+        interp.shared_builtins = builtin_table;
         interp.load_fn = [this](const std::string& s, const std::string& f) {
+            auto it = resident.find(f);
+            if (it != resident.end() && it->second == s) return;
             this->exec(s, f);
         };
         interp.run();
     }
+    // Runs a library and keeps it resident: later load() calls for the same
+    // path and unchanged source are skipped. Lets a long-lived environment
+    // serve scripts that begin with load("stdlib.mu") without re-running it.
+    void preload(const std::string& src, const std::string& path) {
+        exec(src, path);
+        resident[path] = src;
+    }
+
+    // Owns this environment's accounting slot; copies keep their own,
+    // moves (fork() returning by value) hand the slot and its limit over.
+    struct MemAccount {
+        unsigned slot = mem_acquire_slot();
+        MemAccount() = default;
+        MemAccount(const MemAccount&) {}
+        MemAccount(MemAccount&& o) noexcept : slot(o.slot) {
+            o.slot = 0;
+        }
+        MemAccount& operator=(const MemAccount&) {
+            return *this;
+        }
+        MemAccount& operator=(MemAccount&& o) noexcept {
+            if (this != &o) {
+                mem_release_slot(slot);
+                slot = o.slot;
+                o.slot = 0;
+            }
+            return *this;
+        }
+        ~MemAccount() {
+            mem_release_slot(slot);
+        }
+    };
 
     EnvPtr global = std::make_shared<Env>();
     std::map<std::string, Builtin> builtins;
+    // builtins as shared by every task and fork; rebuilt after changes
+    std::shared_ptr<std::map<std::string, Builtin>> builtin_table;
     std::vector<std::string>       call_stack;
     std::vector<std::string>       paths;
-    YieldFn                        yield_fn;
+    YieldGate                      yield;
+    Collector                      gc;
+    MemAccount                     mem;
+    int                            exec_depth = 0;
+    bool                           optimize = true;   // run TokenOptimizer on sources
+    CodeCache                      code_cache;
+    std::map<std::string, std::string> resident;      // path -> source, see preload()
 };
 std::string format_error(const Error& e) {
     std::string msg = e.file + ":" + std::to_string(e.line) + ": " + e.msg;
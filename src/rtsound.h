@@ -2,6 +2,7 @@
 #define RTSOUND_H
 
 #include "core.h"
+#include "signals.h"
 
 #include <algorithm>
 #include <atomic>
@@ -10,6 +11,7 @@
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <sstream>
@@ -73,25 +75,30 @@ static inline PlaybackBuffer value_to_playback_buffer(const Value& v,
 
     if (std::holds_alternative<ArrayPtr>(v)) {
         auto arr = std::get<ArrayPtr>(v);
-        if (arr->elems.empty()) {
+        if (arr->empty()) {
             throw Error{interp.filename, interp.cur_line(),
                         fn + ": channel array is empty", {}};
         }
 
-        pb.channels = static_cast<uint32_t>(arr->elems.size());
+        pb.channels = static_cast<uint32_t>(arr->size());
 
         std::size_t nframes = 0;
         bool first = true;
         std::vector<const NumVal*> chans;
-        chans.reserve(arr->elems.size());
+        chans.reserve(arr->size());
 
-        for (const auto& elem : arr->elems) {
-            if (!std::holds_alternative<NumVal>(elem)) {
+        // a packed array holds one-sample channels
+        std::vector<Value> held;
+        if (arr->packed()) held = arr->values();
+
+        for (std::size_t c = 0; c < arr->size(); ++c) {
+            const Value& ch = arr->packed() ? held[c] : arr->at(c);
+            if (!std::holds_alternative<NumVal>(ch)) {
                 throw Error{interp.filename, interp.cur_line(),
                             fn + ": expected a vector or an array of vectors", {}};
             }
 
-            const auto& nv = std::get<NumVal>(elem);
+            const auto& nv = std::get<NumVal>(ch);
 
             if (first) {
                 nframes = nv.size();
@@ -120,11 +127,91 @@ static inline PlaybackBuffer value_to_playback_buffer(const Value& v,
                 fn + ": expected a vector or an array of vectors", {}};
 }
 
+// Convolvers applied to a voice, one per channel. The device asks for any
+// number of frames, so each channel is delayed by one convolver block:
+// a full block of input is convolved while the previous one plays out.
+// The voice owns its convolvers (their `busy` flag) until it is dropped,
+// which never happens in the callback or under g_mutex (see VoiceList).
+struct VoiceConvolution {
+    std::vector<std::shared_ptr<Convolver>> convs;
+    std::vector<std::vector<Real>> in, out;
+    std::vector<double> frame;
+    std::size_t block = 0, pos = 0;
+    uint64_t tail_frames = 0;    // block delay plus the response's tail
+
+    ~VoiceConvolution() {
+        for (auto& c : convs) c->busy = false;
+    }
+
+    // Feeds one frame of `channels` samples and returns the delayed output
+    // in place.
+    void tick(double* frame) {
+        for (std::size_t ch = 0; ch < convs.size(); ++ch) {
+            double y = out[ch][pos];
+            in[ch][pos] = frame[ch];
+            frame[ch] = y;
+        }
+        if (++pos == block) {
+            for (std::size_t ch = 0; ch < convs.size(); ++ch)
+                convs[ch]->engine.process(in[ch].data(), out[ch].data(), true);
+            pos = 0;
+        }
+    }
+};
+
+// play(buf, sr, convs): one convolver per channel (or a single one for a
+// mono buffer), all with the same block size and free to be claimed.
+static inline std::shared_ptr<VoiceConvolution> value_to_voice_convolution(const Value& v,
+                                                                           uint32_t channels,
+                                                                           Interpreter& interp,
+                                                                           const std::string& fn)
+{
+    std::vector<std::shared_ptr<Convolver>> convs;
+    auto take = [&](const Value& c) {
+        auto* p = std::get_if<NativePtr>(&c);
+        auto conv = p ? std::dynamic_pointer_cast<Convolver>(*p) : nullptr;
+        if (!conv) {
+            throw Error{interp.filename, interp.cur_line(),
+                        fn + ": expected a convolver or an array of convolvers", {}};
+        }
+        convs.push_back(conv);
+    };
+    if (std::holds_alternative<ArrayPtr>(v)) std::get<ArrayPtr>(v)->each(take);
+    else take(v);
+
+    if (convs.size() != channels) {
+        throw Error{interp.filename, interp.cur_line(),
+                    fn + ": one convolver per channel required", {}};
+    }
+
+    auto fx = std::make_shared<VoiceConvolution>();
+    fx->block = static_cast<std::size_t>(convs[0]->engine.block());
+    long longest = 0;
+    for (auto& c : convs) {
+        if (static_cast<std::size_t>(c->engine.block()) != fx->block) {
+            throw Error{interp.filename, interp.cur_line(),
+                        fn + ": all convolvers must have the same block size", {}};
+        }
+        if (c->busy.exchange(true)) {
+            throw Error{interp.filename, interp.cur_line(),
+                        fn + ": convolver is in use elsewhere", {}};
+        }
+        fx->convs.push_back(c);  // released by ~VoiceConvolution, even on a later throw
+        longest = std::max(longest, c->engine.size());
+    }
+    fx->in.assign(channels, std::vector<Real>(fx->block, 0.0));
+    fx->out.assign(channels, std::vector<Real>(fx->block, 0.0));
+    fx->frame.assign(channels, 0.0);
+    fx->tail_frames = fx->block + static_cast<uint64_t>(longest);
+    return fx;
+}
+
 #ifdef BUILD_MUSIL_RTSOUND
 
 struct Voice {
     uint64_t id = 0;
     std::shared_ptr<PlaybackBuffer> buffer;
+    std::shared_ptr<VoiceConvolution> fx;
     std::atomic<uint64_t> cursor_frames {0};
     std::atomic<bool> finished {false};
     std::atomic<bool> paused {false};
@@ -152,20 +239,25 @@ static inline void join_thread_if_needed_locked() {
     }
 }
 
-static inline void cleanup_finished_voices_locked() {
-    g_voices.erase(
-        std::remove_if(g_voices.begin(), g_voices.end(),
-            [](const std::shared_ptr<Voice>& v) {
-                return !v || v->finished.load(std::memory_order_relaxed);
-            }),
-        g_voices.end()
-    );
+// Voices leave g_voices into `dropped`, which the caller destroys after
+// releasing g_mutex: dropping the last reference to a convolver joins its
+// workers, and the callback would wait on the lock meanwhile.
+using VoiceList = std::vector<std::shared_ptr<Voice>>;
+
+static inline void cleanup_finished_voices_locked(VoiceList& dropped) {
+    auto done = std::stable_partition(g_voices.begin(), g_voices.end(),
+        [](const std::shared_ptr<Voice>& v) {
+            return v && !v->finished.load(std::memory_order_relaxed);
+        });
+    std::move(done, g_voices.end(), std::back_inserter(dropped));
+    g_voices.erase(done, g_voices.end());
 }
 
-static inline void clear_all_voices_locked() {
+static inline void clear_all_voices_locked(VoiceList& dropped) {
     for (auto& v : g_voices) {
         if (v) v->finished.store(true, std::memory_order_relaxed);
     }
+    std::move(g_voices.begin(), g_voices.end(), std::back_inserter(dropped));
     g_voices.clear();
 }
 
@@ -198,10 +290,12 @@ static inline std::shared_ptr<Voice> find_voice_by_id_locked(uint64_t voice_id)
     return nullptr;
 }
 
-static inline std::shared_ptr<Voice> make_voice(const std::shared_ptr<PlaybackBuffer>& buffer) {
+static inline std::shared_ptr<Voice> make_voice(const std::shared_ptr<PlaybackBuffer>& buffer,
+                                                const std::shared_ptr<VoiceConvolution>& fx = nullptr) {
     auto voice = std::make_shared<Voice>();
     voice->id = g_next_voice_id.fetch_add(1, std::memory_order_relaxed);
     voice->buffer = buffer;
+    voice->fx = fx;
     voice->cursor_frames.store(0, std::memory_order_relaxed);
     voice->finished.store(false, std::memory_order_relaxed);
     voice->paused.store(false, std::memory_order_relaxed);
@@ -241,26 +335,40 @@ static inline void playback_callback(ma_device* device,
 
         const PlaybackBuffer& buf = *voice->buffer;
         const uint64_t cursor = voice->cursor_frames.load(std::memory_order_relaxed);
+        const uint64_t length = buf.frames + (voice->fx ? voice->fx->tail_frames : 0);
 
-        if (cursor >= buf.frames) {
+        if (cursor >= length) {
             voice->finished.store(true, std::memory_order_relaxed);
             continue;
         }
 
-        const uint64_t remain  = buf.frames - cursor;
+        const uint64_t remain  = length - cursor;
         const uint64_t to_copy = std::min<uint64_t>(remain, static_cast<uint64_t>(frame_count));
-        const float* src = buf.interleaved.data() + cursor * buf.channels;
 
-        for (uint64_t f = 0; f < to_copy; ++f) {
-            for (uint32_t ch = 0; ch < buf.channels; ++ch) {
-                const std::size_t idx = static_cast<std::size_t>(f * buf.channels + ch);
-                out[idx] += src[idx];
+        if (voice->fx) {
+            // past the end of the buffer the convolvers ring out on silence
+            double* frame = voice->fx->frame.data();
+            for (uint64_t f = 0; f < to_copy; ++f) {
+                const uint64_t at = cursor + f;
+                for (uint32_t ch = 0; ch < buf.channels; ++ch)
+                    frame[ch] = at < buf.frames ? buf.interleaved[at * buf.channels + ch] : 0.0;
+                voice->fx->tick(frame);
+                for (uint32_t ch = 0; ch < buf.channels; ++ch)
+                    out[f * buf.channels + ch] += static_cast<float>(frame[ch]);
+            }
+        } else {
+            const float* src = buf.interleaved.data() + cursor * buf.channels;
+            for (uint64_t f = 0; f < to_copy; ++f) {
+                for (uint32_t ch = 0; ch < buf.channels; ++ch) {
+                    const std::size_t idx = static_cast<std::size_t>(f * buf.channels + ch);
+                    out[idx] += src[idx];
+                }
             }
         }
 
         voice->cursor_frames.store(cursor + to_copy, std::memory_order_relaxed);
 
-        if (cursor + to_copy >= buf.frames) {
+        if (cursor + to_copy >= length) {
             voice->finished.store(true, std::memory_order_relaxed);
         }
     }
@@ -269,7 +377,7 @@ static inline void playback_callback(ma_device* device,
         out[i] = clamp_sample(out[i]);
     }
 
-    cleanup_finished_voices_locked();
+    // finished voices are dropped by thread_main, off the audio thread
 }
 
 // ── Engine thread ──────────────────────────────────────────────────────────
@@ -302,8 +410,9 @@ static inline void thread_main(uint32_t sample_rate, uint32_t channels)
 
     while (true) {
         {
+            VoiceList dropped;
             std::lock_guard<std::mutex> lock(g_mutex);
-            cleanup_finished_voices_locked();
+            cleanup_finished_voices_locked(dropped);
 
             if (g_stop_requested.load(std::memory_order_relaxed)) {
                 break;
@@ -323,8 +432,9 @@ static inline void thread_main(uint32_t sample_rate, uint32_t channels)
     g_device_initialized.store(false, std::memory_order_relaxed);
 
     {
+        VoiceList dropped;
         std::lock_guard<std::mutex> lock(g_mutex);
-        clear_all_voices_locked();
+        clear_all_voices_locked(dropped);
         g_sample_rate = 0;
         g_channels = 0;
     }
@@ -336,13 +446,13 @@ static inline void thread_main(uint32_t sample_rate, uint32_t channels)
 // ── Builtins ───────────────────────────────────────────────────────────────
 
 static inline Value fn_play_async(std::vector<Value>& args, Interpreter& interp) {
-    if (args.size() != 1 && args.size() != 2) {
+    if (args.size() < 1 || args.size() > 3) {
         throw Error{interp.filename, interp.cur_line(),
-                    "play_async: expected 1 or 2 arguments", {}};
+                    "play_async: expected 1 to 3 arguments", {}};
     }
 
     const uint32_t sample_rate =
-        (args.size() == 2)
+        (args.size() >= 2)
             ? parse_play_sample_rate(args[1], interp, "play_async")
             : k_default_sample_rate;
 
@@ -354,6 +464,12 @@ static inline Value fn_play_async(std::vector<Value>& args, Interpreter& interp)
         return NumVal{0.0};
     }
 
+    std::shared_ptr<VoiceConvolution> fx;
+    if (args.size() == 3) {
+        fx = value_to_voice_convolution(args[2], buffer->channels, interp, "play_async");
+    }
+
+    VoiceList dropped;
     std::lock_guard<std::mutex> lock(g_mutex);
 
     if (!g_running.load(std::memory_order_relaxed)) {
@@ -362,9 +478,9 @@ static inline Value fn_play_async(std::vector<Value>& args, Interpreter& interp)
         g_sample_rate = buffer->sample_rate;
         g_channels    = buffer->channels;
         g_stop_requested.store(false, std::memory_order_relaxed);
-        g_voices.clear();
+        clear_all_voices_locked(dropped);
 
-        auto voice = make_voice(buffer);
+        auto voice = make_voice(buffer, fx);
         const uint64_t voice_id = voice->id;
         g_voices.push_back(voice);
 
@@ -383,7 +499,7 @@ static inline Value fn_play_async(std::vector<Value>& args, Interpreter& interp)
                     "play_async: channel count must match currently running DAC", {}};
     }
 
-    auto voice = make_voice(buffer);
+    auto voice = make_voice(buffer, fx);
     const uint64_t voice_id = voice->id;
     g_voices.push_back(voice);
 
@@ -408,9 +524,10 @@ static inline Value fn_dacstop(std::vector<Value>& args, Interpreter& interp) {
 
     if (args.empty()) {
         {
+            VoiceList dropped;
             std::lock_guard<std::mutex> lock(g_mutex);
             g_stop_requested.store(true, std::memory_order_relaxed);
-            clear_all_voices_locked();
+            clear_all_voices_locked(dropped);
         }
 
         join_thread_if_needed_locked();
@@ -421,9 +538,10 @@ static inline Value fn_dacstop(std::vector<Value>& args, Interpreter& interp) {
     const uint64_t voice_id = parse_voice_id_arg(args[0], interp, "dacstop");
 
     {
+        VoiceList dropped;
         std::lock_guard<std::mutex> lock(g_mutex);
 
-        cleanup_finished_voices_locked();
+        cleanup_finished_voices_locked(dropped);
 
         auto voice = find_voice_by_id_locked(voice_id);
         if (!voice) {
@@ -432,7 +550,7 @@ static inline Value fn_dacstop(std::vector<Value>& args, Interpreter& interp) {
         }
 
         voice->finished.store(true, std::memory_order_relaxed);
-        cleanup_finished_voices_locked();
+        cleanup_finished_voices_locked(dropped);
     }
 
     return NumVal{1.0};
@@ -444,9 +562,10 @@ static inline Value fn_dacpause(std::vector<Value>& args, Interpreter& interp) {
                     "dacpause: expected 0 or 1 arguments", {}};
     }
 
+    VoiceList dropped;
     std::lock_guard<std::mutex> lock(g_mutex);
 
-    cleanup_finished_voices_locked();
+    cleanup_finished_voices_locked(dropped);
 
     if (args.empty()) {
         for (auto& v : g_voices) {
@@ -478,9 +597,10 @@ static inline Value fn_dacresume(std::vector<Value>& args, Interpreter& interp)
                     "dacresume: expected 0 or 1 arguments", {}};
     }
 
+    VoiceList dropped;
     std::lock_guard<std::mutex> lock(g_mutex);
 
-    cleanup_finished_voices_locked();
+    cleanup_finished_voices_locked(dropped);
 
     if (args.empty()) {
         for (auto& v : g_voices) {
@@ -523,9 +643,10 @@ static inline Value fn_dacinfo(std::vector<Value>& args, Interpreter& interp) {
 
     std::ostringstream ss;
 
+    VoiceList dropped;
     std::lock_guard<std::mutex> lock(g_mutex);
 
-    cleanup_finished_voices_locked();
+    cleanup_finished_voices_locked(dropped);
 
     const bool running = g_running.load(std::memory_order_relaxed);
     const bool device_initialized = g_device_initialized.load(std::memory_order_relaxed);
@@ -607,18 +728,18 @@ static inline Value fn_dacinfo(std::vector<Value>& args, Interpreter& interp) {
 #else
 
 static inline Value fn_play(std::vector<Value>& args, Interpreter& interp) {
-    if (args.size() != 1 && args.size() != 2) {
+    if (args.size() < 1 || args.size() > 3) {
         throw Error{interp.filename, interp.cur_line(),
-                    "play: expected 1 or 2 arguments", {}};
+                    "play: expected 1 to 3 arguments", {}};
     }
     std::cout << "play: realtime sound system has not been enabled" << std::endl;
     return NumVal{0.0};
 }
 
 static inline Value fn_play_async(std::vector<Value>& args, Interpreter& interp) {
-    if (args.size() != 1 && args.size() != 2) {
+    if (args.size() < 1 || args.size() > 3) {
         throw Error{interp.filename, interp.cur_line(),
-                    "play_async: expected 1 or 2 arguments", {}};
+                    "play_async: expected 1 to 3 arguments", {}};
     }
     std::cout << "play_async: realtime sound system has not been enabled" << std::endl;
     return NumVal{0.0};
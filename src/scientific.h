@@ -37,21 +37,27 @@
 static Matrix<double> arr2matrix(const Value& v, const std::string& ctx, Interpreter* interp = nullptr) {
     if (!std::holds_alternative<ArrayPtr>(v))
         throw Error{"scientific", -1, ctx + ": expected array-of-vectors (matrix)"};
-    const auto& rows_arr = std::get<ArrayPtr>(v)->elems;
-    if (rows_arr.empty())
+    const Array& arr = *std::get<ArrayPtr>(v);
+    if (arr.empty())
         throw Error{"scientific", -1, ctx + ": empty matrix"};
-    if (!std::holds_alternative<NumVal>(rows_arr[0]))
+    if (arr.packed()) {
+        // array of scalars: a single column
+        Matrix<double> m(arr.size(), 1);
+        for (std::size_t i = 0; i < arr.size(); ++i) m(i, 0) = arr.nums()[i];
+        return m;
+    }
+    if (!std::holds_alternative<NumVal>(arr.at(0)))
         throw Error{"scientific", -1, ctx + ": rows must be numeric vectors"};
-    const std::size_t n_rows = rows_arr.size();
-    const std::size_t n_cols = std::get<NumVal>(rows_arr[0]).size();
+    const std::size_t n_rows = arr.size();
+    const std::size_t n_cols = std::get<NumVal>(arr.at(0)).size();
     if (n_cols == 0)
         throw Error{"scientific", -1, ctx + ": zero-length rows"};
     Matrix<double> m(n_rows, n_cols);
     for (std::size_t i = 0; i < n_rows; ++i) {
-        if (interp && ((i & 255u) == 0)) interp->maybe_yield();
-        if (!std::holds_alternative<NumVal>(rows_arr[i]))
+        if (interp && ((i & 255u) == 0)) interp->maybe_yield(YIELD_BLOCK_COST);
+        if (!std::holds_alternative<NumVal>(arr.at(i)))
             throw Error{"scientific", -1, ctx + ": row " + std::to_string(i) + " is not a vector"};
-        const NumVal& row = std::get<NumVal>(rows_arr[i]);
+        const NumVal& row = std::get<NumVal>(arr.at(i));
         if (row.size() != n_cols)
             throw Error{"scientific", -1, ctx + ": ragged matrix (inconsistent row lengths)"};
         for (std::size_t j = 0; j < n_cols; ++j)
@@ -63,13 +69,13 @@ static Matrix<double> arr2matrix(const Value& v, const std::string& ctx, Interpr
 // C++ Matrix<double> → Array-of-Vectors
 static Value matrix2arr(const Matrix<double>& m, Interpreter* interp = nullptr) {
     auto arr = std::make_shared<Array>();
-    arr->elems.reserve(m.rows());
+    arr->reserve(m.rows());
     for (std::size_t i = 0; i < m.rows(); ++i) {
-        if (interp && ((i & 255u) == 0)) interp->maybe_yield();
+        if (interp && ((i & 255u) == 0)) interp->maybe_yield(YIELD_BLOCK_COST);
         NumVal row(m.cols());
         for (std::size_t j = 0; j < m.cols(); ++j)
             row[j] = m(i, j);
-        arr->elems.push_back(std::move(row));
+        arr->push(std::move(row));
     }
     return arr;
 }
@@ -258,32 +264,53 @@ static Value fn_eye(std::vector<Value>& args, Interpreter& interp) {
     e.id();
     return matrix2arr(e, &interp);
 }
-// randvec(n)  -> NumVal of n values in [-1, 1]
-// randmat(cols, rows) -> Array-of-Vectors matrix
-static Value fn_rand(std::vector<Value>& args, Interpreter& interp) {
+// rand(n) -> NumVal of n values in [-1, 1)
+// rand(cols, rows) -> Array-of-Vectors matrix
+// randn(n), randn(cols, rows) -> the same shapes, standard normal
+// Both draw from the calling thread's stream (see Rng in core.h).
+static void fill_random(NumVal& out, bool normal, Interpreter& interp) {
+    static constexpr size_t BLOCK = 65536;   // yield between blocks
+    for (size_t lo = 0; lo < out.size(); lo += BLOCK) {
+        size_t n = std::min(BLOCK, out.size() - lo);
+        if (normal) rng().fill_normal(&out[lo], n);
+        else        rng().fill_uniform(&out[lo], n, -1.0, 1.0);
+        if (lo + n < out.size()) sig_yield(interp);
+    }
+}
+static Value random_shape(std::vector<Value>& args, Interpreter& interp, const char* name, bool normal) {
     if (args.size() < 1 || args.size() > 2)
-        throw Error{interp.filename, interp.cur_line(), "rand: 1 or 2 arguments required"};
-    int len  = (int)scalar(args[0], "rand");
-    int rows = args.size() == 2 ? (int)scalar(args[1], "rand") : 1;
-    if (len <= 0 || rows <= 0) throw Error{interp.filename, interp.cur_line(), "rand: dimensions must be positive"};
+        throw Error{interp.filename, interp.cur_line(), std::string(name) + ": 1 or 2 arguments required"};
+    int len  = (int)scalar(args[0], name);
+    int rows = args.size() == 2 ? (int)scalar(args[1], name) : 1;
+    if (len <= 0 || rows <= 0)
+        throw Error{interp.filename, interp.cur_line(), std::string(name) + ": dimensions must be positive"};
     if (rows == 1) {
         NumVal out(len);
-        for (int i = 0; i < len; ++i) {
-            if ((i & 1023) == 0) sig_yield(interp);
-            out[i] = ((double)std::rand() / RAND_MAX) * 2.0 - 1.0;
-        }
+        fill_random(out, normal, interp);
         return out;
     }
     auto arr = std::make_shared<Array>();
     for (int r = 0; r < rows; ++r) {
         if ((r & 255) == 0) sig_yield(interp);
         NumVal row(len);
-        for (int i = 0; i < len; ++i)
-            row[i] = ((double)std::rand() / RAND_MAX) * 2.0 - 1.0;
-        arr->elems.push_back(std::move(row));
+        fill_random(row, normal, interp);
+        arr->push(std::move(row));
     }
     return arr;
 }
+static Value fn_rand(std::vector<Value>& args, Interpreter& interp) {
+    return random_shape(args, interp, "rand", false);
+}
+static Value fn_randn(std::vector<Value>& args, Interpreter& interp) {
+    return random_shape(args, interp, "randn", true);
+}
+// seed(n): restart this thread's stream at n; seed() picks a fresh
+// random seed. Tasks and pmap chunks created afterwards follow from it.
+static Value fn_seed(std::vector<Value>& args, Interpreter& interp) {
+    if (args.size() > 1) throw Error{interp.filename, interp.cur_line(), "seed: 0 or 1 argument"};
+    rng().reseed(args.empty() ? Rng::entropy() : (uint64_t)(int64_t)scalar(args[0], "seed"));
+    return NumVal{0.0};
+}
 // zeros/ones: zeros(n) -> vector; zeros(cols, rows) -> matrix
 static Value fn_zeros(std::vector<Value>& args, Interpreter& interp) {
     if (args.size() < 1 || args.size() > 2)
@@ -295,7 +322,7 @@ static Value fn_zeros(std::vector<Value>& args, Interpreter& interp) {
     auto arr = std::make_shared<Array>();
     for (int r = 0; r < rows; ++r) {
         if ((r & 255) == 0) sig_yield(interp);
-        arr->elems.push_back(NumVal((size_t)len));
+        arr->push(NumVal((size_t)len));
     }
     return arr;
 }
@@ -309,7 +336,7 @@ static Value fn_ones(std::vector<Value>& args, Interpreter& interp) {
     auto arr = std::make_shared<Array>();
     for (int r = 0; r < rows; ++r) {
         if ((r & 255) == 0) sig_yield(interp);
-        arr->elems.push_back(NumVal(1.0, (size_t)len));
+        arr->push(NumVal(1.0, (size_t)len));
     }
     return arr;
 }
@@ -803,8 +830,8 @@ static Value fn_kmeans(std::vector<Value>& args, Interpreter& interp) {
     NumVal labels_va(n);
     for (int i=0; i<n; ++i) labels_va[i]=(double)labels_vec[i];
     auto res = std::make_shared<Array>();
-    res->elems.push_back(labels_va);
-    res->elems.push_back(matrix2arr(centroids));
+    res->push(labels_va);
+    res->push(matrix2arr(centroids));
     return res;
 }
 
@@ -815,39 +842,46 @@ static Value fn_knn(std::vector<Value>& args, Interpreter& interp) {
     if (args.size() != 3) throw Error{interp.filename, interp.cur_line(), "knn: 3 arguments required (train, K, queries)"};
     if (!std::holds_alternative<ArrayPtr>(args[0]))
         throw Error{interp.filename, interp.cur_line(), "knn: training data must be an array"};
-    const auto& train_arr = std::get<ArrayPtr>(args[0])->elems;
+    const Array& train_arr = *std::get<ArrayPtr>(args[0]);
     int obs = (int)train_arr.size();
     if (obs < 1) throw Error{interp.filename, interp.cur_line(), "knn: insufficient training data"};
     int K = (int)scalar(args[1], "knn");
     if (K < 1 || K > obs) throw Error{interp.filename, interp.cur_line(), "knn: invalid K"};
     // Determine feature dimension from first training sample
-    if (!std::holds_alternative<ArrayPtr>(train_arr[0]))
+    Value first = train_arr.get(0);
+    if (!std::holds_alternative<ArrayPtr>(first))
         throw Error{interp.filename, interp.cur_line(), "knn: each training item must be [features, label]"};
-    const auto& first = std::get<ArrayPtr>(train_arr[0])->elems;
-    if (first.size() != 2 || !std::holds_alternative<NumVal>(first[0]))
+    const Array& first_item = *std::get<ArrayPtr>(first);
+    if (first_item.size() != 2 || !std::holds_alternative<NumVal>(first_item.get(0)))
         throw Error{interp.filename, interp.cur_line(), "knn: training item[0] must be [NumVec, label]"};
-    int features = (int)std::get<NumVal>(first[0]).size();
+    int features = (int)std::get<NumVal>(first_item.get(0)).size();
     KNN<double> knn_model(K, features);
     for (int i = 0; i < obs; ++i) {
         if ((i & 255) == 0) sig_yield(interp);
-        const auto& item = std::get<ArrayPtr>(train_arr[i])->elems;
+        Value entry = train_arr.get(i);
+        if (!std::holds_alternative<ArrayPtr>(entry) || std::get<ArrayPtr>(entry)->size() != 2)
+            throw Error{interp.filename, interp.cur_line(), "knn: each training item must be [features, label]"};
+        const Array& item = *std::get<ArrayPtr>(entry);
+        Value feats = item.get(0);
+        std::valarray<double> attrs(nvec(feats, "knn"));
         auto* o = new Observation<double>();
-        o->attributes = std::valarray<double>(std::get<NumVal>(item[0]));
-        o->classlabel  = to_str(item[1]);
+        o->attributes = std::move(attrs);
+        o->classlabel  = to_str(item.get(1));
         knn_model.addObservation(o);
     }
     if (!std::holds_alternative<ArrayPtr>(args[2]))
         throw Error{interp.filename, interp.cur_line(), "knn: queries must be an array"};
-    const auto& queries = std::get<ArrayPtr>(args[2])->elems;
+    const Array& queries = *std::get<ArrayPtr>(args[2]);
     auto out = std::make_shared<Array>();
-    for (const auto& q : queries) {
+    for (std::size_t i = 0; i < queries.size(); ++i) {
         sig_yield(interp);
+        Value q = queries.get(i);
         Observation<double> qo;
         NumVal qv = nvec(q, "knn query");
         if ((int)qv.size() != features)
             throw Error{interp.filename, interp.cur_line(), "knn: query feature dimension mismatch"};
         qo.attributes = std::valarray<double>(qv);
-        out->elems.push_back(knn_model.classify(qo));
+        out->push(knn_model.classify(qo));
     }
     return out;
 }
@@ -877,6 +911,8 @@ inline void add_scientific(Environment& env) {
     // Construction / decomposition
     env.register_builtin("eye",       fn_eye);
     env.register_builtin("rand",      fn_rand);
+    env.register_builtin("randn",     fn_randn);
+    env.register_builtin("seed",      fn_seed);
     env.register_builtin("zeros",     fn_zeros);
     env.register_builtin("ones",      fn_ones);
     env.register_builtin("bpf",       fn_bpf);
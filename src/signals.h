@@ -4,6 +4,8 @@
 #include "core.h"
 #include "signals/FFT.h"
 #include "signals/features.h"
+#include "signals/convolver.h"
+#include "signals/sos.h"
 
 #include <vector>
 #include <valarray>
@@ -58,19 +60,29 @@ static NumVal packed_second(const NumVal& v, const std::string& fn) {
     return NumVal(out);
 }
 
-// Extract b/a from packed filtdesign coefficients [b0 b1 b2 1 a1 a2]
-static void unpack_biquad_coeffs(const NumVal& coeffs, std::valarray<Real>& b, std::valarray<Real>& a,
-                                 const std::string& fn) {
-    if (coeffs.size() != 6)
-        throw Error{"signals", -1, fn + ": packed coeffs must have length 6 [b0 b1 b2 1 a1 a2]"};
-    b.resize(3);
-    a.resize(3);
-    b[0] = coeffs[0];
-    b[1] = coeffs[1];
-    b[2] = coeffs[2];
-    a[0] = coeffs[3];
-    a[1] = coeffs[4];
-    a[2] = coeffs[5];
+// Cascade coefficients for sos_filter from filtdesign output: one vector of
+// [b0 b1 b2 a0 a1 a2] per section, concatenated or in an array; each
+// section is normalized by its a0 to [b0 b1 b2 a1 a2]
+static std::vector<Real> unpack_sos_coeffs(const Value& v, const std::string& fn) {
+    std::vector<NumVal> secs;
+    if (std::holds_alternative<ArrayPtr>(v)) {
+        const Array& arr = *std::get<ArrayPtr>(v);
+        if (arr.packed()) secs.push_back(NumVal(arr.nums().data(), arr.nums().size()));
+        else for (std::size_t i = 0; i < arr.size(); ++i) secs.push_back(sig_nvec(arr.at(i), fn));
+    } else {
+        secs.push_back(sig_nvec(v, fn));
+    }
+    std::vector<Real> c;
+    for (const NumVal& k : secs) {
+        if (k.size() == 0 || k.size() % 6 != 0)
+            throw Error{"signals", -1, fn + ": packed coeffs must have 6 values per section [b0 b1 b2 a0 a1 a2]"};
+        for (std::size_t s = 0; s < k.size(); s += 6) {
+            Real a0 = k[s + 3];
+            if (a0 == Real(0)) throw Error{"signals", -1, fn + ": a0 of a section cannot be zero"};
+            for (int j : {0, 1, 2, 4, 5}) c.push_back(k[s + j] / a0);
+        }
+    }
+    return c;
 }
 
 // ── C++ support functions (unchanged from original) ──────────────────────────
@@ -98,54 +110,112 @@ static int next_pow2(int n) {
     return (1 << count);
 }
 
-static std::valarray<Real> conv_one_channel(const std::valarray<Real>& x, const std::valarray<Real>& y) {
-    int x_sz = (int)x.size(), y_sz = (int)y.size();
-    if (x_sz == 0 || y_sz == 0) return std::valarray<Real>();
-    int conv_len = x_sz + y_sz - 1;
-    int N = next_pow2(conv_len), len = 2 * N;
-    std::valarray<Real> X(Real(0), len), Y(Real(0), len), R(Real(0), len);
-    for (int i = 0; i < N; ++i) {
-        X[2*i] = (i < x_sz ? x[i] : Real(0));
-        Y[2*i] = (i < y_sz ? y[i] : Real(0));
+// Full interleaved spectrum (2*N values) of d real samples cut or
+// zero-padded to N, computed with rfft and mirrored: X[N-k] = conj(X[k]).
+static void real_spectrum(const Real* x, int d, int N, Real* out) {
+    if (x != out) std::copy(x, x + std::min(d, N), out);
+    std::fill(out + std::min(d, N), out + std::max(N, 2), Real(0));
+    rfft<Real>(out, out, N);
+    for (int k = 1; 2 * k < N; ++k) {
+        out[2*(N-k)]   = out[2*k];
+        out[2*(N-k)+1] = -out[2*k+1];
     }
-    fft<Real>(&X[0], N, -1);
-    fft<Real>(&Y[0], N, -1);
-    for (int i = 0; i < N; ++i) {
+}
+
+// Convolution. conv_choose() (signals/convolver.h) prices each method
+// from both lengths: direct for short kernels, one transform of the
+// whole output, or overlap-save over blocks, partitioned when the kernel
+// is longer than a block. The kernel is the shorter operand.
+
+// Unscaled spectrum of y zero-padded to N, as conv_fft multiplies it
+static std::vector<Real> conv_spectrum(const NumVal& y, int N) {
+    std::vector<Real> Y(std::max(N + 2, 2), Real(0));
+    std::copy(std::begin(y), std::end(y), Y.begin());
+    rfft<Real>(&Y[0], &Y[0], N);
+    return Y;
+}
+
+static std::valarray<Real> conv_fft(const NumVal& x, std::size_t y_sz, int N, const std::vector<Real>& Y) {
+    std::size_t conv_len = x.size() + y_sz - 1;
+    std::valarray<Real> X(Real(0), std::max(N + 2, 2));
+    std::copy(std::begin(x), std::end(x), &X[0]);
+    rfft<Real>(&X[0], &X[0], N);
+    for (int i = 0; i <= N / 2; ++i) {
         Real xr=X[2*i], xi=X[2*i+1], yr=Y[2*i], yi=Y[2*i+1];
-        R[2*i]   = xr*yr - xi*yi;
-        R[2*i+1] = xr*yi + xi*yr;
+        X[2*i]   = xr*yr - xi*yi;
+        X[2*i+1] = xr*yi + xi*yr;
     }
-    fft<Real>(&R[0], N, 1);
+    irfft<Real>(&X[0], &X[0], N);
     std::valarray<Real> out(Real(0), conv_len);
-    for (int s = 0; s < conv_len; ++s) out[s] = R[2*s] / N;
+    for (std::size_t s = 0; s < conv_len; ++s) out[s] = X[s] / N;
+    return out;
+}
+
+// Runs x, then silence, through `conv` (taken by value: copies share the
+// response spectra) until len output samples are out
+static std::valarray<Real> conv_blocked(UniformConvolver<Real> conv, const NumVal& x, std::size_t len) {
+    std::size_t B = (std::size_t)conv.block();
+    std::valarray<Real> out(Real(0), len);
+    std::vector<Real> buf(B);
+    for (std::size_t pos = 0; pos < len; pos += B) {
+        std::size_t n = pos < x.size() ? std::min(B, x.size() - pos) : 0;
+        std::copy(std::begin(x) + pos, std::begin(x) + pos + n, buf.begin());
+        std::fill(buf.begin() + n, buf.end(), Real(0));
+        conv.process(&buf[0], &buf[0]);
+        std::copy(buf.begin(), buf.begin() + std::min(B, len - pos), &out[pos]);
+    }
     return out;
 }
 
+static std::valarray<Real> conv_one_channel(const NumVal& x, const NumVal& y) {
+    if (x.size() == 0 || y.size() == 0) return std::valarray<Real>();
+    const NumVal& sig = x.size() >= y.size() ? x : y;
+    const NumVal& h = x.size() >= y.size() ? y : x;
+    std::size_t len = x.size() + y.size() - 1;
+    ConvChoice c = conv_choose((long)sig.size(), (long)h.size());
+    if (c.method == CONV_DIRECT) {
+        std::valarray<Real> out(len);
+        direct_convolve<Real>(&sig[0], (long)sig.size(), &h[0], (long)h.size(), &out[0]);
+        return out;
+    }
+    if (c.method == CONV_BLOCKED)
+        return conv_blocked(UniformConvolver<Real>(&h[0], (long)h.size(), c.size), sig, len);
+    return conv_fft(x, y.size(), (int)c.size, conv_spectrum(y, (int)c.size));
+}
+
 static std::valarray<Real> fd_resample(const std::valarray<Real>& x, Real factor) {
     int in_len = (int)x.size();
     if (in_len == 0 || factor <= 0) return std::valarray<Real>();
     int out_len = std::max(1, (int)std::floor((Real)in_len * factor + 0.5));
-    int N1 = next_pow2(in_len), N2 = next_pow2(out_len);
-    std::valarray<Real> X(Real(0), 2*N1);
-    for (int i = 0; i < N1; ++i) X[2*i] = (i < in_len ? x[i] : Real(0));
-    fft<Real>(&X[0], N1, -1);
-    std::valarray<Real> Y(Real(0), 2*N2);
+    // the transform sizes must keep the ratio N2 / N1 = factor: a padded
+    // good size when N1 * factor comes out whole, else the exact lengths
+    int N1 = (int)fft_good_size(in_len), N2 = 0;
+    Real scaled = (Real)N1 * factor;
+    if (std::fabs(scaled - std::floor(scaled + 0.5)) < 1e-9 * scaled) N2 = (int)std::floor(scaled + 0.5);
+    if (N2 < 1) {
+        N1 = in_len;
+        N2 = out_len;
+    }
+    std::valarray<Real> X(Real(0), std::max(N1 + 2, 2));
+    std::copy(std::begin(x), std::end(x), &X[0]);
+    rfft<Real>(&X[0], &X[0], N1);
+    // bins below both Nyquists carry over; between two even sizes the
+    // input's Nyquist bin lands on the output's
+    std::valarray<Real> Y(Real(0), std::max(N2 + 2, out_len));
     int N1h = N1/2, N2h = N2/2, Nc = std::min(N1h, N2h);
-    Y[0] = X[0];
-    Y[1] = X[1];
-    for (int k = 1; k < Nc; ++k) {
+    for (int k = 0; k < Nc; ++k) {
         Y[2*k]   = X[2*k];
-        Y[2*k+1]   = X[2*k+1];
-        Y[2*(N2-k)]   = X[2*(N1-k)];
-        Y[2*(N2-k)+1] = X[2*(N1-k)+1];
+        Y[2*k+1] = X[2*k+1];
     }
     if ((N1 % 2 == 0) && (N2 % 2 == 0)) {
-        Y[2*N2h]   = X[2*N1h];
-        Y[2*N2h+1] = X[2*N1h+1];
+        Y[2*N2h] = X[2*N1h];
+    } else {
+        Y[2*Nc]   = X[2*Nc];
+        Y[2*Nc+1] = X[2*Nc+1];
     }
-    fft<Real>(&Y[0], N2, +1);
+    irfft<Real>(&Y[0], &Y[0], N2);
     std::valarray<Real> out(Real(0), out_len);
-    for (int n = 0; n < out_len; ++n) out[n] = Y[2*n] / (Real)N2;
+    for (int n = 0; n < std::min(out_len, N2); ++n) out[n] = Y[n] / (Real)N1;
     return out;
 }
 
@@ -201,21 +271,46 @@ static Value fn_osc(std::vector<Value>& args, Interpreter& I) {
 }
 
 // ── Frequency domain ──────────────────────────────────────────────────────────
+// Transform size of fft/rfft: next_pow2 of the signal length, or the
+// explicit size n given as second argument
+static int transform_size(std::vector<Value>& args, int d, const char* name, Interpreter& I) {
+    if (args.size() < 2) return next_pow2(d);
+    int n = (int)sig_scalar(args[1], name);
+    if (n < 1) throw Error{I.filename, I.cur_line(), std::string(name) + ": size must be positive"};
+    return n;
+}
+
+// fft(sig[, n]) -> the interleaved spectrum of sig zero-padded to
+// next_pow2, or cut or zero-padded to any size n
 static Value fn_fft(std::vector<Value>& args, Interpreter& I) {
-    if (args.size() != 1)
-        throw Error{I.filename, I.cur_line(), "fft: 1 argument required"};
+    if (args.size() != 1 && args.size() != 2)
+        throw Error{I.filename, I.cur_line(), "fft: 1 or 2 arguments required (sig[, n])"};
     const NumVal& sig = sig_nvec(args[0], "fft");
-    int d = (int)sig.size(), N = next_pow2(d);
-    std::valarray<Real> buf(Real(0), 2 * N);
-    for (int i = 0; i < N; ++i) {
-        if ((i & 1023) == 0) sig_yield(I);
-        buf[2*i] = (i < d ? sig[i] : Real(0));
-        buf[2*i+1] = Real(0);
-    }
-    fft<Real>(&buf[0], N, -1);
+    int d = (int)sig.size(), N = transform_size(args, d, "fft", I);
+    std::valarray<Real> buf(Real(0), std::max(2 * N, N + 2));
+    sig_yield(I);
+    if (d > 0) real_spectrum(&sig[0], d, N, &buf[0]);
+    if (N == 1) return NumVal(&buf[0], 2);   // no scratch bin
     return NumVal(buf);
 }
 
+// The real part of the inverse transform of an interleaved spectrum of N
+// bins, scaled: the Hermitian part, (X[k] + conj(X[N-k])) / 2, goes
+// through irfft. H is scratch of N + 2 values and receives the N samples.
+static void real_inverse(const Real* spec, int N, Real* H) {
+    if (N < 2) {
+        if (N == 1) H[0] = spec[0];
+        return;
+    }
+    for (int k = 0; k <= N / 2; ++k) {
+        int m = (N - k) % N;
+        H[2*k]   = (spec[2*k] + spec[2*m]) / 2;
+        H[2*k+1] = (spec[2*k+1] - spec[2*m+1]) / 2;
+    }
+    irfft<Real>(H, H, N);
+    for (int i = 0; i < N; ++i) H[i] /= N;
+}
+
 static Value fn_ifft(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 1)
         throw Error{I.filename, I.cur_line(), "ifft: 1 argument required"};
@@ -223,34 +318,193 @@ static Value fn_ifft(std::vector<Value>& args, Interpreter& I) {
     int len = (int)spec.size();
     if (len % 2 != 0) throw Error{I.filename, I.cur_line(), "ifft: spectrum length must be even"};
     int N = len / 2;
-    std::valarray<Real> buf(spec);
-    fft<Real>(&buf[0], N, +1);
+    std::valarray<Real> H(Real(0), N + 2);
+    sig_yield(I);
+    if (N > 0) real_inverse(&spec[0], N, &H[0]);
+    return NumVal(&H[0], N);
+}
+
+// rfft(sig[, n]) -> the N/2+1 bins 0..N/2 of sig zero-padded to
+// N = next_pow2, or cut or zero-padded to n, interleaved (re, im)
+static Value fn_rfft(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() != 1 && args.size() != 2)
+        throw Error{I.filename, I.cur_line(), "rfft: 1 or 2 arguments required (sig[, n])"};
+    const NumVal& sig = sig_nvec(args[0], "rfft");
+    int d = (int)sig.size();
+    if (d == 0) throw Error{I.filename, I.cur_line(), "rfft: empty signal"};
+    int N = transform_size(args, d, "rfft", I);
+    std::valarray<Real> buf(Real(0), N + 2);
+    std::copy(std::begin(sig), std::begin(sig) + std::min(d, N), &buf[0]);
+    sig_yield(I);
+    rfft<Real>(&buf[0], &buf[0], N);
+    return NumVal(&buf[0], 2 * (N / 2 + 1));
+}
+
+// irfft(spec[, n]) -> the N samples of an rfft spectrum, N = 2 * (bins - 1)
+// or the transform size n when given (bins past n/2 are dropped, missing
+// ones read as zero)
+static Value fn_irfft(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() != 1 && args.size() != 2)
+        throw Error{I.filename, I.cur_line(), "irfft: 1 or 2 arguments required (spec[, n])"};
+    const NumVal& spec = sig_nvec(args[0], "irfft");
+    int bins = (int)spec.size() / 2;
+    if (spec.size() % 2 != 0 || bins == 0)
+        throw Error{I.filename, I.cur_line(), "irfft: spectrum must hold interleaved bins"};
+    int N = bins == 1 ? 1 : 2 * (bins - 1);
+    if (args.size() == 2) {
+        N = (int)sig_scalar(args[1], "irfft");
+        if (N < 1) throw Error{I.filename, I.cur_line(), "irfft: size must be positive"};
+    }
+    std::valarray<Real> buf(Real(0), N + 2);
+    std::copy(std::begin(spec), std::begin(spec) + std::min(2 * bins, 2 * (N / 2 + 1)), &buf[0]);
+    sig_yield(I);
+    irfft<Real>(&buf[0], &buf[0], N);
     std::valarray<Real> out(Real(0), N);
-    for (int i = 0; i < N; ++i) {
-        if ((i & 1023) == 0) sig_yield(I);
-        out[i] = buf[2*i] / N;
+    for (int i = 0; i < N; ++i) out[i] = buf[i] / N;
+    return NumVal(out);
+}
+
+// Analysis window of stft/istft: Hann, or the vector given as 4th argument
+static std::valarray<Real> stft_window(std::vector<Value>& args, int N, const char* name, Interpreter& I) {
+    std::valarray<Real> win(N);
+    if (args.size() < 4) {
+        make_window(&win[0], N, Real(0.5), Real(0.5), Real(0));
+        return win;
     }
+    const NumVal& w = sig_nvec(args[3], name);
+    if ((int)w.size() != N)
+        throw Error{I.filename, I.cur_line(), std::string(name) + ": window must have N values"};
+    return w;
+}
+
+// Spectrum of one windowed frame of N samples at x, as fft() returns it:
+// 2 * Nfft interleaved values
+static NumVal stft_frame(const Real* x, const std::valarray<Real>& win, int N, int Nfft) {
+    std::valarray<Real> fb(Real(0), std::max(2 * Nfft, Nfft + 2));
+    for (int i = 0; i < N; ++i) fb[i] = x[i] * win[i];
+    real_spectrum(&fb[0], N, Nfft, &fb[0]);
+    return Nfft == 1 ? NumVal(&fb[0], 2) : NumVal(fb);
+}
+
+// Frames are independent: stft, istft and the framewise conversions and
+// descriptors below work on blocks of at least PAR_FRAMES_MIN frames in
+// parallel on the shared pool.
+static constexpr std::size_t PAR_FRAMES_MIN = 16;
+
+// stft(sig, N, hop[, win]) -> Array of the spectra of the whole frames
+// sig[pos, pos + N), pos = 0, hop, 2 hop, ..., each windowed (Hann by
+// default) and zero-padded to next_pow2(N) as fft() returns it
+static Value fn_stft(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() != 3 && args.size() != 4)
+        throw Error{I.filename, I.cur_line(), "stft: 3 or 4 args required (sig, N, hop[, window])"};
+    const NumVal& sig = sig_nvec(args[0], "stft");
+    int N = (int)sig_scalar(args[1], "stft");
+    int hop = (int)sig_scalar(args[2], "stft");
+    if (N <= 0 || hop <= 0) throw Error{I.filename, I.cur_line(), "stft: N and hop must be positive"};
+    std::valarray<Real> win = stft_window(args, N, "stft", I);
+    int Nfft = next_pow2(N), L = (int)sig.size();
+    std::vector<Value> out(L >= N ? (L - N) / hop + 1 : 0);
+    sig_yield(I);
+    par_blocks(out.size(), PAR_FRAMES_MIN, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t k = lo; k < hi; ++k) out[k] = stft_frame(&sig[k * hop], win, N, Nfft);
+    });
+    return std::make_shared<Array>(std::move(out));
+}
+
+// istft(specs, N, hop[, win]) -> overlap-add of the first N samples of
+// ifft(specs[k]) * win at k * hop, into one buffer, normalised by the OLA
+// gain sum(win^2) / hop; a hop other than the analysis one stretches time
+static Value fn_istft(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() != 3 && args.size() != 4)
+        throw Error{I.filename, I.cur_line(), "istft: 3 or 4 args required (specs, N, hop[, window])"};
+    if (!std::holds_alternative<ArrayPtr>(args[0]))
+        throw Error{I.filename, I.cur_line(), "istft: spectra must be an array"};
+    const Array& specs = *std::get<ArrayPtr>(args[0]);
+    int N = (int)sig_scalar(args[1], "istft");
+    int hop = (int)sig_scalar(args[2], "istft");
+    if (N <= 0 || hop <= 0) throw Error{I.filename, I.cur_line(), "istft: N and hop must be positive"};
+    std::valarray<Real> win = stft_window(args, N, "istft", I);
+    int frames = (int)specs.size();
+    if (frames == 0) return NumVal(Real(0), 1);
+    if (specs.packed())
+        throw Error{I.filename, I.cur_line(), "istft: spectra must be vectors"};
+    for (int k = 0; k < frames; ++k) {
+        const NumVal& spec = sig_nvec(specs.at(k), "istft");
+        if (spec.size() % 2 != 0 || (int)spec.size() / 2 < N)
+            throw Error{I.filename, I.cur_line(), "istft: each spectrum needs at least 2 * N values"};
+    }
+    // Block b owns the output from its first frame up to the first frame
+    // of block b + 1; what its last frames write past that end goes to a
+    // tail of N - hop samples, added in once all blocks are done.
+    std::size_t len = (std::size_t)hop * (frames - 1) + N, over = N > hop ? N - hop : 0;
+    std::size_t blocks = std::min<std::size_t>(work_pool().size() + 1, frames / PAR_FRAMES_MIN);
+    blocks = std::max<std::size_t>(blocks, 1);
+    std::valarray<Real> out(Real(0), len);
+    std::vector<std::vector<Real>> tails(blocks);
+    sig_yield(I);
+    par_blocks(blocks, 1, [&](std::size_t b0, std::size_t b1) {
+        std::valarray<Real> H;
+        for (std::size_t b = b0; b < b1; ++b) {
+            std::size_t f0 = frames * b / blocks, f1 = frames * (b + 1) / blocks;
+            std::size_t end = b + 1 < blocks ? f1 * hop : len;
+            std::vector<Real>& tail = tails[b];
+            tail.assign(b + 1 < blocks ? over : 0, Real(0));
+            for (std::size_t k = f0; k < f1; ++k) {
+                const NumVal& spec = std::get<NumVal>(specs.at(k));
+                int Nfft = (int)spec.size() / 2;
+                if ((int)H.size() < Nfft + 2) H.resize(Nfft + 2);
+                real_inverse(&spec[0], Nfft, &H[0]);
+                std::size_t pos = k * hop;
+                for (int i = 0; i < N; ++i) {
+                    if (pos + i < end) out[pos + i] += H[i] * win[i];
+                    else tail[pos + i - end] += H[i] * win[i];
+                }
+            }
+        }
+    });
+    for (std::size_t b = 0; b + 1 < blocks; ++b) {
+        std::size_t end = frames * (b + 1) / blocks * hop;
+        for (std::size_t i = 0; i < tails[b].size() && end + i < len; ++i) out[end + i] += tails[b][i];
+    }
+    out *= Real(1) / ((win * win).sum() / hop);
     return NumVal(out);
 }
 
+// Applies convert(buf, bins) to a copy of one interleaved spectrum, or of
+// each spectrum of an array (e.g. as returned by stft)
+template <typename F>
+static Value convert_spectra(const Value& v, const char* name, Interpreter& I, F convert) {
+    auto one = [&](const NumVal& spec) {
+        if (spec.size() % 2 != 0)
+            throw Error{I.filename, I.cur_line(), std::string(name) + ": spectrum length must be even"};
+        NumVal r(spec);
+        if (r.size()) convert(&r[0], (int)r.size() / 2);
+        return r;
+    };
+    if (std::holds_alternative<NumVal>(v)) return one(std::get<NumVal>(v));
+    if (!std::holds_alternative<ArrayPtr>(v))
+        throw Error{I.filename, I.cur_line(), std::string(name) + ": expected a spectrum or an array of spectra"};
+    const Array& specs = *std::get<ArrayPtr>(v);
+    if (specs.packed() && specs.size())
+        throw Error{I.filename, I.cur_line(), std::string(name) + ": expected a spectrum or an array of spectra"};
+    std::vector<Value> out(specs.size());
+    sig_yield(I);
+    par_blocks(out.size(), PAR_FRAMES_MIN, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t k = lo; k < hi; ++k) out[k] = one(sig_nvec(specs.at(k), name));
+    });
+    return std::make_shared<Array>(std::move(out));
+}
+
 static Value fn_car2pol(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 1)
         throw Error{I.filename, I.cur_line(), "car2pol: 1 argument required"};
-    NumVal spec = std::get<NumVal>(args[0]);
-    if (spec.size() % 2 != 0)
-        throw Error{I.filename, I.cur_line(), "car2pol: spectrum length must be even"};
-    rect2pol(&spec[0], (int)spec.size() / 2);
-    return spec;
+    return convert_spectra(args[0], "car2pol", I, rect2pol<Real>);
 }
 
 static Value fn_pol2car(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 1)
         throw Error{I.filename, I.cur_line(), "pol2car: 1 argument required"};
-    NumVal spec = std::get<NumVal>(args[0]);
-    if (spec.size() % 2 != 0)
-        throw Error{I.filename, I.cur_line(), "pol2car: spectrum length must be even"};
-    pol2rect(&spec[0], (int)spec.size() / 2);
-    return spec;
+    return convert_spectra(args[0], "pol2car", I, pol2rect<Real>);
 }
 
 static Value fn_window(std::vector<Value>& args, Interpreter& I) {
@@ -296,11 +550,11 @@ static Value fn_interleave(std::vector<Value>& args, Interpreter& I) {
         a = packed_first(packed, "interleave");
         b = packed_second(packed, "interleave");
     } else if (std::holds_alternative<ArrayPtr>(args[0])) {
-        const auto& lst = std::get<ArrayPtr>(args[0])->elems;
+        const Array& lst = *std::get<ArrayPtr>(args[0]);
         if (lst.size() != 2)
             throw Error{I.filename, I.cur_line(), "interleave: legacy array must contain exactly 2 vectors"};
-        a = std::get<NumVal>(lst[0]);
-        b = std::get<NumVal>(lst[1]);
+        a = sig_nvec(lst.get(0), "interleave");
+        b = sig_nvec(lst.get(1), "interleave");
     } else {
         throw Error{I.filename, I.cur_line(), "interleave: argument must be packed vector or array of 2 vectors"};
     }
@@ -328,19 +582,73 @@ static Value fn_tail(std::vector<Value>& args, Interpreter& I) {
     return packed_second(sig_nvec(args[0], "tail"), "tail");
 }
 
-// Spectral features
+// Spectral features. Each descriptor also takes a matrix of amplitude
+// frames (one row per frame, e.g. the magnitudes of an stft) and returns
+// a vector with one value per frame, computed in parallel over blocks of
+// at least PAR_DESCR_MIN frames; scalar parameters may then be given per
+// frame as vectors.
+static constexpr std::size_t PAR_DESCR_MIN = 64;
+
+// Rows of a matrix of frames, each of the given length when len > 0
+static std::vector<const NumVal*> spec_rows(const Value& v, std::size_t len, const char* name, Interpreter& I) {
+    const Array& m = *std::get<ArrayPtr>(v);
+    if (m.packed() && m.size())
+        throw Error{I.filename, I.cur_line(), std::string(name) + ": expected a vector or a matrix of frames"};
+    std::vector<const NumVal*> rows(m.size());
+    for (std::size_t k = 0; k < rows.size(); ++k) {
+        rows[k] = &sig_nvec(m.at(k), name);
+        if (len && rows[k]->size() != len)
+            throw Error{I.filename, I.cur_line(), std::string(name) + ": amps and freqs must have same length"};
+        if (rows[k]->size() == 0)
+            throw Error{I.filename, I.cur_line(), std::string(name) + ": empty frame"};
+    }
+    return rows;
+}
+
+// A scalar parameter broadcast to n frames, or one value per frame
+static NumVal frame_param(const Value& v, std::size_t n, const char* name, Interpreter& I) {
+    const NumVal& p = sig_nvec(v, name);
+    if (p.size() == 1) return NumVal(p[0], n);
+    if (p.size() != n)
+        throw Error{I.filename, I.cur_line(), std::string(name) + ": expected a scalar or one value per frame"};
+    return p;
+}
+
+template <typename F>
+static Value per_frame(std::size_t n, Interpreter& I, F f) {
+    NumVal out(Real(0), n);
+    sig_yield(I);
+    par_blocks(n, PAR_DESCR_MIN, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t k = lo; k < hi; ++k) out[k] = f(k);
+    });
+    return out;
+}
+
 static Value fn_speccent(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 2) throw Error{I.filename, I.cur_line(), "speccent: 2 args required (amps, freqs)"};
-    const NumVal& amps = sig_nvec(args[0], "speccent");
     const NumVal& freqs = sig_nvec(args[1], "speccent");
+    if (std::holds_alternative<ArrayPtr>(args[0])) {
+        auto rows = spec_rows(args[0], freqs.size(), "speccent", I);
+        return per_frame(rows.size(), I, [&](std::size_t k) {
+            return speccentr<Real>(&(*rows[k])[0], &freqs[0], (int)freqs.size());
+        });
+    }
+    const NumVal& amps = sig_nvec(args[0], "speccent");
     if (amps.size() != freqs.size())
         throw Error{I.filename, I.cur_line(), "speccent: amps and freqs must have same length"};
     return NumVal{speccentr<Real>(&amps[0], &freqs[0], (int)amps.size())};
 }
 static Value fn_specspread(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 3) throw Error{I.filename, I.cur_line(), "specspread: 3 args required"};
-    const NumVal& amps = sig_nvec(args[0], "specspread");
     const NumVal& freqs = sig_nvec(args[1], "specspread");
+    if (std::holds_alternative<ArrayPtr>(args[0])) {
+        auto rows = spec_rows(args[0], freqs.size(), "specspread", I);
+        NumVal cent = frame_param(args[2], rows.size(), "specspread", I);
+        return per_frame(rows.size(), I, [&](std::size_t k) {
+            return specspread<Real>(&(*rows[k])[0], &freqs[0], cent[k], (int)freqs.size());
+        });
+    }
+    const NumVal& amps = sig_nvec(args[0], "specspread");
     Real centroid = sig_scalar(args[2], "specspread");
     if (amps.size() != freqs.size())
         throw Error{I.filename, I.cur_line(), "specspread: amps and freqs must have same length"};
@@ -348,8 +656,16 @@ static Value fn_specspread(std::vector<Value>& args, Interpreter& I) {
 }
 static Value fn_specskew(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 4) throw Error{I.filename, I.cur_line(), "specskew: 4 args required"};
-    const NumVal& amps = sig_nvec(args[0], "specskew");
     const NumVal& freqs = sig_nvec(args[1], "specskew");
+    if (std::holds_alternative<ArrayPtr>(args[0])) {
+        auto rows = spec_rows(args[0], freqs.size(), "specskew", I);
+        NumVal cent = frame_param(args[2], rows.size(), "specskew", I);
+        NumVal spread = frame_param(args[3], rows.size(), "specskew", I);
+        return per_frame(rows.size(), I, [&](std::size_t k) {
+            return specskew<Real>(&(*rows[k])[0], &freqs[0], cent[k], spread[k], (int)freqs.size());
+        });
+    }
+    const NumVal& amps = sig_nvec(args[0], "specskew");
     Real centroid = sig_scalar(args[2], "specskew");
     Real spread = sig_scalar(args[3], "specskew");
     if (amps.size() != freqs.size())
@@ -358,28 +674,60 @@ static Value fn_specskew(std::vector<Value>& args, Interpreter& I) {
 }
 static Value fn_speckurt(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 4) throw Error{I.filename, I.cur_line(), "speckurt: 4 args required"};
-    const NumVal& amps = sig_nvec(args[0], "speckurt");
     const NumVal& freqs = sig_nvec(args[1], "speckurt");
+    if (std::holds_alternative<ArrayPtr>(args[0])) {
+        auto rows = spec_rows(args[0], freqs.size(), "speckurt", I);
+        NumVal cent = frame_param(args[2], rows.size(), "speckurt", I);
+        NumVal spread = frame_param(args[3], rows.size(), "speckurt", I);
+        return per_frame(rows.size(), I, [&](std::size_t k) {
+            return speckurt<Real>(&(*rows[k])[0], &freqs[0], cent[k], spread[k], (int)freqs.size());
+        });
+    }
+    const NumVal& amps = sig_nvec(args[0], "speckurt");
     Real centroid = sig_scalar(args[2], "speckurt");
     Real spread = sig_scalar(args[3], "speckurt");
     if (amps.size() != freqs.size())
         throw Error{I.filename, I.cur_line(), "speckurt: amps and freqs must have same length"};
     return NumVal{speckurt<Real>(&amps[0], &freqs[0], centroid, spread, (int)amps.size())};
 }
+// specflux(frames) -> flux of each frame against the previous one (the
+// first against silence); specflux(amps, prev_amps) -> flux of one frame
 static Value fn_specflux(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() == 1 && std::holds_alternative<ArrayPtr>(args[0])) {
+        auto rows = spec_rows(args[0], 0, "specflux", I);
+        for (auto* r : rows)
+            if (r->size() != rows[0]->size())
+                throw Error{I.filename, I.cur_line(), "specflux: all frames must have the same length"};
+        NumVal silence(Real(0), rows.empty() ? 0 : rows[0]->size());
+        return per_frame(rows.size(), I, [&](std::size_t k) {
+            return specflux<Real>(&(*rows[k])[0], k ? &(*rows[k - 1])[0] : &silence[0], (int)rows[k]->size());
+        });
+    }
     if (args.size() != 2) throw Error{I.filename, I.cur_line(), "specflux: 2 args required (amps, prev_amps)"};
-    NumVal amps = std::get<NumVal>(args[0]);
-    NumVal oamps = std::get<NumVal>(args[1]);
+    const NumVal& amps = sig_nvec(args[0], "specflux");
+    const NumVal& oamps = sig_nvec(args[1], "specflux");
     if (amps.size() != oamps.size()) throw Error{I.filename, I.cur_line(), "specflux: amps and prev_amps must be same length"};
     return NumVal{specflux<Real>(&amps[0], &oamps[0], (int)amps.size())};
 }
 static Value fn_specirr(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 1) throw Error{I.filename, I.cur_line(), "specirr: 1 argument required"};
-    NumVal amps = std::get<NumVal>(args[0]);
+    if (std::holds_alternative<ArrayPtr>(args[0])) {
+        auto rows = spec_rows(args[0], 0, "specirr", I);
+        return per_frame(rows.size(), I, [&](std::size_t k) {
+            return specirr<Real>(&(*rows[k])[0], (int)rows[k]->size());
+        });
+    }
+    const NumVal& amps = sig_nvec(args[0], "specirr");
     return NumVal{specirr<Real>(&amps[0], (int)amps.size())};
 }
 static Value fn_specdecr(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 1) throw Error{I.filename, I.cur_line(), "specdecr: 1 argument required"};
+    if (std::holds_alternative<ArrayPtr>(args[0])) {
+        auto rows = spec_rows(args[0], 0, "specdecr", I);
+        return per_frame(rows.size(), I, [&](std::size_t k) {
+            return specdecr<Real>(&(*rows[k])[0], (int)rows[k]->size());
+        });
+    }
     const NumVal& amps = sig_nvec(args[0], "specdecr");
     return NumVal{specdecr<Real>(&amps[0], (int)amps.size())};
 }
@@ -409,27 +757,123 @@ static Value fn_conv(std::vector<Value>& args, Interpreter& I) {
     const NumVal& x = sig_nvec(args[0], "conv");
     const NumVal& y = sig_nvec(args[1], "conv");
     if (x.size() == 0 || y.size() == 0) throw Error{I.filename, I.cur_line(), "conv: empty signal"};
-    return NumVal(conv_one_channel(std::valarray<Real>(x), std::valarray<Real>(y)));
+    return NumVal(conv_one_channel(x, y));
 }
 
-// Leave multichannel API as Array-of-vectors for now (less hot-path than STFT internals)
+// pconv(sig, ir, block) -> same as conv, by uniformly partitioned
+// overlap-save: memory is bounded by the response and the block size
+static Value fn_pconv(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() != 3) throw Error{I.filename, I.cur_line(), "pconv: 3 arguments required (sig, ir, block)"};
+    const NumVal& x = sig_nvec(args[0], "pconv");
+    const NumVal& h = sig_nvec(args[1], "pconv");
+    Real block = sig_scalar(args[2], "pconv");
+    if (x.size() == 0 || h.size() == 0) throw Error{I.filename, I.cur_line(), "pconv: empty signal"};
+    if (block < 1 || block != std::floor(block))
+        throw Error{I.filename, I.cur_line(), "pconv: block must be a positive integer"};
+    sig_yield(I);
+    return NumVal(conv_blocked(UniformConvolver<Real>(&h[0], (long)h.size(), (long)block), x,
+                               x.size() + h.size() - 1));
+}
+
+// Streaming convolver returned by convolver(): each convolve() call takes
+// the next input samples and returns as many output samples. The engine
+// is not reentrant; `busy` makes a second concurrent caller (another
+// task, or an rtsound voice it is attached to) fail instead of racing.
+struct Convolver : Native {
+    Convolver(const Real* ir, long len, long block) : engine(ir, len, block) {}
+    const char* type_name() const override {
+        return "convolver";
+    }
+    PartitionedConvolver<Real> engine;
+    std::atomic<bool> busy{false};
+};
+
+// convolver(ir, block) -> convolver with a latency of `block` samples
+static Value fn_convolver(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() != 2) throw Error{I.filename, I.cur_line(), "convolver: 2 arguments required (ir, block)"};
+    const NumVal& h = sig_nvec(args[0], "convolver");
+    Real block = sig_scalar(args[1], "convolver");
+    if (h.size() == 0) throw Error{I.filename, I.cur_line(), "convolver: empty impulse response"};
+    if (block < 1 || block != std::floor(block))
+        throw Error{I.filename, I.cur_line(), "convolver: block must be a positive integer"};
+    return NativePtr{std::make_shared<Convolver>(&h[0], (long)h.size(), (long)block)};
+}
+
+// convolve(cv, x) -> the next len(x) output samples; len(x) must be a
+// multiple of the convolver's block
+static Value fn_convolve(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() != 2) throw Error{I.filename, I.cur_line(), "convolve: 2 arguments required (convolver, sig)"};
+    auto* cv = native_cast<Convolver>(args[0]);
+    if (!cv) throw Error{I.filename, I.cur_line(), "convolve: first argument must be a convolver"};
+    const NumVal& x = sig_nvec(args[1], "convolve");
+    std::size_t B = (std::size_t)cv->engine.block();
+    if (x.size() % B != 0)
+        throw Error{I.filename, I.cur_line(), "convolve: input length must be a multiple of the block size"};
+    if (cv->busy.exchange(true))
+        throw Error{I.filename, I.cur_line(), "convolve: convolver is in use elsewhere"};
+    NumVal y(x);
+    for (std::size_t pos = 0; pos < y.size(); pos += B) cv->engine.process(&y[pos], &y[pos]);
+    cv->busy = false;
+    return y;
+}
+
+// convmc(xs, ys): channel i convolves xs[i] with ys[i], the last vector
+// of the shorter list standing in for the missing ones. Channels run in
+// parallel; a vector broadcast this way is transformed only once when it
+// is the kernel: its spectrum per transform size, or its partition
+// spectra per block, are shared by all the channels using it.
 static Value fn_convmc(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 2) throw Error{I.filename, I.cur_line(), "convmc: 2 arguments required"};
     if (!std::holds_alternative<ArrayPtr>(args[0]) || !std::holds_alternative<ArrayPtr>(args[1]))
         throw Error{I.filename, I.cur_line(), "convmc: arguments must be arrays of vectors"};
-    const auto& matx = std::get<ArrayPtr>(args[0])->elems;
-    const auto& maty = std::get<ArrayPtr>(args[1])->elems;
+    const Array& matx = *std::get<ArrayPtr>(args[0]);
+    const Array& maty = *std::get<ArrayPtr>(args[1]);
     int nx = (int)matx.size(), ny = (int)maty.size();
     if (nx == 0 || ny == 0) throw Error{I.filename, I.cur_line(), "convmc: empty channel list"};
+    // packed lists hold one-sample channels: read them through a copy
+    std::vector<Value> px, py;
+    if (matx.packed()) px = matx.values();
+    if (maty.packed()) py = maty.values();
     int max_ch = std::max(nx, ny);
-    auto out = std::make_shared<Array>();
+    std::vector<const NumVal*> xs(max_ch), ys(max_ch);
     for (int i = 0; i < max_ch; ++i) {
-        sig_yield(I);
-        const NumVal& xch = sig_nvec(matx[i < nx ? i : nx-1], "convmc");
-        const NumVal& ych = sig_nvec(maty[i < ny ? i : ny-1], "convmc");
-        out->elems.push_back(NumVal(conv_one_channel(std::valarray<Real>(xch), std::valarray<Real>(ych))));
+        int ix = i < nx ? i : nx-1, iy = i < ny ? i : ny-1;
+        xs[i] = &sig_nvec(matx.packed() ? px[ix] : matx.at(ix), "convmc");
+        ys[i] = &sig_nvec(maty.packed() ? py[iy] : maty.at(iy), "convmc");
     }
-    return out;
+
+    const NumVal* shared = ny < max_ch ? ys[ny-1] : nx < max_ch ? xs[nx-1] : nullptr;
+    std::vector<ConvChoice> choice(max_ch, ConvChoice{CONV_DIRECT, 0, 0});
+    std::vector<const NumVal*> other(max_ch, nullptr);
+    std::map<long, std::vector<Real>> spectra;
+    std::map<long, std::unique_ptr<UniformConvolver<Real>>> blocked;
+    for (int i = 0; shared && i < max_ch; ++i) {
+        const NumVal* o = xs[i] == shared ? ys[i] : ys[i] == shared ? xs[i] : nullptr;
+        if (!o || o->size() == 0 || shared->size() == 0 || shared->size() > o->size()) continue;
+        other[i] = o;
+        choice[i] = conv_choose((long)o->size(), (long)shared->size());
+        if (choice[i].method == CONV_FFT && !spectra.count(choice[i].size))
+            spectra[choice[i].size] = conv_spectrum(*shared, (int)choice[i].size);
+        if (choice[i].method == CONV_BLOCKED && !blocked.count(choice[i].size))
+            blocked[choice[i].size].reset(
+                new UniformConvolver<Real>(&(*shared)[0], (long)shared->size(), choice[i].size));
+    }
+
+    std::vector<Value> out(max_ch);
+    sig_yield(I);
+    par_blocks(max_ch, 1, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i) {
+            const NumVal* o = other[i];
+            if (!o || choice[i].method == CONV_DIRECT) {
+                out[i] = NumVal(conv_one_channel(*xs[i], *ys[i]));
+                continue;
+            }
+            std::size_t len = o->size() + shared->size() - 1;
+            if (choice[i].method == CONV_BLOCKED) out[i] = NumVal(conv_blocked(*blocked.at(choice[i].size), *o, len));
+            else out[i] = NumVal(conv_fft(*o, shared->size(), (int)choice[i].size, spectra.at(choice[i].size)));
+        }
+    });
+    return std::make_shared<Array>(std::move(out));
 }
 
 // Vector ops
@@ -505,34 +949,103 @@ static Value fn_reson(std::vector<Value>& args, Interpreter& I) {
     return NumVal(out);
 }
 
-// filter(x, coeffs) or filter(x, b, a)
+// Direct form I filter with normalized bn, an: the first max(Nb, Na) - 1
+// samples check the history bounds, the rest run without branches
+static void direct_filter(const NumVal& x, const std::valarray<Real>& bn, const std::valarray<Real>& an,
+                          Real* y, Interpreter& I) {
+    long N = (long)x.size(), Nb = (long)bn.size(), Na = (long)an.size();
+    long warm = std::min(N, std::max(Nb, Na) - 1);
+    for (long n = 0; n < warm; ++n) {
+        Real acc = 0;
+        for (long k = 0; k < Nb; ++k) if (n-k >= 0) acc += bn[k] * x[n-k];
+        for (long k = 1; k < Na; ++k) if (n-k >= 0) acc -= an[k] * y[n-k];
+        y[n] = acc;
+    }
+    const Real* b = &bn[0];
+    const Real* a = &an[0];
+    for (long pos = warm; pos < N; pos += 512) {
+        sig_yield(I);
+        long end = std::min(N, pos + 512);
+        for (long n = pos; n < end; ++n) {
+            const Real* xn = &x[n];
+            const Real* yn = y + n;
+            Real acc = 0;
+            for (long k = 0; k < Nb; ++k) acc += b[k] * xn[-k];
+            for (long k = 1; k < Na; ++k) acc -= a[k] * yn[-k];
+            y[n] = acc;
+        }
+    }
+}
+
+// filter(x, coeffs) runs a cascade of biquads, coeffs as filtdesign returns
+// them (one section, several concatenated, or an array of sections);
+// filter(x, b, a) any direct form filter. x may be an array of channels.
 static Value fn_filter(std::vector<Value>& args, Interpreter& I) {
     if (args.size() != 2 && args.size() != 3)
         throw Error{I.filename, I.cur_line(), "filter: 2 or 3 args required (sig, coeffs) or (sig, b, a)"};
-    const NumVal& x = sig_nvec(args[0], "filter");
-    std::valarray<Real> b, a;
+    bool multi = std::holds_alternative<ArrayPtr>(args[0]);
+    std::vector<const NumVal*> xs;
+    if (multi) {
+        // numbers are packed: an array of them is a signal mistyped, not channels
+        const Array& arr = *std::get<ArrayPtr>(args[0]);
+        if (arr.packed())
+            throw Error{I.filename, I.cur_line(), "filter: signal must be a vector or an array of vectors"};
+        for (std::size_t i = 0; i < arr.size(); ++i) xs.push_back(&sig_nvec(arr.at(i), "filter"));
+    } else {
+        xs.push_back(&sig_nvec(args[0], "filter"));
+    }
+    int nch = (int)xs.size();
+    std::vector<std::valarray<Real>> ys(nch);
+    for (int ch = 0; ch < nch; ++ch) ys[ch].resize(xs[ch]->size());
+
     if (args.size() == 2) {
-        const NumVal& coeffs = sig_nvec(args[1], "filter");
-        unpack_biquad_coeffs(coeffs, b, a, "filter");
+        std::vector<Real> c = unpack_sos_coeffs(args[1], "filter");
+        int ns = (int)c.size() / 5;
+        // channels run together up to the shortest, then each on its own
+        long common = (long)xs[0]->size();
+        for (int ch = 1; ch < nch; ++ch) common = std::min(common, (long)xs[ch]->size());
+        std::vector<std::vector<Real>> zs(nch, std::vector<Real>(2 * ns, Real(0)));
+        std::vector<Real*> z(nch), y(nch);
+        std::vector<const Real*> x(nch);
+        for (int ch = 0; ch < nch; ++ch) {
+            z[ch] = zs[ch].data();
+            x[ch] = std::begin(*xs[ch]);
+            y[ch] = std::begin(ys[ch]);
+        }
+        const long chunk = 16384;
+        for (long pos = 0; pos < common; pos += chunk) {
+            sig_yield(I);
+            long len = std::min(chunk, common - pos);
+            sos_filter<Real>(&c[0], ns, &z[0], &x[0], &y[0], nch, len);
+            for (int ch = 0; ch < nch; ++ch) {
+                x[ch] += len;
+                y[ch] += len;
+            }
+        }
+        for (int ch = 0; ch < nch; ++ch) {
+            for (long pos = common; pos < (long)xs[ch]->size(); pos += chunk) {
+                sig_yield(I);
+                long len = std::min(chunk, (long)xs[ch]->size() - pos);
+                sos_filter<Real>(&c[0], ns, &z[ch], &x[ch], &y[ch], 1, len);
+                x[ch] += len;
+                y[ch] += len;
+            }
+        }
     } else {
-        b = std::valarray<Real>(sig_nvec(args[1], "filter"));
-        a = std::valarray<Real>(sig_nvec(args[2], "filter"));
-    }
-    if (b.size() == 0) throw Error{I.filename, I.cur_line(), "filter: b must be non-empty"};
-    if (a.size() == 0) throw Error{I.filename, I.cur_line(), "filter: a must be non-empty"};
-    Real a0 = a[0];
-    if (a0 == Real(0)) throw Error{I.filename, I.cur_line(), "filter: a[0] cannot be zero"};
-    std::valarray<Real> bn = b / a0, an = a / a0;
-    int N = (int)x.size(), Nb = (int)bn.size(), Na = (int)an.size();
-    std::valarray<Real> y(Real(0), N);
-    for (int n = 0; n < N; ++n) {
-        if ((n & 511) == 0) sig_yield(I);
-        Real acc = 0;
-        for (int k = 0; k < Nb; ++k) if (n-k >= 0) acc += bn[k] * x[n-k];
-        for (int k = 1; k < Na; ++k) if (n-k >= 0) acc -= an[k] * y[n-k];
-        y[n] = acc;
+        std::valarray<Real> b(sig_nvec(args[1], "filter")), a(sig_nvec(args[2], "filter"));
+        if (b.size() == 0) throw Error{I.filename, I.cur_line(), "filter: b must be non-empty"};
+        if (a.size() == 0) throw Error{I.filename, I.cur_line(), "filter: a must be non-empty"};
+        Real a0 = a[0];
+        if (a0 == Real(0)) throw Error{I.filename, I.cur_line(), "filter: a[0] cannot be zero"};
+        std::valarray<Real> bn = b / a0, an = a / a0;
+        for (int ch = 0; ch < nch; ++ch)
+            if (xs[ch]->size()) direct_filter(*xs[ch], bn, an, &ys[ch][0], I);
     }
-    return NumVal(y);
+
+    if (!multi) return NumVal(std::move(ys[0]));
+    std::vector<Value> out;
+    for (auto& y : ys) out.push_back(NumVal(std::move(y)));
+    return std::make_shared<Array>(std::move(out));
 }
 
 // filtdesign(type, Fs, f0, Q, gain_db) -> packed NumVal [b0 b1 b2 1 a1 a2]
@@ -674,12 +1187,73 @@ static Value fn_resample(std::vector<Value>& args, Interpreter& I) {
     return NumVal(fd_resample(std::valarray<Real>(x), factor));
 }
 
+// stftstream(src, N, hop) -> generator of spectra, one frame per pull,
+// identical to the frames of stft(): the fft of each full Hann-windowed
+// frame. src is a vector or a generator of blocks (vectors, or arrays of
+// channels whose first channel is used), so wavstream() output can be
+// analysed in constant memory.
+struct StftStream : Generator {
+    Value               src;
+    int                 N, hop, Nfft;
+    std::valarray<Real> win;
+    std::vector<Real>   buf;
+    std::size_t         head = 0;      // start of the next frame in buf
+    bool                drained = false;
+
+    StftStream(Value s, int n, int h) : src(std::move(s)), N(n), hop(h), Nfft(next_pow2(n)), win(n) {
+        make_window(&win[0], N, Real(0.5), Real(0.5), Real(0));
+    }
+    bool refill(Interpreter& I) {
+        if (drained) return false;
+        if (auto* v = std::get_if<NumVal>(&src)) {
+            buf.insert(buf.end(), std::begin(*v), std::end(*v));
+            drained = true;
+            return true;
+        }
+        Value block;
+        if (!native_cast<Generator>(src)->pull(block, I)) {
+            drained = true;
+            return false;
+        }
+        if (auto* a = std::get_if<ArrayPtr>(&block); a && !(*a)->empty()) block = (*a)->get(0);
+        const NumVal& x = sig_nvec(block, "stftstream");
+        if (head >= 65536 && head <= buf.size()) {
+            buf.erase(buf.begin(), buf.begin() + head);
+            head = 0;
+        }
+        buf.insert(buf.end(), std::begin(x), std::end(x));
+        return true;
+    }
+    bool pull(Value& out, Interpreter& I) override {
+        while (buf.size() < head + N)
+            if (!refill(I)) return false;
+        out = stft_frame(&buf[head], win, N, Nfft);
+        head += hop;
+        return true;
+    }
+};
+
+static Value fn_stftstream(std::vector<Value>& args, Interpreter& I) {
+    if (args.size() != 3)
+        throw Error{I.filename, I.cur_line(), "stftstream: 3 args required (src, N, hop)"};
+    if (!std::holds_alternative<NumVal>(args[0]) && !native_cast<Generator>(args[0]))
+        throw Error{I.filename, I.cur_line(), "stftstream: source must be a vector or a generator"};
+    int N = (int)sig_scalar(args[1], "stftstream");
+    int hop = (int)sig_scalar(args[2], "stftstream");
+    if (N <= 0 || hop <= 0) throw Error{I.filename, I.cur_line(), "stftstream: N and hop must be positive"};
+    return NativePtr{std::make_shared<StftStream>(args[0], N, hop)};
+}
+
 inline void add_signals(Environment& env) {
     env.register_builtin("mix",          fn_mix);
     env.register_builtin("gen",          fn_gen);
     env.register_builtin("osc",          fn_osc);
     env.register_builtin("fft",          fn_fft);
     env.register_builtin("ifft",         fn_ifft);
+    env.register_builtin("rfft",         fn_rfft);
+    env.register_builtin("irfft",        fn_irfft);
+    env.register_builtin("stft",         fn_stft);
+    env.register_builtin("istft",        fn_istft);
     env.register_builtin("car2pol",      fn_car2pol);
     env.register_builtin("pol2car",      fn_pol2car);
     env.register_builtin("window",       fn_window);
@@ -694,6 +1268,9 @@ inline void add_signals(Environment& env) {
     env.register_builtin("energy",       fn_energy);
     env.register_builtin("zcr",          fn_zcr);
     env.register_builtin("conv",         fn_conv);
+    env.register_builtin("pconv",        fn_pconv);
+    env.register_builtin("convolver",    fn_convolver);
+    env.register_builtin("convolve",     fn_convolve);
     env.register_builtin("convmc",       fn_convmc);
     env.register_builtin("deinterleave", fn_deinterleave);
     env.register_builtin("interleave",   fn_interleave);
@@ -709,6 +1286,7 @@ inline void add_signals(Environment& env) {
     env.register_builtin("comb",         fn_comb);
     env.register_builtin("allpass",      fn_allpass);
     env.register_builtin("resample",     fn_resample);
+    env.register_builtin("stftstream",   fn_stftstream);
 }
 
 #endif // SIGNALS_H
@@ -20,8 +20,14 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <type_traits>
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 
 //! Peak representation
 template <typename T>
@@ -349,8 +355,11 @@ template <typename T>
 		}
 }
 
+//! Radix-2 kernel with recurrence twiddles, power-of-two sizes only; other
+//! sizes go through MixedFFTPlan or Bluestein. Kept as the table-free
+//! reference that bench/fft_bench measures the planned kernels against
 template <typename T>
-void fft (T *fftBuffer, long fftFrameSize, long sign) {
+void fft_unplanned (T *fftBuffer, long fftFrameSize, long sign) {
 	T wr, wi, arg, *p1, *p2, temp;
 	T tr, ti, ur, ui, *p1r, *p1i, *p2r, *p2i;
 	long i, bitm, j, le, le2, k;
@@ -406,6 +415,890 @@ void fft (T *fftBuffer, long fftFrameSize, long sign) {
 	}
 }
 
+//! Butterfly kernels, best first. The SIMD kernels work on double only and
+//! are chosen at runtime from the CPU; fft_set_kernel () forces a kernel
+//! (clamped to what the CPU supports), e.g. to validate against RADIX2.
+enum FFTKernel { FFT_RADIX2, FFT_RADIX4, FFT_SSE2, FFT_AVX2 };
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+	#define FFT_X86_SIMD
+	#include <immintrin.h>
+#endif
+
+inline FFTKernel fft_best_kernel () {
+#ifdef FFT_X86_SIMD
+	static const FFTKernel best = __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")
+		? FFT_AVX2 : FFT_SSE2;
+	return best;
+#else
+	return FFT_RADIX4;
+#endif
+}
+
+inline std::atomic<int>& fft_kernel_setting () {
+	static std::atomic<int> k {-1};
+	return k;
+}
+
+inline FFTKernel fft_kernel () {
+	int k = fft_kernel_setting ().load (std::memory_order_relaxed);
+	return k < 0 ? fft_best_kernel () : (FFTKernel) k;
+}
+
+inline void fft_set_kernel (FFTKernel k) {
+	fft_kernel_setting ().store (std::min ((int) k, (int) fft_best_kernel ()));
+}
+
+inline const char* fft_kernel_name (FFTKernel k) {
+	static const char* names[] = {"radix-2", "radix-4", "sse2", "avx2"};
+	return names[k];
+}
+
+//! Radix-2 stage of half-size m over bit-reversed data; the twiddle of
+//! butterfly j is tab[j % len] turned by -i (+i inverse) per wrap
+template <typename T, bool INV>
+void fft_pass2 (T* d, long N, long m, const T* tab, long len) {
+	for (long k = 0; k < N; k += 2 * m) {
+		T* a = d + 2 * k;
+		T* b = a + 2 * m;
+		for (long j = 0; j < m; ++j) {
+			T wr = 1, wi = 0;
+			if (tab) {
+				wr = tab[2 * (j % len)];
+				wi = INV ? -tab[2 * (j % len) + 1] : tab[2 * (j % len) + 1];
+				if (j >= len) {
+					T t = wr;
+					wr = INV ? -wi : wi;
+					wi = INV ? t : -t;
+				}
+			}
+			T tr = b[2 * j] * wr - b[2 * j + 1] * wi;
+			T ti = b[2 * j] * wi + b[2 * j + 1] * wr;
+			b[2 * j] = a[2 * j] - tr;
+			b[2 * j + 1] = a[2 * j + 1] - ti;
+			a[2 * j] += tr;
+			a[2 * j + 1] += ti;
+		}
+	}
+}
+
+//! Two radix-2 stages (m and 2m) fused into one radix-4 pass: W holds
+//! exp(-i pi j / m) and V exp(-i pi j / 2m) for j < m
+template <typename T, bool INV>
+void fft_pass4 (T* d, long N, long m, const T* W, const T* V) {
+	for (long k = 0; k < N; k += 4 * m) {
+		T* p0 = d + 2 * k;
+		T* p1 = p0 + 2 * m;
+		T* p2 = p1 + 2 * m;
+		T* p3 = p2 + 2 * m;
+		for (long j = 0; j < 2 * m; j += 2) {
+			T wr = W[j], wi = INV ? -W[j + 1] : W[j + 1];
+			T vr = V[j], vi = INV ? -V[j + 1] : V[j + 1];
+			T t1r = p1[j] * wr - p1[j + 1] * wi, t1i = p1[j] * wi + p1[j + 1] * wr;
+			T t3r = p3[j] * wr - p3[j + 1] * wi, t3i = p3[j] * wi + p3[j + 1] * wr;
+			T y0r = p0[j] + t1r, y0i = p0[j + 1] + t1i;
+			T y1r = p0[j] - t1r, y1i = p0[j + 1] - t1i;
+			T y2r = p2[j] + t3r, y2i = p2[j + 1] + t3i;
+			T y3r = p2[j] - t3r, y3i = p2[j + 1] - t3i;
+			T u2r = y2r * vr - y2i * vi, u2i = y2r * vi + y2i * vr;
+			T u3r = y3r * vr - y3i * vi, u3i = y3r * vi + y3i * vr;
+			T r3r = INV ? -u3i : u3i, r3i = INV ? u3r : -u3r;
+			p0[j] = y0r + u2r; p0[j + 1] = y0i + u2i;
+			p2[j] = y0r - u2r; p2[j + 1] = y0i - u2i;
+			p1[j] = y1r + r3r; p1[j + 1] = y1i + r3i;
+			p3[j] = y1r - r3r; p3[j + 1] = y1i - r3i;
+		}
+	}
+}
+
+#ifdef FFT_X86_SIMD
+//! one complex double per register
+template <bool INV>
+inline __m128d fft_cmul_sse2 (__m128d a, __m128d w) {
+	__m128d wr = _mm_unpacklo_pd (w, w), wi = _mm_unpackhi_pd (w, w);
+	__m128d t = _mm_mul_pd (_mm_shuffle_pd (a, a, 1), wi);
+	const __m128d sign = INV ? _mm_set_pd (-0.0, 0.0) : _mm_set_pd (0.0, -0.0);
+	return _mm_add_pd (_mm_mul_pd (a, wr), _mm_xor_pd (t, sign));
+}
+
+template <bool INV>
+void fft_pass4_sse2 (double* d, long N, long m, const double* W, const double* V) {
+	const __m128d rot = INV ? _mm_set_pd (0.0, -0.0) : _mm_set_pd (-0.0, 0.0);
+	for (long k = 0; k < N; k += 4 * m) {
+		double* p0 = d + 2 * k;
+		double* p1 = p0 + 2 * m;
+		double* p2 = p1 + 2 * m;
+		double* p3 = p2 + 2 * m;
+		for (long j = 0; j < 2 * m; j += 2) {
+			__m128d w = _mm_loadu_pd (W + j), v = _mm_loadu_pd (V + j);
+			__m128d x0 = _mm_loadu_pd (p0 + j), x2 = _mm_loadu_pd (p2 + j);
+			__m128d t1 = fft_cmul_sse2<INV> (_mm_loadu_pd (p1 + j), w);
+			__m128d t3 = fft_cmul_sse2<INV> (_mm_loadu_pd (p3 + j), w);
+			__m128d y0 = _mm_add_pd (x0, t1), y1 = _mm_sub_pd (x0, t1);
+			__m128d u2 = fft_cmul_sse2<INV> (_mm_add_pd (x2, t3), v);
+			__m128d u3 = fft_cmul_sse2<INV> (_mm_sub_pd (x2, t3), v);
+			u3 = _mm_xor_pd (_mm_shuffle_pd (u3, u3, 1), rot);
+			_mm_storeu_pd (p0 + j, _mm_add_pd (y0, u2));
+			_mm_storeu_pd (p2 + j, _mm_sub_pd (y0, u2));
+			_mm_storeu_pd (p1 + j, _mm_add_pd (y1, u3));
+			_mm_storeu_pd (p3 + j, _mm_sub_pd (y1, u3));
+		}
+	}
+}
+
+//! two complex doubles per register; needs m >= 2
+template <bool INV>
+__attribute__ ((target ("avx2,fma")))
+inline __m256d fft_cmul_avx2 (__m256d a, __m256d w) {
+	__m256d t = _mm256_mul_pd (_mm256_permute_pd (a, 0x5), _mm256_permute_pd (w, 0xF));
+	return INV ? _mm256_fmsubadd_pd (a, _mm256_movedup_pd (w), t)
+		: _mm256_fmaddsub_pd (a, _mm256_movedup_pd (w), t);
+}
+
+template <bool INV>
+__attribute__ ((target ("avx2,fma")))
+void fft_pass4_avx2 (double* d, long N, long m, const double* W, const double* V) {
+	const __m256d rot = INV ? _mm256_set_pd (0.0, -0.0, 0.0, -0.0) : _mm256_set_pd (-0.0, 0.0, -0.0, 0.0);
+	for (long k = 0; k < N; k += 4 * m) {
+		double* p0 = d + 2 * k;
+		double* p1 = p0 + 2 * m;
+		double* p2 = p1 + 2 * m;
+		double* p3 = p2 + 2 * m;
+		for (long j = 0; j < 2 * m; j += 4) {
+			__m256d w = _mm256_loadu_pd (W + j), v = _mm256_loadu_pd (V + j);
+			__m256d x0 = _mm256_loadu_pd (p0 + j), x2 = _mm256_loadu_pd (p2 + j);
+			__m256d t1 = fft_cmul_avx2<INV> (_mm256_loadu_pd (p1 + j), w);
+			__m256d t3 = fft_cmul_avx2<INV> (_mm256_loadu_pd (p3 + j), w);
+			__m256d y0 = _mm256_add_pd (x0, t1), y1 = _mm256_sub_pd (x0, t1);
+			__m256d u2 = fft_cmul_avx2<INV> (_mm256_add_pd (x2, t3), v);
+			__m256d u3 = fft_cmul_avx2<INV> (_mm256_sub_pd (x2, t3), v);
+			u3 = _mm256_xor_pd (_mm256_permute_pd (u3, 0x5), rot);
+			_mm256_storeu_pd (p0 + j, _mm256_add_pd (y0, u2));
+			_mm256_storeu_pd (p2 + j, _mm256_sub_pd (y0, u2));
+			_mm256_storeu_pd (p1 + j, _mm256_add_pd (y1, u3));
+			_mm256_storeu_pd (p3 + j, _mm256_sub_pd (y1, u3));
+		}
+	}
+}
+#endif
+
+//! Sizes from this one up run as four-step transforms (sqrt(N)-sized FFTs
+//! over columns and rows, then a transpose), so every sub-transform stays in
+//! cache. In-place passes keep winning for as long as the data fits in the
+//! last-level cache and TLB; lower this on machines with small caches.
+#ifndef FFT_FOUR_STEP_MIN
+	#define FFT_FOUR_STEP_MIN 4194304
+#endif
+
+//! Precomputed tables for one power-of-two size. In place: the bit reversal
+//! split in two half-width tables, and per radix-4 pass the twiddles of its
+//! two stages, contiguous and computed directly in double precision.
+//! Four-step: the plans of the two factors and the twiddles
+//! exp(-2 pi i t / N) split as coarse[t >> fine_bits] * fine[t & mask].
+template <typename T>
+struct FFTPlan {
+	explicit FFTPlan (long n) : FFTPlan (n, n >= FFT_FOUR_STEP_MIN) {}
+	FFTPlan (long n, bool four_step) : N (n) {
+		int bits = 0;
+		while ((1L << bits) < N) ++bits;
+		if (four_step && bits >= 8) {
+			n1 = 1L << (bits / 2);
+			n2 = N / n1;
+			rows1 = std::make_shared<const FFTPlan<T> > (n1);   // columns
+			rows2 = std::make_shared<const FFTPlan<T> > (n2);   // rows
+			fine_bits = bits / 2;
+			fine = roots (1L << fine_bits, 1, N);
+			coarse = roots (N >> fine_bits, 1L << fine_bits, N);
+			return;
+		}
+		lo_bits = bits / 2;
+		hi_bits = bits - lo_bits;
+		rev_lo = reverse_table (lo_bits);
+		rev_hi = reverse_table (hi_bits);
+		long m = 1;
+		if (bits & 1) {
+			passes.push_back (Pass {1, 2, 0, 0});
+			m = 2;
+		}
+		for (; m < N; m *= 4) {
+			Pass p {m, 4, (long) twiddle.size (), (long) twiddle.size () + 2 * m};
+			std::vector<T> w = roots (m, N / (2 * m), N), v = roots (m, N / (4 * m), N);
+			twiddle.insert (twiddle.end (), w.begin (), w.end ());
+			twiddle.insert (twiddle.end (), v.begin (), v.end ());
+			passes.push_back (p);
+		}
+	}
+	//! exp(-2 pi i k step / n) for k < count, interleaved
+	static std::vector<T> roots (long count, long step, long n) {
+		std::vector<T> r (2 * count);
+		for (long k = 0; k < count; ++k) {
+			double a = -TWOPI * (double) ((k * step) % n) / (double) n;
+			r[2 * k] = (T) std::cos (a);
+			r[2 * k + 1] = (T) std::sin (a);
+		}
+		return r;
+	}
+	static std::vector<uint32_t> reverse_table (int bits) {
+		std::vector<uint32_t> t (1u << bits, 0);
+		for (uint32_t i = 1; i < t.size (); ++i) {
+			t[i] = (t[i >> 1] >> 1) | ((i & 1u) << (bits - 1));
+		}
+		return t;
+	}
+	uint32_t reverse (uint32_t i) const {
+		return (rev_lo[i & ((1u << lo_bits) - 1)] << hi_bits) | rev_hi[i >> lo_bits];
+	}
+	//! in-place transform of N interleaved complex values; sign -1 forward,
+	//! +1 inverse (unscaled), as fft ()
+	void execute (T* data, long sign, FFTKernel kernel = fft_kernel ()) const {
+		if (sign < 0) run<false> (data, kernel);
+		else run<true> (data, kernel);
+	}
+	bool four_step () const {
+		return n1 != 0;
+	}
+	std::size_t bytes () const {
+		std::size_t b = sizeof (*this) + (rev_lo.size () + rev_hi.size ()) * sizeof (uint32_t)
+			+ (twiddle.size () + fine.size () + coarse.size ()) * sizeof (T);
+		if (rows1) b += rows1->bytes () + rows2->bytes ();
+		return b;
+	}
+
+	struct Pass {
+		long m;
+		int radix;
+		long w, v;    // offsets in twiddle
+	};
+
+	long N;
+	int lo_bits = 0, hi_bits = 0;
+	std::vector<uint32_t> rev_lo, rev_hi;
+	std::vector<Pass> passes;
+	std::vector<T> twiddle;
+
+	long n1 = 0, n2 = 0;
+	std::shared_ptr<const FFTPlan<T> > rows1, rows2;
+	int fine_bits = 0;
+	std::vector<T> fine, coarse;
+
+private:
+	template <bool INV>
+	void run (T* data, FFTKernel kernel) const {
+		if (four_step ()) {
+			run_four_step<INV> (data, kernel);
+			return;
+		}
+		for (uint32_t i = 1; i + 1 < (uint32_t) N; ++i) {
+			uint32_t j = reverse (i);
+			if (i < j) {
+				std::swap (data[2 * i], data[2 * j]);
+				std::swap (data[2 * i + 1], data[2 * j + 1]);
+			}
+		}
+		const T* tw = twiddle.data ();
+		for (const Pass& p : passes) {
+			if (p.radix == 2) {
+				fft_pass2<T, INV> (data, N, 1, nullptr, 1);
+			} else if (kernel == FFT_RADIX2) {
+				fft_pass2<T, INV> (data, N, p.m, p.m > 1 ? tw + p.w : nullptr, p.m);
+				fft_pass2<T, INV> (data, N, 2 * p.m, tw + p.v, p.m);
+			} else {
+				pass4<INV> (data, p, kernel);
+			}
+		}
+	}
+	template <bool INV>
+	void pass4 (T* data, const Pass& p, FFTKernel kernel) const {
+		const T* tw = twiddle.data ();
+#ifdef FFT_X86_SIMD
+		if constexpr (std::is_same<T, double>::value) {
+			if (kernel == FFT_AVX2 && p.m >= 2) {
+				fft_pass4_avx2<INV> (data, N, p.m, tw + p.w, tw + p.v);
+				return;
+			}
+			if (kernel >= FFT_SSE2) {
+				fft_pass4_sse2<INV> (data, N, p.m, tw + p.w, tw + p.v);
+				return;
+			}
+		}
+#endif
+		fft_pass4<T, INV> (data, N, p.m, tw + p.w, tw + p.v);
+	}
+	// x as n1 rows of n2: FFT each column (gathered in batches of 8), scale
+	// by exp(-2 pi i col row / N), FFT each row in place, then transpose
+	template <bool INV>
+	void run_four_step (T* data, FFTKernel kernel) const {
+		const long B = 8;
+		const long mask = (1L << fine_bits) - 1;
+		std::vector<T> tmp (2 * B * n1);
+		for (long c0 = 0; c0 < n2; c0 += B) {
+			for (long r = 0; r < n1; ++r) {
+				const T* src = data + 2 * (r * n2 + c0);
+				for (long b = 0; b < B; ++b) {
+					tmp[2 * (b * n1 + r)] = src[2 * b];
+					tmp[2 * (b * n1 + r) + 1] = src[2 * b + 1];
+				}
+			}
+			for (long b = 0; b < B; ++b) {
+				T* col = tmp.data () + 2 * b * n1;
+				rows1->execute (col, INV ? 1 : -1, kernel);
+				for (long k = 1, t = c0 + b; k < n1; ++k, t += c0 + b) {
+					const T* c = &coarse[2 * (t >> fine_bits)];
+					const T* f = &fine[2 * (t & mask)];
+					T wr = c[0] * f[0] - c[1] * f[1];
+					T wi = c[0] * f[1] + c[1] * f[0];
+					if (INV) wi = -wi;
+					T xr = col[2 * k], xi = col[2 * k + 1];
+					col[2 * k] = xr * wr - xi * wi;
+					col[2 * k + 1] = xr * wi + xi * wr;
+				}
+			}
+			for (long r = 0; r < n1; ++r) {
+				T* dst = data + 2 * (r * n2 + c0);
+				for (long b = 0; b < B; ++b) {
+					dst[2 * b] = tmp[2 * (b * n1 + r)];
+					dst[2 * b + 1] = tmp[2 * (b * n1 + r) + 1];
+				}
+			}
+		}
+		for (long r = 0; r < n1; ++r) rows2->execute (data + 2 * r * n2, INV ? 1 : -1, kernel);
+		if (n1 == n2) {
+			transpose_square (data, n1);
+		} else {
+			std::unique_ptr<T[]> buf (new T[2 * N]);
+			transpose (data, buf.get (), n1, n2);
+			std::copy (buf.get (), buf.get () + 2 * N, data);
+		}
+	}
+	//! blocked out-of-place transpose of a rows x cols complex matrix
+	static void transpose (const T* src, T* dst, long rows, long cols) {
+		const long B = 16;
+		for (long i0 = 0; i0 < rows; i0 += B) {
+			for (long j0 = 0; j0 < cols; j0 += B) {
+				long ie = std::min (i0 + B, rows), je = std::min (j0 + B, cols);
+				for (long i = i0; i < ie; ++i) {
+					for (long j = j0; j < je; ++j) {
+						dst[2 * (j * rows + i)] = src[2 * (i * cols + j)];
+						dst[2 * (j * rows + i) + 1] = src[2 * (i * cols + j) + 1];
+					}
+				}
+			}
+		}
+	}
+	static void transpose_square (T* d, long n) {
+		const long B = 16;
+		for (long i0 = 0; i0 < n; i0 += B) {
+			for (long j0 = i0; j0 < n; j0 += B) {
+				for (long i = i0; i < std::min (i0 + B, n); ++i) {
+					for (long j = std::max (j0, i + 1); j < std::min (j0 + B, n); ++j) {
+						std::swap (d[2 * (i * n + j)], d[2 * (j * n + i)]);
+						std::swap (d[2 * (i * n + j) + 1], d[2 * (j * n + i) + 1]);
+					}
+				}
+			}
+		}
+	}
+};
+
+//! Plans shared by all threads. Sizes up to FFT_PLAN_KEEP stay cached for
+//! the process; larger plans live while a caller holds them (each thread
+//! keeps its last one), so a single huge transform does not pin its tables.
+#ifndef FFT_PLAN_KEEP
+	#define FFT_PLAN_KEEP 65536
+#endif
+
+template <typename P>
+std::shared_ptr<const P> fft_cached_plan (long N) {
+	thread_local std::shared_ptr<const P> last;
+	if (last && last->N == N) return last;
+
+	struct Entry {
+		std::shared_ptr<const P> keep;
+		std::weak_ptr<const P> held;
+	};
+	static std::mutex lock;
+	static std::map<long, Entry> plans;
+	std::lock_guard<std::mutex> guard (lock);
+	Entry& e = plans[N];
+	std::shared_ptr<const P> p = e.keep ? e.keep : e.held.lock ();
+	if (!p) {
+		p = std::make_shared<const P> (N);
+		if (N <= FFT_PLAN_KEEP) e.keep = p;
+		else e.held = p;
+	}
+	last = p;
+	return p;
+}
+
+template <typename T>
+std::shared_ptr<const FFTPlan<T> > fft_plan (long N) {
+	return fft_cached_plan<FFTPlan<T> > (N);
+}
+
+//! One complex value for the Stockham passes below, which are written once
+//! against this interface; FFTComplexSSE2 holds a complex double in a
+//! register on x86-64
+template <typename T>
+struct FFTComplex {
+	T re, im;
+	static FFTComplex load (const T* p) { return {p[0], p[1]}; }
+	void store (T* p) const { p[0] = re; p[1] = im; }
+	FFTComplex operator+ (FFTComplex b) const { return {re + b.re, im + b.im}; }
+	FFTComplex operator- (FFTComplex b) const { return {re - b.re, im - b.im}; }
+	FFTComplex scale (T c) const { return {re * c, im * c}; }
+	FFTComplex times_i () const { return {-im, re}; }
+	//! times w, or conj (w) when INV
+	template <bool INV>
+	FFTComplex turn (const T* w) const {
+		T wi = INV ? -w[1] : w[1];
+		return {re * w[0] - im * wi, re * wi + im * w[0]};
+	}
+};
+
+#ifdef FFT_X86_SIMD
+struct FFTComplexSSE2 {
+	__m128d v;
+	static FFTComplexSSE2 load (const double* p) { return {_mm_loadu_pd (p)}; }
+	void store (double* p) const { _mm_storeu_pd (p, v); }
+	FFTComplexSSE2 operator+ (FFTComplexSSE2 b) const { return {_mm_add_pd (v, b.v)}; }
+	FFTComplexSSE2 operator- (FFTComplexSSE2 b) const { return {_mm_sub_pd (v, b.v)}; }
+	FFTComplexSSE2 scale (double c) const { return {_mm_mul_pd (v, _mm_set1_pd (c))}; }
+	FFTComplexSSE2 times_i () const {
+		return {_mm_xor_pd (_mm_shuffle_pd (v, v, 1), _mm_set_pd (0.0, -0.0))};
+	}
+	template <bool INV>
+	FFTComplexSSE2 turn (const double* w) const { return {fft_cmul_sse2<INV> (v, _mm_loadu_pd (w))}; }
+};
+#endif
+
+//! Radix-4 Stockham pass: the 4-point DFT of x[q + s (r + j m)], j < 4,
+//! turned by w = exp(-2 pi i r k / 4m), k = 1..3, lands on
+//! y[q + s (4 r + k)]; the passes read and write different buffers, so
+//! the output comes out in natural order without a bit reversal
+template <typename C, typename T, bool INV>
+void fft_stage4 (const T* x, T* y, long m, long s, const T* w) {
+	const long js = 2 * s * m;
+	for (long r = 0; r < m; ++r, w += 6) {
+		const T* a = x + 2 * s * r;
+		T* b = y + 2 * s * 4 * r;
+		for (long q = 0; q < 2 * s; q += 2) {
+			C a0 = C::load (a + q), a1 = C::load (a + q + js);
+			C a2 = C::load (a + q + 2 * js), a3 = C::load (a + q + 3 * js);
+			C t0 = a0 + a2, t1 = a0 - a2, t2 = a1 + a3, t3 = (a1 - a3).times_i ();
+			(t0 + t2).store (b + q);
+			if (INV) {
+				(t1 + t3).template turn<INV> (w).store (b + q + 2 * s);
+				(t1 - t3).template turn<INV> (w + 4).store (b + q + 6 * s);
+			} else {
+				(t1 - t3).template turn<INV> (w).store (b + q + 2 * s);
+				(t1 + t3).template turn<INV> (w + 4).store (b + q + 6 * s);
+			}
+			(t0 - t2).template turn<INV> (w + 2).store (b + q + 4 * s);
+		}
+	}
+}
+
+//! Radix-2 Stockham pass, as fft_stage4 ()
+template <typename C, typename T, bool INV>
+void fft_stage2 (const T* x, T* y, long m, long s, const T* w) {
+	const long js = 2 * s * m;
+	for (long r = 0; r < m; ++r, w += 2) {
+		const T* a = x + 2 * s * r;
+		T* b = y + 2 * s * 2 * r;
+		for (long q = 0; q < 2 * s; q += 2) {
+			C a0 = C::load (a + q), a1 = C::load (a + q + js);
+			(a0 + a1).store (b + q);
+			(a0 - a1).template turn<INV> (w).store (b + q + 2 * s);
+		}
+	}
+}
+
+//! Odd-radix Stockham pass, as fft_stage4 (): b_k and b_p-k share the sums
+//! and differences of a_j and a_p-j; cs holds cos and sin of 2 pi t / p.
+//! P > 0 fixes the radix at compile time (3, 5, 7), P = 0 takes p.
+#ifndef FFT_RADIX_MAX
+	#define FFT_RADIX_MAX 31
+#endif
+
+template <typename C, typename T, bool INV, int P>
+void fft_stage_odd (const T* x, T* y, long m, long s, const T* w, const T* cs, int p) {
+	if (P) p = P;
+	const int h = (p - 1) / 2;
+	const int R = P ? P : FFT_RADIX_MAX;
+	const long js = 2 * s * m;
+	C sum[R / 2 + 1], dif[R / 2 + 1];
+	for (long r = 0; r < m; ++r, w += 2 * (p - 1)) {
+		const T* a = x + 2 * s * r;
+		T* b = y + 2 * s * p * r;
+		for (long q = 0; q < 2 * s; q += 2) {
+			C a0 = C::load (a + q), b0 = a0;
+			for (int j = 1; j <= h; ++j) {
+				C u = C::load (a + q + j * js), v = C::load (a + q + (p - j) * js);
+				sum[j] = u + v;
+				dif[j] = u - v;
+				b0 = b0 + sum[j];
+			}
+			b0.store (b + q);
+			for (int k = 1; k <= h; ++k) {
+				C e = a0, f = dif[1].scale (cs[2 * k + 1]);
+				e = e + sum[1].scale (cs[2 * k]);
+				for (int j = 2, t = k; j <= h; ++j) {
+					t += k;
+					if (t >= p) t -= p;
+					e = e + sum[j].scale (cs[2 * t]);
+					f = f + dif[j].scale (cs[2 * t + 1]);
+				}
+				f = f.times_i ();        // b_k = e - i f, b_p-k = e + i f
+				if (INV) {
+					(e + f).template turn<INV> (w + 2 * (k - 1)).store (b + q + 2 * s * k);
+					(e - f).template turn<INV> (w + 2 * (p - k - 1)).store (b + q + 2 * s * (p - k));
+				} else {
+					(e - f).template turn<INV> (w + 2 * (k - 1)).store (b + q + 2 * s * k);
+					(e + f).template turn<INV> (w + 2 * (p - k - 1)).store (b + q + 2 * s * (p - k));
+				}
+			}
+		}
+	}
+}
+
+//! Work buffer of at least count values for the out-of-place passes (plans
+//! are shared between threads and hold no scratch): per thread up to the
+//! size of the kept plans, in big beyond that
+template <typename T>
+T* fft_scratch (std::size_t count, std::vector<T>& big) {
+	thread_local std::vector<T> buf;
+	if (count > 2 * (std::size_t) FFT_PLAN_KEEP) {
+		big.resize (count);
+		return big.data ();
+	}
+	if (buf.size () < count) buf.resize (count);
+	return buf.data ();
+}
+
+//! Plan for any size. Powers of two run on FFTPlan; sizes whose prime
+//! factors are all at most FFT_RADIX_MAX run as Stockham passes of radix
+//! 4, 2, 3, 5, 7 and the remaining primes; any other size goes through
+//! Bluestein's algorithm, a chirp convolution done with power-of-two FFTs.
+template <typename T>
+struct MixedFFTPlan {
+	explicit MixedFFTPlan (long n) : N (n) {
+		if (N < 2) return;
+		if ((N & (N - 1)) == 0) {
+			pow2 = fft_plan<T> (N);
+			return;
+		}
+		std::vector<int> radices;
+		long rest = N;
+		while (rest % 4 == 0) {
+			radices.push_back (4);
+			rest /= 4;
+		}
+		for (int p = 2; p <= FFT_RADIX_MAX && rest > 1; ++p) {
+			while (rest % p == 0) {
+				radices.push_back (p);
+				rest /= p;
+			}
+		}
+		if (rest > 1) {
+			make_bluestein ();
+			return;
+		}
+		long len = N, s = 1;
+		for (int p : radices) {
+			long m = len / p;
+			Stage st {p, m, s, (long) twiddle.size (), (long) unit.size ()};
+			for (long r = 0; r < m; ++r) {
+				std::vector<T> w = FFTPlan<T>::roots (p, r * s, N);
+				twiddle.insert (twiddle.end (), w.begin () + 2, w.end ());
+			}
+			if (p & 1) {
+				std::vector<T> c = FFTPlan<T>::roots (p, 1, p);
+				for (int t = 0; t < p; ++t) c[2 * t + 1] = -c[2 * t + 1];   // sin (2 pi t / p)
+				unit.insert (unit.end (), c.begin (), c.end ());
+			}
+			stages.push_back (st);
+			len = m;
+			s *= p;
+		}
+	}
+	//! in-place transform of N interleaved complex values; sign -1 forward,
+	//! +1 inverse (unscaled), as fft ()
+	void execute (T* data, long sign) const {
+		if (N < 2) return;
+		if (pow2) {
+			pow2->execute (data, sign);
+		} else if (chirp.empty ()) {
+			if (sign < 0) run<false> (data);
+			else run<true> (data);
+		} else {
+			run_bluestein (data, sign);
+		}
+	}
+	bool bluestein () const {
+		return !chirp.empty ();
+	}
+
+	struct Stage {
+		int radix;
+		long m, s;
+		long w, c;    // offsets in twiddle and unit
+	};
+
+	long N;
+	std::shared_ptr<const FFTPlan<T> > pow2;
+	std::vector<Stage> stages;
+	std::vector<T> twiddle, unit;
+
+	long M = 0;
+	std::shared_ptr<const FFTPlan<T> > conv;
+	std::vector<T> chirp, kernel;
+
+private:
+	template <bool INV>
+	void run (T* data) const {
+#ifdef FFT_X86_SIMD
+		if constexpr (std::is_same<T, double>::value) {
+			run<FFTComplexSSE2, INV> (data);
+			return;
+		}
+#endif
+		run<FFTComplex<T>, INV> (data);
+	}
+	template <typename C, bool INV>
+	void run (T* data) const {
+		std::vector<T> big;
+		T* x = data;
+		T* y = fft_scratch<T> (2 * N, big);
+		for (const Stage& st : stages) {
+			const T* w = twiddle.data () + st.w;
+			const T* c = unit.data () + st.c;
+			switch (st.radix) {
+			case 4: fft_stage4<C, T, INV> (x, y, st.m, st.s, w); break;
+			case 2: fft_stage2<C, T, INV> (x, y, st.m, st.s, w); break;
+			case 3: fft_stage_odd<C, T, INV, 3> (x, y, st.m, st.s, w, c, 3); break;
+			case 5: fft_stage_odd<C, T, INV, 5> (x, y, st.m, st.s, w, c, 5); break;
+			case 7: fft_stage_odd<C, T, INV, 7> (x, y, st.m, st.s, w, c, 7); break;
+			default: fft_stage_odd<C, T, INV, 0> (x, y, st.m, st.s, w, c, st.radix); break;
+			}
+			std::swap (x, y);
+		}
+		if (x != data) std::copy (x, x + 2 * N, data);
+	}
+	// X[k] = c[k] sum_n (x[n] c[n]) conj (c[k - n]), c[k] = exp(-i pi k^2 / N),
+	// with the convolution done circularly over M >= 2N - 1 points
+	void make_bluestein () {
+		M = 1;
+		while (M < 2 * N - 1) M <<= 1;
+		conv = fft_plan<T> (M);
+		chirp.resize (2 * N);
+		long t = 0;                            // k^2 mod 2N
+		for (long k = 0; k < N; ++k) {
+			double a = -PI * (double) t / (double) N;
+			chirp[2 * k] = (T) std::cos (a);
+			chirp[2 * k + 1] = (T) std::sin (a);
+			t = (t + 2 * k + 1) % (2 * N);
+		}
+		kernel.assign (2 * M, 0);
+		for (long k = 0; k < N; ++k) {
+			long i = k == 0 ? 0 : M - k;
+			kernel[2 * k] = chirp[2 * k] / (T) M;
+			kernel[2 * k + 1] = -chirp[2 * k + 1] / (T) M;
+			kernel[2 * i] = kernel[2 * k];
+			kernel[2 * i + 1] = kernel[2 * k + 1];
+		}
+		conv->execute (kernel.data (), -1);
+	}
+	// the inverse is conj (forward (conj (x)))
+	void run_bluestein (T* data, long sign) const {
+		std::vector<T> big;
+		T* a = fft_scratch<T> (2 * M, big);
+		T im = sign < 0 ? 1 : -1;
+		for (long k = 0; k < N; ++k) {
+			T xr = data[2 * k], xi = im * data[2 * k + 1];
+			a[2 * k] = xr * chirp[2 * k] - xi * chirp[2 * k + 1];
+			a[2 * k + 1] = xr * chirp[2 * k + 1] + xi * chirp[2 * k];
+		}
+		std::fill (a + 2 * N, a + 2 * M, T (0));
+		conv->execute (a, -1);
+		for (long k = 0; k < M; ++k) {
+			T xr = a[2 * k], xi = a[2 * k + 1];
+			a[2 * k] = xr * kernel[2 * k] - xi * kernel[2 * k + 1];
+			a[2 * k + 1] = xr * kernel[2 * k + 1] + xi * kernel[2 * k];
+		}
+		conv->execute (a, +1);
+		for (long k = 0; k < N; ++k) {
+			T xr = a[2 * k], xi = a[2 * k + 1];
+			data[2 * k] = xr * chirp[2 * k] - xi * chirp[2 * k + 1];
+			data[2 * k + 1] = im * (xr * chirp[2 * k + 1] + xi * chirp[2 * k]);
+		}
+	}
+};
+
+template <typename T>
+std::shared_ptr<const MixedFFTPlan<T> > mixed_fft_plan (long N) {
+	return fft_cached_plan<MixedFFTPlan<T> > (N);
+}
+
+//! Cost of a transform of N points relative to a power of two of the same
+//! length: the Stockham passes make an extra copy per pass and have no
+//! SIMD kernels
+#ifndef FFT_MIXED_COST
+	#define FFT_MIXED_COST 1.5
+#endif
+
+//! The cheapest size >= n to pad a transform to: among the 2/3/5/7-smooth
+//! sizes up to the next power of two (even ones, so real transforms can
+//! take the half-size path), the one with the lowest estimated N log N
+inline long fft_good_size (long n) {
+	if (n <= 2) return std::max (n, 1L);
+	long top = 2;
+	while (top < n) top <<= 1;
+	long best = top;
+	double best_cost = (double) top * std::log2 ((double) top);
+	for (long p7 = 2; p7 < top; p7 *= 7) {
+		for (long p5 = p7; p5 < top; p5 *= 5) {
+			for (long p3 = p5; p3 < top; p3 *= 3) {
+				long c = p3;
+				while (c < n) c <<= 1;
+				if (c >= top) continue;
+				double cost = FFT_MIXED_COST * (double) c * std::log2 ((double) c);
+				if (cost < best_cost) {
+					best = c;
+					best_cost = cost;
+				}
+			}
+		}
+	}
+	return best;
+}
+
+//! In-place complex FFT of fftFrameSize interleaved values (sign -1 forward,
+//! +1 inverse, unscaled), any size, on a cached plan
+template <typename T>
+void fft (T *fftBuffer, long fftFrameSize, long sign) {
+	if (fftFrameSize < 2) return;
+	if ((fftFrameSize & (fftFrameSize - 1)) == 0) {
+		fft_plan<T> (fftFrameSize)->execute (fftBuffer, sign);
+	} else {
+		mixed_fft_plan<T> (fftFrameSize)->execute (fftBuffer, sign);
+	}
+}
+
+//! Real-input transform of N samples. Even sizes run as a complex FFT of
+//! N / 2 points (even samples as real parts, odd as imaginary) and a split
+//! pass with the twiddles exp(-2 pi i k / N), k <= N / 4; odd sizes run a
+//! full complex transform.
+template <typename T>
+struct RFFTPlan {
+	explicit RFFTPlan (long n) : N (n) {
+		if (N >= 2 && N % 2 == 0) {
+			half = mixed_fft_plan<T> (N / 2);
+			twiddle = FFTPlan<T>::roots (N / 4 + 1, 1, N);
+		} else if (N > 1) {
+			full = mixed_fft_plan<T> (N);
+		}
+	}
+
+	//! N real samples to the N / 2 + 1 bins 0..N/2, interleaved (N + 2
+	//! values, N + 1 for odd N); in and out may be the same buffer
+	void forward (const T* in, T* out) const {
+		if (N < 2) {
+			out[0] = in[0];
+			out[1] = 0;
+			return;
+		}
+		if (full) {
+			std::vector<T> c (2 * N, 0);
+			for (long i = 0; i < N; ++i) c[2 * i] = in[i];
+			full->execute (c.data (), -1);
+			std::copy (c.begin (), c.begin () + N + 1, out);
+			return;
+		}
+		long M = N / 2;
+		if (out != in) std::copy (in, in + N, out);
+		half->execute (out, -1);
+		T z0r = out[0], z0i = out[1];
+		out[0] = z0r + z0i;
+		out[1] = 0;
+		out[N] = z0r - z0i;
+		out[N + 1] = 0;
+		for (long k = 1; k <= M / 2; ++k) {
+			T* a = out + 2 * k;
+			T* b = out + 2 * (M - k);
+			T er = (a[0] + b[0]) / 2, ei = (a[1] - b[1]) / 2;      // even part
+			T or_ = (a[1] + b[1]) / 2, oi = (b[0] - a[0]) / 2;     // odd part
+			T wr = twiddle[2 * k], wi = twiddle[2 * k + 1];
+			T tr = or_ * wr - oi * wi, ti = or_ * wi + oi * wr;
+			a[0] = er + tr;
+			a[1] = ei + ti;
+			b[0] = er - tr;
+			b[1] = ti - ei;
+		}
+	}
+	//! bins 0..N/2 (imaginary parts of the first and, for even N, the last
+	//! ignored) back to N real samples, unscaled like fft (): the result
+	//! is N times the signal; in and out may be the same buffer
+	void inverse (const T* in, T* out) const {
+		if (N < 2) {
+			out[0] = in[0];
+			return;
+		}
+		if (full) {
+			std::vector<T> c (2 * N);
+			c[0] = in[0];
+			c[1] = 0;
+			for (long k = 1; 2 * k < N; ++k) {
+				c[2 * k] = c[2 * (N - k)] = in[2 * k];
+				c[2 * k + 1] = in[2 * k + 1];
+				c[2 * (N - k) + 1] = -in[2 * k + 1];
+			}
+			full->execute (c.data (), +1);
+			for (long i = 0; i < N; ++i) out[i] = c[2 * i];
+			return;
+		}
+		long M = N / 2;
+		T x0 = in[0], xm = in[N];
+		if (out != in) std::copy (in + 2, in + N, out + 2);
+		out[0] = x0 + xm;
+		out[1] = x0 - xm;
+		for (long k = 1; k <= M / 2; ++k) {
+			T* a = out + 2 * k;
+			T* b = out + 2 * (M - k);
+			T er = a[0] + b[0], ei = a[1] - b[1];
+			T dr = a[0] - b[0], di = a[1] + b[1];
+			T wr = twiddle[2 * k], wi = -twiddle[2 * k + 1];
+			T or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+			a[0] = er - oi;
+			a[1] = ei + or_;
+			b[0] = er + oi;
+			b[1] = or_ - ei;
+		}
+		half->execute (out, +1);
+	}
+
+	long N;
+	std::shared_ptr<const MixedFFTPlan<T> > half, full;
+	std::vector<T> twiddle;
+};
+
+template <typename T>
+std::shared_ptr<const RFFTPlan<T> > rfft_plan (long N) {
+	return fft_cached_plan<RFFTPlan<T> > (N);
+}
+
+//! Real FFT of N samples: out receives the N / 2 + 1 interleaved bins,
+//! N + 2 values (N + 1 for odd N)
+template <typename T>
+void rfft (const T* in, T* out, long N) {
+	rfft_plan<T> (N)->forward (in, out);
+}
+
+//! Inverse of rfft (): N / 2 + 1 bins to N samples, unscaled
+template <typename T>
+void irfft (const T* in, T* out, long N) {
+	rfft_plan<T> (N)->inverse (in, out);
+}
+
 // ---------------------------------------------------------------------- //
 template <typename T>
 void hanningz (T* out, int N) {
@@ -0,0 +1,434 @@
+// convolver.h
+//
+
+// partitioned FFT convolution: the impulse response is cut into blocks
+// whose spectra are computed once; the input runs through a frequency-
+// domain delay line, so memory is bounded by the response and the block
+// size, not by the length of the signal
+
+#ifndef CONVOLVER_H
+#define CONVOLVER_H
+
+#include "FFT.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//! a += x * h over n bins of split spectra (real parts, imaginary parts)
+template <typename T>
+void conv_cmac (T* ar, T* ai, const T* xr, const T* xi, const T* hr, const T* hi, long n) {
+	for (long k = 0; k < n; ++k) {
+		ar[k] += xr[k] * hr[k] - xi[k] * hi[k];
+		ai[k] += xr[k] * hi[k] + xi[k] * hr[k];
+	}
+}
+
+#ifdef FFT_X86_SIMD
+inline void conv_cmac_sse2 (double* ar, double* ai, const double* xr, const double* xi,
+	const double* hr, const double* hi, long n) {
+	long k = 0;
+	for (; k + 2 <= n; k += 2) {
+		__m128d a = _mm_loadu_pd (xr + k), b = _mm_loadu_pd (xi + k);
+		__m128d c = _mm_loadu_pd (hr + k), d = _mm_loadu_pd (hi + k);
+		_mm_storeu_pd (ar + k, _mm_add_pd (_mm_loadu_pd (ar + k), _mm_sub_pd (_mm_mul_pd (a, c), _mm_mul_pd (b, d))));
+		_mm_storeu_pd (ai + k, _mm_add_pd (_mm_loadu_pd (ai + k), _mm_add_pd (_mm_mul_pd (a, d), _mm_mul_pd (b, c))));
+	}
+	conv_cmac<double> (ar + k, ai + k, xr + k, xi + k, hr + k, hi + k, n - k);
+}
+
+__attribute__ ((target ("avx2,fma")))
+inline void conv_cmac_avx2 (double* ar, double* ai, const double* xr, const double* xi,
+	const double* hr, const double* hi, long n) {
+	long k = 0;
+	for (; k + 4 <= n; k += 4) {
+		__m256d a = _mm256_loadu_pd (xr + k), b = _mm256_loadu_pd (xi + k);
+		__m256d c = _mm256_loadu_pd (hr + k), d = _mm256_loadu_pd (hi + k);
+		__m256d re = _mm256_fmadd_pd (a, c, _mm256_loadu_pd (ar + k));
+		__m256d im = _mm256_fmadd_pd (a, d, _mm256_loadu_pd (ai + k));
+		_mm256_storeu_pd (ar + k, _mm256_fnmadd_pd (b, d, re));
+		_mm256_storeu_pd (ai + k, _mm256_fmadd_pd (b, c, im));
+	}
+	conv_cmac_sse2 (ar + k, ai + k, xr + k, xi + k, hr + k, hi + k, n - k);
+}
+
+inline void conv_cmac (double* ar, double* ai, const double* xr, const double* xi,
+	const double* hr, const double* hi, long n) {
+	if (fft_kernel () == FFT_AVX2) conv_cmac_avx2 (ar, ai, xr, xi, hr, hi, n);
+	else conv_cmac_sse2 (ar, ai, xr, xi, hr, hi, n);
+}
+#endif
+
+//! Uniformly partitioned overlap-save convolver: each call to process ()
+//! takes `block` input samples and returns the next `block` samples of
+//! the linear convolution with the response, with no added latency.
+//! Copies share the response spectra and start from the copied state.
+template <typename T>
+struct UniformConvolver {
+	UniformConvolver (const T* ir, long ir_len, long block) :
+		B (std::max (block, 1L)), N (2 * B), bins (B + 1),
+		parts (std::max ((ir_len + B - 1) / B, 1L)),
+		plan (rfft_plan<T> (N)),
+		X (parts * 2 * bins, 0),
+		in (N, 0), acc (N + 2, 0), yr (bins, 0), yi (bins, 0), cur (0) {
+		std::vector<T> pad (N + 2, 0), spectra (parts * 2 * bins);
+		for (long p = 0; p < parts; ++p) {
+			long n = std::min (B, ir_len - p * B);
+			std::fill (pad.begin (), pad.end (), 0);
+			if (n > 0) std::copy (ir + p * B, ir + p * B + n, pad.begin ());
+			plan->forward (&pad[0], &pad[0]);
+			// the 1 / N of the inverse is folded into the response
+			split (&pad[0], &spectra[p * 2 * bins], (T) 1 / N);
+		}
+		H = std::make_shared<const std::vector<T> > (std::move (spectra));
+	}
+
+	long block () const { return B; }
+	long partitions () const { return parts; }
+
+	//! convolves the next B input samples into B output samples; in and
+	//! out may be the same buffer
+	void process (const T* x, T* y) {
+		// slide the 2B input window and transform it into the newest slot
+		std::copy (in.begin () + B, in.end (), in.begin ());
+		std::copy (x, x + B, in.begin () + B);
+		cur = cur ? cur - 1 : parts - 1;
+		std::copy (in.begin (), in.end (), acc.begin ());
+		plan->forward (&acc[0], &acc[0]);
+		split (&acc[0], &X[cur * 2 * bins], 1);
+
+		// Y = sum over p of X[now - p] * H[p]; spectra are stored as bins
+		// real parts then bins imaginary parts for the SIMD conv_cmac
+		std::fill (yr.begin (), yr.end (), 0);
+		std::fill (yi.begin (), yi.end (), 0);
+		for (long p = 0; p < parts; ++p) {
+			const T* xs = &X[((cur + p) % parts) * 2 * bins];
+			const T* hs = &(*H)[p * 2 * bins];
+			conv_cmac (&yr[0], &yi[0], xs, xs + bins, hs, hs + bins, bins);
+		}
+		for (long k = 0; k < bins; ++k) {
+			acc[2 * k] = yr[k];
+			acc[2 * k + 1] = yi[k];
+		}
+		plan->inverse (&acc[0], &acc[0]);
+		// the first half holds the circular wrap; the second is valid
+		std::copy (acc.begin () + B, acc.begin () + N, y);
+	}
+
+	void reset () {
+		std::fill (X.begin (), X.end (), 0);
+		std::fill (in.begin (), in.end (), 0);
+		cur = 0;
+	}
+
+	void split (const T* spec, T* out, T scale) const {
+		for (long k = 0; k < bins; ++k) {
+			out[k] = spec[2 * k] * scale;
+			out[bins + k] = spec[2 * k + 1] * scale;
+		}
+	}
+
+	long B, N, bins, parts;
+	std::shared_ptr<const RFFTPlan<T> > plan;
+	std::shared_ptr<const std::vector<T> > H;
+	std::vector<T> X, in, acc, yr, yi;
+	long cur;
+};
+
+//! Non-uniformly partitioned convolver for streaming: the head of the
+//! response runs through a UniformConvolver with the caller's block B, so
+//! the only latency is the block itself. The rest is cut into levels
+//! whose blocks grow four times at a time up to max_block; a level with
+//! block L starts 2 L into the response, so its result for one block of
+//! input is due only one block L later, and each level computes it on a
+//! thread of its own while process () keeps being called. Levels with
+//! blocks up to CONV_INLINE_MAX samples cost little and have deadlines
+//! too short to leave to the scheduler: process () computes them itself.
+//! Blocks are handed to and from the workers through sequence numbers,
+//! so a realtime caller never takes a lock; a level that misses its
+//! deadline then plays silence instead of making the caller wait.
+static const long CONV_INLINE_MAX = 1024;
+// how long a worker sleeps before looking again for a block whose
+// notification it missed (the caller posts without the lock)
+static const std::chrono::milliseconds CONV_POLL (2);
+
+template <typename T>
+struct PartitionedConvolver {
+	PartitionedConvolver (const T* ir, long ir_len, long block, long max_block = 16384) :
+		B (std::max (block, 1L)), length (std::max (ir_len, 0L)) {
+		// every block is a multiple of the previous one, hence of B
+		for (long b = B, start = 0;;) {
+			long next = std::max (b, std::min (4 * b, max_block / b * b));
+			long end = next > b ? std::min (2 * next, length) : length;
+			if (start == 0) head.reset (new UniformConvolver<T> (ir, end, B));
+			else levels.emplace_back (new Level (ir + start, end - start, b));
+			if (end >= length) break;
+			start = end;
+			b = next;
+		}
+		for (size_t k = 0; k < levels.size (); ++k)
+			if (levels[k]->L > CONV_INLINE_MAX)
+				levels[k]->worker = std::thread (&PartitionedConvolver::run, levels[k].get (), (int) k + 1);
+	}
+	~PartitionedConvolver () {
+		for (auto& l : levels) {
+			if (!l->worker.joinable ()) continue;
+			{
+				std::lock_guard<std::mutex> lk (l->m);
+				l->quit = true;
+			}
+			l->cv.notify_all ();
+			l->worker.join ();
+		}
+	}
+	PartitionedConvolver (const PartitionedConvolver&) = delete;
+	PartitionedConvolver& operator= (const PartitionedConvolver&) = delete;
+
+	long block () const { return B; }
+	long size () const { return length; }
+	long stages () const { return (long) levels.size () + 1; }
+
+	//! convolves the next B input samples into B output samples, with no
+	//! added latency; in and out may be the same buffer. A realtime caller
+	//! never waits for a worker: a late level drops its input block and
+	//! plays silence until it has caught up.
+	void process (const T* x, T* y, bool realtime = false) {
+		for (auto& lp : levels) {
+			Level& l = *lp;
+			if (l.fill == l.L) {
+				// a block of this level is complete: the one before it has
+				// been computed meanwhile and plays from now on
+				l.fill = l.played = 0;
+				if (!l.worker.joinable ()) {
+					std::swap (l.pending, l.ready);
+					std::swap (l.input, l.job);
+					l.conv.process (&l.job[0], &l.pending[0]);
+				} else if (realtime && l.done.load (std::memory_order_acquire) != l.posted) {
+					std::fill (l.ready.begin (), l.ready.end (), 0);
+					l.late = true;
+				} else {
+					if (!realtime) wait (l);
+					// the result of a late block is out of date by now
+					if (l.late) std::fill (l.pending.begin (), l.pending.end (), 0);
+					l.late = false;
+					std::swap (l.pending, l.ready);
+					std::swap (l.input, l.job);
+					l.posted.store (l.posted.load (std::memory_order_relaxed) + 1, std::memory_order_release);
+					l.cv.notify_all ();
+				}
+			}
+			std::copy (x, x + B, &l.input[l.fill]);
+			l.fill += B;
+		}
+		head->process (x, y);
+		for (auto& lp : levels) {
+			Level& l = *lp;
+			const T* r = &l.ready[l.played];
+			for (long i = 0; i < B; ++i) y[i] += r[i];
+			l.played += B;
+		}
+	}
+
+	void reset () {
+		head->reset ();
+		for (auto& l : levels) {
+			wait (*l);
+			l->conv.reset ();
+			std::fill (l->ready.begin (), l->ready.end (), 0);
+			std::fill (l->pending.begin (), l->pending.end (), 0);
+			l->fill = l->played = 0;
+			l->late = false;
+		}
+	}
+
+private:
+	struct Level {
+		Level (const T* ir, long n, long block) :
+			conv (ir, n, block), L (block), input (block, 0), job (block, 0),
+			pending (block, 0), ready (block, 0) {}
+		UniformConvolver<T> conv;
+		long L, fill = 0, played = 0;
+		std::vector<T> input, job, pending, ready;
+		std::thread worker;
+		// the caller publishes job as block number posted, the worker
+		// publishes pending as done; only the worker and wait () lock m
+		std::atomic<unsigned> posted {0}, done {0};
+		std::mutex m;
+		std::condition_variable cv;
+		bool late = false, quit = false;
+	};
+
+	static void run (Level* l, int depth) {
+#ifdef __linux__
+		// larger blocks have later deadlines: let the smaller ones (and
+		// the caller) preempt them when cores are short
+		setpriority (PRIO_PROCESS, (id_t) syscall (SYS_gettid), 2 * depth);
+#else
+		(void) depth;
+#endif
+		std::unique_lock<std::mutex> lk (l->m);
+		for (;;) {
+			unsigned n;
+			while (!l->quit && (n = l->posted.load (std::memory_order_acquire)) == l->done.load (std::memory_order_relaxed))
+				l->cv.wait_for (lk, CONV_POLL);
+			if (l->quit) return;
+			lk.unlock ();
+			l->conv.process (&l->job[0], &l->pending[0]);
+			lk.lock ();
+			l->done.store (n, std::memory_order_release);
+			l->cv.notify_all ();
+		}
+	}
+	static void wait (Level& l) {
+		if (!l.worker.joinable ()) return;
+		std::unique_lock<std::mutex> lk (l.m);
+		l.cv.wait (lk, [&l] { return l.done.load (std::memory_order_acquire) == l.posted.load (std::memory_order_relaxed); });
+	}
+
+	long B, length;
+	std::unique_ptr<UniformConvolver<T> > head;
+	std::vector<std::unique_ptr<Level> > levels;
+};
+
+// direct convolution ------------------------------------------------- //
+
+//! out[m] = sum over j of hr[j] xp[m + j] for m in [0, len): xp must hold
+//! len + lh - 1 samples; the SIMD versions keep 8 outputs in registers
+template <typename T>
+void conv_dot (const T* xp, const T* hr, long lh, T* out, long len) {
+	for (long m = 0; m < len; ++m) {
+		T acc = 0;
+		for (long j = 0; j < lh; ++j) acc += hr[j] * xp[m + j];
+		out[m] = acc;
+	}
+}
+
+#ifdef FFT_X86_SIMD
+inline void conv_dot_sse2 (const double* xp, const double* hr, long lh, double* out, long len) {
+	long m = 0;
+	for (; m + 8 <= len; m += 8) {
+		__m128d a0 = _mm_setzero_pd (), a1 = a0, a2 = a0, a3 = a0;
+		const double* x = xp + m;
+		for (long j = 0; j < lh; ++j) {
+			__m128d h = _mm_set1_pd (hr[j]);
+			a0 = _mm_add_pd (a0, _mm_mul_pd (h, _mm_loadu_pd (x + j)));
+			a1 = _mm_add_pd (a1, _mm_mul_pd (h, _mm_loadu_pd (x + j + 2)));
+			a2 = _mm_add_pd (a2, _mm_mul_pd (h, _mm_loadu_pd (x + j + 4)));
+			a3 = _mm_add_pd (a3, _mm_mul_pd (h, _mm_loadu_pd (x + j + 6)));
+		}
+		_mm_storeu_pd (out + m, a0);
+		_mm_storeu_pd (out + m + 2, a1);
+		_mm_storeu_pd (out + m + 4, a2);
+		_mm_storeu_pd (out + m + 6, a3);
+	}
+	conv_dot<double> (xp + m, hr, lh, out + m, len - m);
+}
+
+__attribute__ ((target ("avx2,fma")))
+inline void conv_dot_avx2 (const double* xp, const double* hr, long lh, double* out, long len) {
+	long m = 0;
+	for (; m + 16 <= len; m += 16) {
+		__m256d a0 = _mm256_setzero_pd (), a1 = a0, a2 = a0, a3 = a0;
+		const double* x = xp + m;
+		for (long j = 0; j < lh; ++j) {
+			__m256d h = _mm256_broadcast_sd (hr + j);
+			a0 = _mm256_fmadd_pd (h, _mm256_loadu_pd (x + j), a0);
+			a1 = _mm256_fmadd_pd (h, _mm256_loadu_pd (x + j + 4), a1);
+			a2 = _mm256_fmadd_pd (h, _mm256_loadu_pd (x + j + 8), a2);
+			a3 = _mm256_fmadd_pd (h, _mm256_loadu_pd (x + j + 12), a3);
+		}
+		_mm256_storeu_pd (out + m, a0);
+		_mm256_storeu_pd (out + m + 4, a1);
+		_mm256_storeu_pd (out + m + 8, a2);
+		_mm256_storeu_pd (out + m + 12, a3);
+	}
+	conv_dot_sse2 (xp + m, hr, lh, out + m, len - m);
+}
+#endif
+
+template <typename T>
+void conv_dot_best (const T* xp, const T* hr, long lh, T* out, long len) {
+	conv_dot<T> (xp, hr, lh, out, len);
+}
+
+#ifdef FFT_X86_SIMD
+inline void conv_dot_best (const double* xp, const double* hr, long lh, double* out, long len) {
+	if (fft_kernel () == FFT_AVX2) conv_dot_avx2 (xp, hr, lh, out, len);
+	else conv_dot_sse2 (xp, hr, lh, out, len);
+}
+#endif
+
+//! Full linear convolution in the time domain, out[0, lx + lh - 1), for
+//! kernels short enough that lx * lh multiply-adds beat the transforms
+template <typename T>
+void direct_convolve (const T* x, long lx, const T* h, long lh, T* out) {
+	long len = lx + lh - 1;
+	std::vector<T> xp (len + lh - 1, 0), hr (h, h + lh);
+	std::copy (x, x + lx, xp.begin () + (lh - 1));
+	std::reverse (hr.begin (), hr.end ());
+	conv_dot_best (&xp[0], &hr[0], lh, out, len);
+}
+
+// method choice ------------------------------------------------------ //
+
+//! Cost model for one convolution of lx samples with a kernel of lh, in
+//! ns, fitted on x86-64 with AVX2 (bench/conv_bench prints it against
+//! measured times): a direct multiply-add plus copying per sample, a
+//! real FFT per N log2 N (mixed-radix sizes cost FFT_MIXED_COST times
+//! more, transforms past CONV_FFT_CACHE points CONV_FFT_UNCACHED times
+//! more), a split complex multiply-add and the copies per block sample
+static const double CONV_DIRECT_NS = 0.13;
+static const double CONV_COPY_NS = 1.0;
+static const double CONV_FFT_NS = 0.55;
+static const double CONV_FFT_CACHE = 524288;
+static const double CONV_FFT_UNCACHED = 1.7;
+static const double CONV_CMAC_NS = 1.3;
+static const double CONV_BLOCK_NS = 8;
+
+enum ConvMethod { CONV_DIRECT, CONV_FFT, CONV_BLOCKED };
+
+struct ConvChoice {
+	ConvMethod method;
+	long size;		// transform size (FFT) or block (BLOCKED)
+	double cost;	// predicted ns
+};
+
+inline double conv_rfft_cost (long N) {
+	double c = CONV_FFT_NS * N * std::log2 (std::max (N, 2L));
+	if (N & (N - 1)) c *= FFT_MIXED_COST;
+	return N > CONV_FFT_CACHE ? c * CONV_FFT_UNCACHED : c;
+}
+
+//! The cheapest of: direct, one transform of the whole output (padded to
+//! fft_good_size), or a UniformConvolver over blocks of a power of two
+//! (overlap-save, partitioned when the kernel is longer than a block)
+inline ConvChoice conv_choose (long lx, long lh) {
+	double len = (double) lx + lh - 1;
+	ConvChoice best {CONV_DIRECT, 0, CONV_DIRECT_NS * (double) lx * lh + CONV_COPY_NS * len};
+	long N = (long) fft_good_size ((size_t) (lx + lh - 1));
+	double fft = 3 * conv_rfft_cost (N) + CONV_CMAC_NS * (N / 2 + 1);
+	if (fft < best.cost) best = ConvChoice {CONV_FFT, N, fft};
+	for (long B = 64; B < lx + lh - 1 && B <= 65536; B *= 2) {
+		double blocks = std::ceil (len / B), parts = std::ceil ((double) lh / B);
+		double c = parts * conv_rfft_cost (2 * B)
+			+ blocks * (2 * conv_rfft_cost (2 * B) + CONV_BLOCK_NS * B + parts * CONV_CMAC_NS * (B + 1));
+		if (c < best.cost) best = ConvChoice {CONV_BLOCKED, B, c};
+	}
+	return best;
+}
+
+#endif	// CONVOLVER_H
+
+// EOF
@@ -88,12 +88,11 @@ inline T speckurt (
 }
 
 template <typename T>
-inline T specflux (T* amplitudes, T* oldAmplitudes, int N) {
+inline T specflux (const T* amplitudes, const T* oldAmplitudes, int N) {
 	T sf = 0;
 	T a = 0;
 	for (int i = 0; i < N; ++i) {
 		a = (amplitudes[i] - oldAmplitudes[i]);
-		oldAmplitudes[i] = amplitudes[i];
 		sf += a < 0 ? 0 : a; // rectification
 	}
 	
@@ -101,7 +100,7 @@ inline T specflux (T* amplitudes, T* oldAmplitudes, int N) {
 }
 	
 template <typename T>
-inline T specirr (T* amplitudes, int N) { 
+inline T specirr (const T* amplitudes, int N) { 
 	if (1 > N) return 0;
 	T si = 0; // spectral irregularity
 	T a = 0;
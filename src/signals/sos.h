@@ -0,0 +1,189 @@
+// sos.h
+//
+
+// cascades of second-order sections in transposed direct form II: the
+// signal goes through the whole cascade in one pass, a block at a time,
+// with up to four sections' state held in registers; several channels
+// run side by side in the lanes of SIMD registers
+
+#ifndef SOS_H
+#define SOS_H
+
+#include "FFT.h"
+
+#include <algorithm>
+#include <vector>
+
+// coefficients are five per section, b0 b1 b2 a1 a2, normalized by a0;
+// the state is two values per section, z1 and z2
+static const int SOS_GROUP = 4;
+static const long SOS_BLOCK = 256;
+
+//! Runs n samples of d in place through S sections; the SIMD versions
+//! run 2 or 4 channels interleaved frame by frame, as are z1 and z2
+template <typename T, int S>
+void sos_group (const T* c, T* z, T* d, long n) {
+	T k[5 * S], w1[S], w2[S];
+	std::copy (c, c + 5 * S, k);
+	for (int s = 0; s < S; ++s) {
+		w1[s] = z[2 * s];
+		w2[s] = z[2 * s + 1];
+	}
+	for (long i = 0; i < n; ++i) {
+		T v = d[i];
+		for (int s = 0; s < S; ++s) {
+			T o = k[5 * s] * v + w1[s];
+			w1[s] = k[5 * s + 1] * v - k[5 * s + 3] * o + w2[s];
+			w2[s] = k[5 * s + 2] * v - k[5 * s + 4] * o;
+			v = o;
+		}
+		d[i] = v;
+	}
+	for (int s = 0; s < S; ++s) {
+		z[2 * s] = w1[s];
+		z[2 * s + 1] = w2[s];
+	}
+}
+
+#ifdef FFT_X86_SIMD
+template <int S>
+void sos_group_sse2 (const double* c, double* z, double* d, long n) {
+	__m128d k[5 * S], w1[S], w2[S];
+	for (int j = 0; j < 5 * S; ++j) k[j] = _mm_set1_pd (c[j]);
+	for (int s = 0; s < S; ++s) {
+		w1[s] = _mm_loadu_pd (z + 4 * s);
+		w2[s] = _mm_loadu_pd (z + 4 * s + 2);
+	}
+	for (long i = 0; i < n; ++i) {
+		__m128d v = _mm_loadu_pd (d + 2 * i);
+		for (int s = 0; s < S; ++s) {
+			__m128d o = _mm_add_pd (_mm_mul_pd (k[5 * s], v), w1[s]);
+			w1[s] = _mm_add_pd (_mm_sub_pd (_mm_mul_pd (k[5 * s + 1], v), _mm_mul_pd (k[5 * s + 3], o)), w2[s]);
+			w2[s] = _mm_sub_pd (_mm_mul_pd (k[5 * s + 2], v), _mm_mul_pd (k[5 * s + 4], o));
+			v = o;
+		}
+		_mm_storeu_pd (d + 2 * i, v);
+	}
+	for (int s = 0; s < S; ++s) {
+		_mm_storeu_pd (z + 4 * s, w1[s]);
+		_mm_storeu_pd (z + 4 * s + 2, w2[s]);
+	}
+}
+
+// no FMA: each lane rounds exactly as the scalar cascade does
+template <int S>
+__attribute__ ((target ("avx2")))
+void sos_group_avx2 (const double* c, double* z, double* d, long n) {
+	__m256d k[5 * S], w1[S], w2[S];
+	for (int j = 0; j < 5 * S; ++j) k[j] = _mm256_set1_pd (c[j]);
+	for (int s = 0; s < S; ++s) {
+		w1[s] = _mm256_loadu_pd (z + 8 * s);
+		w2[s] = _mm256_loadu_pd (z + 8 * s + 4);
+	}
+	for (long i = 0; i < n; ++i) {
+		__m256d v = _mm256_loadu_pd (d + 4 * i);
+		for (int s = 0; s < S; ++s) {
+			__m256d o = _mm256_add_pd (_mm256_mul_pd (k[5 * s], v), w1[s]);
+			w1[s] = _mm256_add_pd (_mm256_sub_pd (_mm256_mul_pd (k[5 * s + 1], v),
+				_mm256_mul_pd (k[5 * s + 3], o)), w2[s]);
+			w2[s] = _mm256_sub_pd (_mm256_mul_pd (k[5 * s + 2], v), _mm256_mul_pd (k[5 * s + 4], o));
+			v = o;
+		}
+		_mm256_storeu_pd (d + 4 * i, v);
+	}
+	for (int s = 0; s < S; ++s) {
+		_mm256_storeu_pd (z + 8 * s, w1[s]);
+		_mm256_storeu_pd (z + 8 * s + 4, w2[s]);
+	}
+}
+#endif
+
+//! Lanes per SIMD register available for T
+template <typename T>
+int sos_lanes () {
+	return 1;
+}
+
+#ifdef FFT_X86_SIMD
+template <>
+inline int sos_lanes<double> () {
+	return fft_kernel () == FFT_AVX2 ? 4 : 2;
+}
+#endif
+
+template <int S, typename T>
+void sos_group_best (int L, const T* c, T* z, T* d, long n) {
+	sos_group<T, S> (c, z, d, n);
+}
+
+#ifdef FFT_X86_SIMD
+template <int S>
+void sos_group_best (int L, const double* c, double* z, double* d, long n) {
+	if (L == 4) sos_group_avx2<S> (c, z, d, n);
+	else if (L == 2) sos_group_sse2<S> (c, z, d, n);
+	else sos_group<double, S> (c, z, d, n);
+}
+#endif
+
+//! Runs n interleaved frames of L lanes through all ns sections, in
+//! groups of up to SOS_GROUP sections; z holds 2 L values per section
+template <typename T>
+void sos_cascade (int L, const T* c, int ns, T* z, T* d, long n) {
+	for (int s = 0; s < ns; s += SOS_GROUP) {
+		const T* cs = c + 5 * s;
+		T* zs = z + 2 * L * s;
+		switch (std::min (SOS_GROUP, ns - s)) {
+		case 1: sos_group_best<1> (L, cs, zs, d, n); break;
+		case 2: sos_group_best<2> (L, cs, zs, d, n); break;
+		case 3: sos_group_best<3> (L, cs, zs, d, n); break;
+		default: sos_group_best<4> (L, cs, zs, d, n); break;
+		}
+	}
+}
+
+//! Filters n samples of nch channels through a cascade of ns sections:
+//! c holds 5 ns coefficients, z[ch] the 2 ns state values of channel ch
+//! (zero to start, carried over between calls), x[ch] and y[ch] its
+//! input and output, which may be the same buffer. Groups of channels
+//! run in the lanes of one register, a block of frames at a time.
+template <typename T>
+void sos_filter (const T* c, int ns, T* const* z, const T* const* x, T* const* y, int nch, long n) {
+	int L = sos_lanes<T> ();
+	std::vector<T> buf, zl;
+	for (int ch = 0; ch < nch; ) {
+		int m = std::min (L, nch - ch);
+		if (m == 1) {
+			for (long pos = 0; pos < n; pos += SOS_BLOCK) {
+				long len = std::min (SOS_BLOCK, n - pos);
+				if (y[ch] != x[ch]) std::copy (x[ch] + pos, x[ch] + pos + len, y[ch] + pos);
+				sos_cascade<T> (1, c, ns, z[ch], y[ch] + pos, len);
+			}
+			++ch;
+			continue;
+		}
+		// a partial group is padded with silent lanes
+		buf.assign (L * SOS_BLOCK, T (0));
+		zl.assign (2 * L * ns, T (0));
+		for (int j = 0; j < 2 * ns; ++j)
+			for (int l = 0; l < m; ++l) zl[j * L + l] = z[ch + l][j];
+		for (long pos = 0; pos < n; pos += SOS_BLOCK) {
+			long len = std::min (SOS_BLOCK, n - pos);
+			for (int l = 0; l < m; ++l) {
+				const T* xs = x[ch + l] + pos;
+				for (long i = 0; i < len; ++i) buf[i * L + l] = xs[i];
+			}
+			sos_cascade<T> (L, c, ns, &zl[0], &buf[0], len);
+			for (int l = 0; l < m; ++l) {
+				T* ys = y[ch + l] + pos;
+				for (long i = 0; i < len; ++i) ys[i] = buf[i * L + l];
+			}
+		}
+		for (int j = 0; j < 2 * ns; ++j)
+			for (int l = 0; l < m; ++l) z[ch + l][j] = zl[j * L + l];
+		ch += m;
+	}
+}
+
+#endif	// SOS_H
+
+// EOF
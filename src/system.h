@@ -9,6 +9,7 @@
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
@@ -41,37 +42,44 @@ static ArrayPtr aref(const Value& v, const std::string& fn) {
 
 static ArrayPtr strings_to_array(const std::vector<std::string>& xs) {
     auto out = std::make_shared<Array>();
-    for (const auto& s : xs) out->elems.push_back(s);
+    out->reserve(xs.size());
+    for (const auto& s : xs) out->push(s);
     return out;
 }
 
-static ArrayPtr csv_table_to_array(const std::vector<std::vector<std::string>>& table) {
+// Rows are converted as they are parsed, so the whole file is never held
+// as strings; all-numeric rows end up as packed arrays.
+static ArrayPtr read_csv_to_array(std::istream& in) {
     auto rows = std::make_shared<Array>();
-    for (const auto& row : table) {
+    std::string line;
+    while (std::getline(in, line)) {
+        auto row = readCSVRow(line);
+        if (row.size() == 1 && row[0].empty()) continue;
         auto r = std::make_shared<Array>();
+        r->reserve(row.size());
         for (const auto& cell : row) {
             char* end = nullptr;
             double x = std::strtod(cell.c_str(), &end);
-            if (!cell.empty() && end && *end == '\0') r->elems.push_back(NumVal{x});
-            else r->elems.push_back(cell);
+            if (!cell.empty() && end && *end == '\0') r->push_num(x);
+            else r->push(cell);
         }
-        rows->elems.push_back(r);
+        rows->push(r);
     }
     return rows;
 }
 
 static std::vector<std::vector<std::string>> array_to_csv_table(const ArrayPtr& table) {
     std::vector<std::vector<std::string>> out;
-    out.reserve(table->elems.size());
-    for (const auto& rowv : table->elems) {
-        ArrayPtr row = aref(rowv, "writecsv");
+    out.reserve(table->size());
+    for (std::size_t i = 0; i < table->size(); ++i) {
+        ArrayPtr row = aref(table->get(i), "writecsv");
         std::vector<std::string> r;
-        r.reserve(row->elems.size());
-        for (const auto& cell : row->elems) {
+        r.reserve(row->size());
+        row->each([&r](const Value& cell) {
             if (std::holds_alternative<std::string>(cell)) r.push_back(std::get<std::string>(cell));
             else if (std::holds_alternative<NumVal>(cell)) r.push_back(to_str(cell));
             else throw Error{"system", -1, "writecsv: cells must be strings or numeric values", {}};
-        }
+        });
         out.push_back(std::move(r));
     }
     return out;
@@ -79,25 +87,29 @@ static std::vector<std::vector<std::string>> array_to_csv_table(const ArrayPtr&
 
 static Value wav_channels_to_value(uint32_t sr, const std::vector<std::vector<double>>& channels) {
     auto res = std::make_shared<Array>();
-    res->elems.push_back(NumVal{static_cast<double>(sr)});
+    res->push(NumVal{static_cast<double>(sr)});
     auto chs = std::make_shared<Array>();
     for (const auto& ch : channels) {
-        if (ch.empty()) chs->elems.push_back(NumVal{});
-        else chs->elems.push_back(NumVal(ch.data(), ch.size()));
+        if (ch.empty()) chs->push(NumVal{});
+        else chs->push(NumVal(ch.data(), ch.size()));
     }
-    res->elems.push_back(chs);
+    res->push(chs);
     return res;
 }
 
 static std::vector<std::vector<double>> value_to_wav_channels(const ArrayPtr& chs) {
     std::vector<std::vector<double>> out;
-    out.reserve(chs->elems.size());
+    out.reserve(chs->size());
     std::size_t n = 0;
     bool first = true;
-    for (const auto& v : chs->elems) {
-        if (!std::holds_alternative<NumVal>(v))
+    // a packed array holds one-sample channels
+    std::vector<Value> held;
+    if (chs->packed()) held = chs->values();
+    for (std::size_t c = 0; c < chs->size(); ++c) {
+        const Value& ch = chs->packed() ? held[c] : chs->at(c);
+        if (!std::holds_alternative<NumVal>(ch))
             throw Error{"system", -1, "writewav: channel list must contain vectors", {}};
-        const auto& nv = std::get<NumVal>(v);
+        const auto& nv = std::get<NumVal>(ch);
         if (first) {
             n = nv.size();
             first = false;
@@ -137,6 +149,12 @@ static Value fn_dirlist(std::vector<Value>& args, Interpreter& interp) {
     return strings_to_array(names);
 }
 
+static Value fn_rmfile(std::vector<Value>& args, Interpreter& interp) {
+    if (args.size() != 1) throw Error{interp.filename, interp.cur_line(), "rmfile: expected 1 argument", {}};
+    std::string path = interp.resolve_path(sref(args[0], "rmfile"));
+    return NumVal{std::remove(path.c_str()) == 0 ? 1.0 : 0.0};
+}
+
 static Value fn_filestat(std::vector<Value>& args, Interpreter& interp) {
     if (args.size() != 1) throw Error{interp.filename, interp.cur_line(), "filestat: expected 1 argument", {}};
     std::string raw_path = sref(args[0], "filestat");
@@ -144,10 +162,10 @@ static Value fn_filestat(std::vector<Value>& args, Interpreter& interp) {
     struct stat st {};
     auto out = std::make_shared<Array>();
     int r = stat(filename.c_str(), &st);
-    out->elems.push_back(NumVal{r == 0 ? 1.0 : 0.0});
+    out->push(NumVal{r == 0 ? 1.0 : 0.0});
     if (r != 0) return out;
-    out->elems.push_back(NumVal{static_cast<double>(st.st_size)});
-    out->elems.push_back(NumVal{static_cast<double>(st.st_nlink)});
+    out->push(NumVal{static_cast<double>(st.st_size)});
+    out->push(NumVal{static_cast<double>(st.st_nlink)});
     std::stringstream tt;
     tt << (S_ISDIR(st.st_mode) ? "d" : "-")
        << ((st.st_mode & S_IRUSR) ? "r" : "-")
@@ -159,7 +177,7 @@ static Value fn_filestat(std::vector<Value>& args, Interpreter& interp) {
        << ((st.st_mode & S_IROTH) ? "r" : "-")
        << ((st.st_mode & S_IWOTH) ? "w" : "-")
        << ((st.st_mode & S_IXOTH) ? "x" : "-");
-    out->elems.push_back(tt.str());
+    out->push(tt.str());
     return out;
 }
 
@@ -243,7 +261,7 @@ static Value fn_readcsv(std::vector<Value>& args, Interpreter& interp) {
     std::string raw_path = sref(args[0], "readcsv");
     std::ifstream file(interp.resolve_path(raw_path));
     if (!file) throw Error{interp.filename, interp.cur_line(), "readcsv: cannot open file", {}};
-    return csv_table_to_array(readCSV(file));
+    return read_csv_to_array(file);
 }
 
 static Value fn_writecsv(std::vector<Value>& args, Interpreter& interp) {
@@ -287,7 +305,7 @@ static Value fn_writewav(std::vector<Value>& args, Interpreter& interp) {
     std::memcpy(header.data, "data", 4);
     header.subchunk1Size = 16;
     header.audioFormat   = 1;
-    header.numChannels   = static_cast<uint16_t>(chs->elems.size());
+    header.numChannels   = static_cast<uint16_t>(chs->size());
     header.sampleRate    = static_cast<uint32_t>(sr);
     header.bitsPerSample = 16;
     header.blockAlign    = static_cast<uint16_t>(header.numChannels * header.bitsPerSample / 8);
@@ -298,6 +316,45 @@ static Value fn_writewav(std::vector<Value>& args, Interpreter& interp) {
     return NumVal{1.0};
 }
 
+// wavinfo(path) -> map with sr, channels, frames and bits, read from the header
+static Value fn_wavinfo(std::vector<Value>& args, Interpreter& interp) {
+    if (args.size() != 1) throw Error{interp.filename, interp.cur_line(), "wavinfo: expected 1 argument", {}};
+    WavReader reader(interp.resolve_path(sref(args[0], "wavinfo")).c_str());
+    auto m = std::make_shared<Map>();
+    m->set(MapKey{false, 0, "sr"},       NumVal{(double)reader.header.sampleRate});
+    m->set(MapKey{false, 0, "channels"}, NumVal{(double)reader.header.numChannels});
+    m->set(MapKey{false, 0, "frames"},   NumVal{(double)reader.frames});
+    m->set(MapKey{false, 0, "bits"},     NumVal{(double)reader.header.bitsPerSample});
+    return m;
+}
+
+// wavstream(path [, block]) -> generator of blocks read lazily from the
+// file; each block is an array with one vector per channel, `block` frames
+// long (4096 by default, the last one may be shorter).
+struct WavStream : Generator {
+    WavReader   reader;
+    std::size_t block;
+    WavStream(const std::string& path, std::size_t b) : reader(path.c_str()), block(b) {}
+    bool pull(Value& out, Interpreter&) override {
+        if (reader.position >= reader.frames) return false;
+        std::vector<std::vector<double>> chs;
+        reader.read(chs, block);
+        auto res = std::make_shared<Array>();
+        for (const auto& ch : chs) res->push(NumVal(ch.data(), ch.size()));
+        out = res;
+        return true;
+    }
+};
+
+static Value fn_wavstream(std::vector<Value>& args, Interpreter& interp) {
+    if (args.size() != 1 && args.size() != 2)
+        throw Error{interp.filename, interp.cur_line(), "wavstream: expected 1 or 2 arguments", {}};
+    std::string path = interp.resolve_path(sref(args[0], "wavstream"));
+    double block = args.size() == 2 ? scalar(args[1], "wavstream") : 4096.0;
+    if (block < 1) throw Error{interp.filename, interp.cur_line(), "wavstream: block must be positive", {}};
+    return NativePtr{std::make_shared<WavStream>(path, (std::size_t)block)};
+}
+
 // ── Registration ─────────────────────────────────────────────────────────────
 
 inline void add_system(Environment& env) {
@@ -305,6 +362,7 @@ inline void add_system(Environment& env) {
     env.register_builtin("clock",    fn_clock);
     env.register_builtin("dirlist",  fn_dirlist);
     env.register_builtin("filestat", fn_filestat);
+    env.register_builtin("rmfile",   fn_rmfile);
     env.register_builtin("getvar",   fn_getvar);
     env.register_builtin("udprecv",  fn_udprecv);
     env.register_builtin("udpsend",  fn_udpsend);
@@ -312,6 +370,8 @@ inline void add_system(Environment& env) {
     env.register_builtin("writecsv", fn_writecsv);
     env.register_builtin("readwav",  fn_readwav);
     env.register_builtin("writewav", fn_writewav);
+    env.register_builtin("wavinfo",  fn_wavinfo);
+    env.register_builtin("wavstream", fn_wavstream);
 }
 
 #endif // SYSTEM_H
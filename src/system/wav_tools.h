@@ -8,6 +8,9 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
 
 // WAV I/O -----------------------------------------------------------------
 struct WAVHeader {
@@ -26,60 +29,88 @@ struct WAVHeader {
     uint32_t dataSize;         // size of data section in bytes
 };
 
-inline std::vector<std::vector<double>> read_wav_raw(const char* filename, WAVHeader& header) {
-    std::stringstream err;
-    std::ifstream file(filename, std::ios::binary);
-    if (!file) {
-        err << "cannot open WAV file " << filename;
-        throw std::runtime_error(err.str());
-    }
+// Incremental reader: the header is validated on open and samples are
+// decoded block by block, so a file can be processed without loading it
+// whole (see wavstream()).
+struct WavReader {
+    std::ifstream file;
+    WAVHeader     header{};
+    std::size_t   frames   = 0;   // frames in the data chunk
+    std::size_t   position = 0;   // frames read so far
+
+    explicit WavReader(const char* filename) : file(filename, std::ios::binary) {
+        std::stringstream err;
+        if (!file) {
+            err << "cannot open WAV file " << filename;
+            throw std::runtime_error(err.str());
+        }
 
-    file.read(reinterpret_cast<char*>(&header), sizeof(WAVHeader));
-    if (!file.good()) {
-        err << "invalid or truncated WAV header";
-        throw std::runtime_error(err.str());
-    }
+        file.read(reinterpret_cast<char*>(&header), sizeof(WAVHeader));
+        if (!file.good()) {
+            err << "invalid or truncated WAV header";
+            throw std::runtime_error(err.str());
+        }
 
-    if (header.audioFormat != 1 && header.audioFormat != 3) { // PCM or IEEE float
-        err << "unsupported WAV format (not PCM or IEEE float)";
-        throw std::runtime_error(err.str());
-    }
+        if (header.audioFormat != 1 && header.audioFormat != 3) { // PCM or IEEE float
+            err << "unsupported WAV format (not PCM or IEEE float)";
+            throw std::runtime_error(err.str());
+        }
 
-    if (header.bitsPerSample != 16 && !(header.bitsPerSample == 32 && header.audioFormat == 3)) {
-        err << "unsupported bits per sample: " << header.bitsPerSample;
-        throw std::runtime_error(err.str());
-    }
+        if (header.bitsPerSample != 16 && !(header.bitsPerSample == 32 && header.audioFormat == 3)) {
+            err << "unsupported bits per sample: " << header.bitsPerSample;
+            throw std::runtime_error(err.str());
+        }
 
-    int bytesPerSample = header.bitsPerSample / 8;
-    int numSamples = static_cast<int>(header.dataSize / bytesPerSample);
-    numSamples /= header.numChannels;
+        if (header.numChannels == 0) {
+            err << "invalid WAV header: no channels";
+            throw std::runtime_error(err.str());
+        }
 
-    std::vector<std::vector<double>> channels(
-        header.numChannels, std::vector<double>(numSamples));
+        frames = header.dataSize / (header.bitsPerSample / 8) / header.numChannels;
+    }
 
-    for (int i = 0; i < numSamples; ++i) {
-        for (int ch = 0; ch < header.numChannels; ++ch) {
-            if (header.bitsPerSample == 16) {
-                int16_t sample;
-                file.read(reinterpret_cast<char*>(&sample), sizeof(int16_t));
-                if (!file.good()) {
-                    err << "unexpected EOF while reading samples";
-                    throw std::runtime_error(err.str());
-                }
-                channels[ch][i] = sample / 32768.0;  // [-1,1]
-            } else if (header.bitsPerSample == 32 && header.audioFormat == 3) {
-                float sample;
-                file.read(reinterpret_cast<char*>(&sample), sizeof(float));
-                if (!file.good()) {
-                    err << "unexpected EOF while reading samples";
-                    throw std::runtime_error(err.str());
+    // Appends up to `count` frames to each of `channels`; returns the
+    // number of frames read.
+    std::size_t read(std::vector<std::vector<double>>& channels, std::size_t count) {
+        count = std::min(count, frames - position);
+        std::size_t nch = header.numChannels;
+        std::size_t bytesPerSample = header.bitsPerSample / 8;
+        channels.resize(nch);
+        std::size_t base = channels[0].size();
+        for (auto& ch : channels) ch.resize(base + count);
+
+        std::vector<char> raw;
+        const std::size_t step = 16384;
+        for (std::size_t done = 0; done < count; done += step) {
+            std::size_t n = std::min(step, count - done);
+            raw.resize(n * nch * bytesPerSample);
+            file.read(raw.data(), (std::streamsize)raw.size());
+            if (!file.good()) throw std::runtime_error("unexpected EOF while reading samples");
+            const char* p = raw.data();
+            for (std::size_t i = 0; i < n; ++i) {
+                for (std::size_t ch = 0; ch < nch; ++ch, p += bytesPerSample) {
+                    if (header.bitsPerSample == 16) {
+                        int16_t sample;
+                        std::memcpy(&sample, p, sizeof(int16_t));
+                        channels[ch][base + done + i] = sample / 32768.0;  // [-1,1]
+                    } else {
+                        float sample;
+                        std::memcpy(&sample, p, sizeof(float));
+                        channels[ch][base + done + i] = sample;  // already [-1,1]
+                    }
                 }
-                channels[ch][i] = sample;  // already [-1,1]
             }
         }
+        position += count;
+        return count;
     }
+};
 
-    file.close();
+inline std::vector<std::vector<double>> read_wav_raw(const char* filename, WAVHeader& header) {
+    WavReader reader(filename);
+    header = reader.header;
+    std::vector<std::vector<double>> channels(header.numChannels);
+    reader.read(channels, reader.frames);
     return channels;
 }
 
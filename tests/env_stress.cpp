@@ -0,0 +1,268 @@
+// env_stress.cpp
+//
+// Runs many forks of one frozen prelude on parallel threads and checks
+// that every job sees its own globals and the prelude stays untouched.
+//
+// usage: env_stress [threads] [jobs per thread]
+
+#include "musil.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const char* PRELUDE_EXTRA = R"(
+var TABLE = [1, 2, 3]
+var SETTINGS = map("gain", 1)
+var COUNT = 0
+proc bump () {
+    COUNT = COUNT + 1
+    return COUNT
+}
+proc count () {
+    return COUNT
+}
+proc first () {
+    return TABLE[0]
+}
+)";
+
+static const char* JOB = R"(
+var acc = 0
+var i = 0
+while (i < 2000) {
+    acc = acc + mod(i, 7)
+    i = i + 1
+}
+TABLE[0] = JOB
+set(SETTINGS, "gain", JOB)
+var k = 0
+while (k < JOB) {
+    bump()
+    k = k + 1
+}
+proc make_adder (n) {
+    proc add (x) { return x + n }
+    return add
+}
+var adders = []
+var j = 0
+while (j < 200) {
+    push(adders, make_adder(j))
+    j = j + 1
+}
+var last = adders[199](JOB)
+gc()
+var words = sort(["delta", "alpha", str(JOB), "charlie"])
+var joined = join(words, ",")
+var big = zeros(10000 + JOB)
+var total = sum(big + 1)
+var squares = pmap(range(0, 100), proc (x) { return x * x + count() }, 8)
+var firsts = pmap(range(0, 4), proc (x) { return first() }, 1)
+var pending = [spawn(proc (n) { return n * 2 + bump() - COUNT }, JOB), spawn("sum", vec(JOB, 1))]
+JOB = JOB + 1000
+var spawned = await_all(pending)
+JOB = JOB - 1000
+)";
+
+static string read_file (const string& path) {
+	ifstream f (path);
+	if (!f) throw runtime_error ("cannot open '" + path + "'");
+	return string (istreambuf_iterator<char> (f), {});
+}
+
+static double num (Environment& env, const string& name) {
+	return std::get<NumVal> (env.global->vars.at (name))[0];
+}
+
+int main (int argc, char* argv[]) {
+	int threads = argc > 1 ? atoi (argv[1]) : 8;
+	int jobs = argc > 2 ? atoi (argv[2]) : 25;
+
+	Environment prelude;
+	add_scientific (prelude);
+	add_system (prelude);
+	add_signals (prelude);
+	add_plotting (prelude);
+	add_rtsound (prelude);
+	try {
+		for (const char* lib : {"stdlib.mu", "scientific.mu", "signals.mu"}) {
+			string path = string (MUSIL_SOURCE_DIR) + "/" + lib;
+			prelude.exec (read_file (path), path);
+		}
+		prelude.exec (PRELUDE_EXTRA, "<prelude>");
+	} catch (Error& e) {
+		cerr << format_error (e) << endl;
+		return 1;
+	}
+	prelude.freeze ();
+
+	atomic<int> failures {0};
+	auto check = [&] (bool ok, int job, const string& what) {
+		if (!ok) {
+			failures++;
+			cerr << "job " << job << ": " << what << endl;
+		}
+	};
+
+	vector<thread> pool;
+	for (int t = 0; t < threads; ++t) {
+		pool.emplace_back ([&, t] {
+			for (int r = 0; r < jobs; ++r) {
+				int id = t * jobs + r + 1;
+				Environment env = prelude.fork ();
+				env.global->vars["JOB"] = NumVal {(double) id};
+				try {
+					env.exec (JOB, "<job>");
+				} catch (Error& e) {
+					check (false, id, format_error (e));
+					continue;
+				}
+				check (num (env, "acc") == 5995, id, "loop result");
+				check (num (env, "COUNT") == id, id, "prelude proc writes fork globals");
+				check (num (env, "last") == 199 + id, id, "closures");
+				check (num (env, "total") == 10000 + id, id, "vector sum");
+				auto squares = std::get<ArrayPtr> (env.global->vars.at ("squares"));
+				check (std::get<NumVal> (squares->get (99))[0] == 9801 + id, id, "pmap reads fork globals");
+				auto firsts = std::get<ArrayPtr> (env.global->vars.at ("firsts"));
+				check (std::get<NumVal> (firsts->get (3))[0] == id, id, "pmap reads fork arrays");
+				auto spawned = std::get<ArrayPtr> (env.global->vars.at ("spawned"));
+				check (std::get<NumVal> (spawned->get (0))[0] == 2 * id, id, "spawn proc");
+				check (std::get<NumVal> (spawned->get (1))[0] == id + 1, id, "spawn builtin");
+				auto table = std::get<ArrayPtr> (env.global->vars.at ("TABLE"));
+				check (std::get<NumVal> (table->get (0))[0] == id, id, "copy-on-write array");
+				check (std::get<string> (env.global->vars.at ("joined")).find (to_string (id)) != string::npos,
+					id, "strings");
+			}
+		});
+	}
+	for (auto& th : pool) th.join ();
+
+	auto table = std::get<ArrayPtr> (prelude.global->vars.at ("TABLE"));
+	check (std::get<NumVal> (table->get (0))[0] == 1, 0, "prelude array modified");
+	check (num (prelude, "COUNT") == 0, 0, "prelude global modified");
+	auto gain = std::get<MapPtr> (prelude.global->vars.at ("SETTINGS"))->find (MapKey {false, 0, "gain"});
+	check (gain && std::get<NumVal> (*gain)[0] == 1, 0, "prelude map modified");
+
+	// a stop request reaches pmap chunks, spawned tasks and generator bodies
+	static const char* RUNAWAY[] = {
+		"pmap(range(0, 4), proc (x) { while (1) { x = x + 1 } }, 1)",
+		"await(spawn(proc () { while (1) { } }))",
+		"proc forever () { while (1) { } yield 1 }\nnext(forever())",
+	};
+	for (const char* src : RUNAWAY) {
+		Environment env = prelude.fork ();
+		atomic<bool> stop {false};
+		env.set_yield ([&stop] {
+			if (stop) throw runtime_error ("stopped");
+		});
+		thread stopper ([&] {
+			this_thread::sleep_for (chrono::milliseconds (100));
+			stop = true;
+			env.request_yield ();
+		});
+		bool stopped = false;
+		try {
+			env.exec (src, "<runaway>");
+		} catch (Error& e) {
+			stopped = e.msg.find ("stopped") != string::npos;
+		} catch (std::exception& e) {
+			stopped = string (e.what ()) == "stopped";
+		}
+		stopper.join ();
+		check (stopped, 0, string ("stop request not delivered: ") + src);
+	}
+
+	// a suspended generator holds no thread, so any number can be live;
+	// a body that pulls itself gets an error instead of hanging
+	{
+		Environment env = prelude.fork ();
+		env.exec ("proc gen (k) { for (var j in range(0, 3)) { if (j > 0) { yield k + j } } }\n"
+		          "var gs = []\nvar total = 0\n"
+		          "for (var i in range(0, 2000)) { push(gs, gen(i)) }\n"
+		          "for (var g in gs) { total = total + next(g) }\n"
+		          "for (var g in gs) { total = total + next(g) + next(g, 0) }",
+		          "<generators>");
+		check (num (env, "total") == 1999 * 2000 + 3 * 2000, 0, "live generators lost their place");
+		bool running = false;
+		try {
+			env.exec ("proc again () { yield next(self) }\nvar self = again()\nnext(self)", "<generators>");
+		} catch (Error& e) {
+			running = e.msg.find ("generator is already running") != string::npos;
+		}
+		check (running, 0, "generator pulled itself");
+	}
+
+	// variables the optimizer hoists out of top-level loops are not left
+	// behind as globals
+	{
+		Environment env = prelude.fork ();
+		env.exec ("var s = 0\nfor (var x in range(0, 10)) { s = s + sqrt(16) }\n"
+		          "var i = 0\nwhile (i < 10) {\n  s = s + sqrt(25)\n  i = i + 1\n}", "<hoist>");
+		check (num (env, "s") == 90, 0, "hoisted loops");
+		for (auto& kv : env.global->vars)
+			check (kv.first.compare (0, 5, "__inv") && kv.first.compare (0, 5, "__seq"), 0,
+			       "hoisted variable left behind: " + kv.first);
+	}
+
+	// over its limit a job gets an ordinary error; once the accounting
+	// slots run out a limit is refused instead of capping the shared slot
+	{
+		Environment env = prelude.fork ();
+		env.set_mem_limit (1 << 20);
+		bool limited = false;
+		try {
+			env.exec ("var z = zeros(1e6)", "<limit>");
+		} catch (Error& e) {
+			limited = e.msg.find ("memory limit exceeded") != string::npos;
+		}
+		check (limited, 0, "memory limit not enforced");
+		Environment moved = std::move (env);
+		limited = false;
+		try {
+			moved.exec ("var z = zeros(1e6)", "<limit>");
+		} catch (Error& e) {
+			limited = e.msg.find ("memory limit exceeded") != string::npos;
+		}
+		check (limited, 0, "memory limit lost by a move");
+		for (const char* grow : {"push(a, [1, 2])", "set(m, len(a), 1) push(a, 0)"}) {
+			Environment small = prelude.fork ();
+			small.set_mem_limit (1 << 20);
+			limited = false;
+			try {
+				small.exec (string ("var a = [] var m = map() while (len(a) < 1e6) { ") + grow + " }",
+				            "<limit>");
+			} catch (Error& e) {
+				limited = e.msg.find ("memory limit exceeded") != string::npos;
+			}
+			check (limited, 0, string ("small containers escape the limit: ") + grow);
+		}
+		vector<unique_ptr<Environment>> many;
+		bool refused = false;
+		for (unsigned i = 0; i < MEM_SLOTS && !refused; ++i) {
+			many.push_back (make_unique<Environment> ());
+			try {
+				many.back ()->set_mem_limit (1 << 20);
+			} catch (Error&) {
+				refused = true;
+			}
+		}
+		check (refused, 0, "memory limit set on the shared slot");
+	}
+
+	if (failures) {
+		cerr << failures << " failures" << endl;
+		return 1;
+	}
+	cout << threads * jobs << " jobs on " << threads << " threads: ok" << endl;
+	return 0;
+}
+
+// eof
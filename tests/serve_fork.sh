@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# serve_fork.sh MUSIL
+#
+# Jobs forked by musil --serve after a preloaded library has started the
+# work pool must still finish, report their status and be able to use
+# the pool themselves.
+
+musil=$1
+dir=$(mktemp -d)
+server=
+cleanup () {
+	[ -n "$server" ] && kill "$server" 2> /dev/null
+	rm -rf "$dir"
+}
+trap cleanup EXIT
+
+echo 'var WARM = pmap(range(0, 64), proc (x) { return x * 2 }, 1)' > "$dir/lib.mu"
+echo 'print 1 + 1' > "$dir/plain.mu"
+echo 'print sum(to_vec(pmap(range(0, 8), proc (x) { return x }, 1)))' > "$dir/pool.mu"
+
+MUSIL_THREADS=4 "$musil" --serve "$dir/sock" "$dir/lib.mu" > "$dir/server.log" 2>&1 &
+server=$!
+i=0
+while [ ! -S "$dir/sock" ]; do
+	i=$((i + 1))
+	if [ $i -gt 100 ]; then
+		echo "server did not start"
+		cat "$dir/server.log"
+		exit 1
+	fi
+	sleep 0.1
+done
+
+check () {
+	out=$(timeout 20 "$musil" --client "$dir/sock" "$dir/$1")
+	status=$?
+	if [ $status -ne 0 ] || [ "$out" != "$2" ]; then
+		echo "$1: status $status, output '$out', expected '$2'"
+		exit 1
+	fi
+}
+check plain.mu 2
+check pool.mu 28
+echo "serve_fork: ok"